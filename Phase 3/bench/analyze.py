@@ -0,0 +1,404 @@
+#!/usr/bin/env python3
+"""Static hazard and CPI estimator for .mc programs.
+
+Reads the text segment of an .mc file and builds the control-flow graph from
+the branch and jal encodings. It counts the data stalls of every basic block
+under the hazard rules of pipeline_decode, with and without forwarding, and
+estimates CPI without running the pipeline:
+
+    python3 analyze.py prog.mc                                # static, loop-depth weights
+    python3 analyze.py prog.mc --profile branch_profile.txt   # weighted by a real profile
+    python3 analyze.py prog.mc --top 5 --json report.json
+
+Timing model, calibrated against the CPI stack of the pipelined simulator:
+  * without forwarding, decode waits while a source register's writer is in
+    EX/MEM or MEM/WB, so a consumer issues 3 cycles after its producer;
+  * with forwarding only a load holds decode, and the consumer issues 2
+    cycles after it;
+  * a mispredicted branch and every jalr flush one cycle (jal is redirected
+    in fetch), and filling/draining the pipeline costs 4 cycles;
+  * a mul/div or RV32F op holds EX for its latency, which defaults to 1 as in
+    the simulator; pass the simulator's --*-latency values along.
+
+f-registers are numbered 32-63 and v-registers 64-95, as the simulator does,
+so their hazards are counted like those of the integer registers. An RVV
+instruction holds EX for a time that depends on vl, which a static pass does
+not know; it is counted as one cycle, so vector loops come out optimistic.
+An ecall that makes a system call drains the pipeline, which is not counted
+either; the estimate only covers the code between system calls.
+
+Block frequencies come from the simulator's --branch-profile output. The
+misprediction count of a branch is then estimated for the 1-bit predictor
+from its taken/not-taken counts. Without a profile a block is weighted
+10^(loop depth), where the loops are the backward branches and jumps around
+it, and only data stalls and jalr flushes enter the CPI estimate.
+
+Stalls are counted inside each block and across every CFG edge into it; a
+block entered from a call return (jalr) starts with an empty pipeline.
+"""
+import argparse
+import bisect
+import json
+import sys
+
+MODELS = ("forwarding", "no-forwarding")
+MAX_LOOP_DEPTH = 6      # static weights stop at 10^6
+EX_LATENCY = {"mul": 1, "div": 1, "fp": 1, "fmul": 1, "fdiv": 1}   # EX cycles, set from the command line
+FP_REG = 32
+FP_OPCODES = (0x07, 0x27, 0x43, 0x47, 0x4B, 0x4F, 0x53)
+VEC_REG = 64
+
+
+def sign(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+class Op:
+    """One instruction, with registers decoded the way pipeline_decode does."""
+
+    def __init__(self, pc, word, text):
+        self.pc, self.word, self.text = pc, word, text
+        opcode = word & 0x7F
+        rd, rs1, rs2 = (word >> 7) & 0x1F, (word >> 15) & 0x1F, (word >> 20) & 0x1F
+        self.opcode = opcode
+        self.rs1 = rs1 if opcode in (0x33, 0x63, 0x23, 0x13, 0x03, 0x67) else 0
+        self.rs2 = rs2 if opcode in (0x33, 0x63, 0x23) else 0
+        self.rd = rd if opcode in (0x33, 0x13, 0x37, 0x17, 0x6F, 0x67, 0x03) else 0
+        self.rs3 = 0
+        self.load = opcode == 0x03
+        self.unit = None
+        if opcode == 0x33 and word >> 25 == 0x01:
+            self.unit = "mul" if (word >> 12) & 0x7 < 4 else "div"
+        func3 = (word >> 12) & 0x7
+        if opcode == 0x57 or (opcode in (0x07, 0x27) and func3 != 2):   # flw/fsw have width 2
+            self.vector_registers(word, rd, rs1, rs2)
+        elif opcode in FP_OPCODES:
+            self.fp_registers(word, rd, rs1, rs2)
+        elif opcode == 0x73 and func3:                  # Zicsr: csrr*i have a zimm in the rs1 field
+            self.rs1, self.rd = (rs1 if func3 < 4 else 0), rd
+        self.ecall = opcode == 0x73 and not func3
+        self.target = None
+        if opcode == 0x63:
+            imm = ((word >> 31) & 1) << 12 | ((word >> 7) & 1) << 11 | ((word >> 25) & 0x3F) << 5 | ((word >> 8) & 0xF) << 1
+            self.target = pc + sign(imm, 13)
+        elif opcode == 0x6F:
+            imm = ((word >> 31) & 1) << 20 | ((word >> 12) & 0xFF) << 12 | ((word >> 20) & 1) << 11 | ((word >> 21) & 0x3FF) << 1
+            self.target = pc + sign(imm, 21)
+
+    def fp_registers(self, word, rd, rs1, rs2):
+        opcode, func5 = self.opcode, word >> 27
+        if opcode == 0x07:                              # flw
+            self.rs1, self.rd, self.load = rs1, FP_REG + rd, True
+        elif opcode == 0x27:                            # fsw
+            self.rs1, self.rs2 = rs1, FP_REG + rs2
+        elif opcode != 0x53:                            # fmadd family
+            self.rs1, self.rs2, self.rd, self.unit = FP_REG + rs1, FP_REG + rs2, FP_REG + rd, "fmul"
+            self.rs3 = FP_REG + (word >> 27)
+        else:
+            self.rs1 = rs1 if func5 in (0x1A, 0x1E) else FP_REG + rs1
+            self.rs2 = FP_REG + rs2 if func5 not in (0x0B, 0x18, 0x1A, 0x1C, 0x1E) else 0
+            self.rd = rd if func5 in (0x14, 0x18, 0x1C) else FP_REG + rd
+            self.unit = "fmul" if func5 == 0x02 else "fdiv" if func5 in (0x03, 0x0B) else "fp"
+
+    def vector_registers(self, word, rd, rs1, rs2):
+        """The vector unit accesses memory in EX, so a vector load holds no consumer."""
+        func3, funct6 = (word >> 12) & 0x7, word >> 26
+        stride = rs2 if funct6 & 0x3 == 0x2 else 0      # mop 2: strided, x[rs2] is the stride
+        if self.opcode == 0x07:                         # vle/vlse
+            self.rs1, self.rs2, self.rd = rs1, stride, VEC_REG + rd
+        elif self.opcode == 0x27:                       # vse/vsse: the data register is in the rd field
+            self.rs1, self.rs2, self.rs3 = rs1, stride, VEC_REG + rd
+        elif func3 == 7:                                # vsetvli
+            self.rs1, self.rd = rs1, rd
+        else:
+            to_x = funct6 == 0x10 and func3 == 2        # vmv.x.s
+            no_vs2 = funct6 == 0x17 or (funct6 == 0x10 and func3 == 6)  # vmv.v.*, vmv.s.x
+            self.rs1 = VEC_REG + rs1 if func3 in (0, 2) and not to_x else rs1 if func3 in (4, 6) else 0
+            self.rs2 = 0 if no_vs2 else VEC_REG + rs2
+            self.rd = rd if to_x else VEC_REG + rd
+
+    @property
+    def control(self):
+        return self.opcode in (0x63, 0x6F, 0x67) or self.ecall
+
+
+def read_mc(path):
+    ops = []
+    with open(path) as f:
+        for line in f:
+            if line.startswith("#Data Segment"):
+                break
+            parts = line.split(None, 2)
+            if len(parts) < 2 or not parts[0].startswith("0x") or parts[1] == "0x":
+                continue
+            text = parts[2].rsplit(" #", 1)[0].strip() if len(parts) > 2 else ""
+            ops.append(Op(int(parts[0], 16), int(parts[1], 16), text))
+    return ops
+
+
+def read_profile(path):
+    branches, blocks = {}, {}
+    with open(path) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) >= 4 and parts[0] == "branch":
+                branches[int(parts[1], 16)] = (int(parts[2]), int(parts[3]))
+            elif len(parts) >= 3 and parts[0] == "block":
+                blocks[int(parts[1], 16)] = int(parts[2])
+    return branches, blocks
+
+
+def ex_extra(op):
+    return EX_LATENCY[op.unit] - 1 if op.unit else 0
+
+
+def issue(ops, model, ready=None):
+    """Issue cycles of ops in order; returns (stalls, ready, stalled pairs)."""
+    ready = dict(ready or {})      # register -> (first cycle a consumer may issue, producer)
+    cycle, stalls, pairs = 0, 0, []
+    for op in ops:
+        wait = cycle + 1
+        producer = None
+        for reg in (op.rs1, op.rs2, op.rs3):
+            if reg and reg in ready and ready[reg][0] > wait:
+                wait, producer = ready[reg]
+        if producer is not None:
+            pairs.append((producer, op, wait - cycle - 1))
+        stalls += wait - cycle - 1
+        # everything behind a multi-cycle op waits in ID; that is structural, not a data stall
+        cycle = wait + ex_extra(op)
+        if op.rd:
+            if model == "no-forwarding":
+                ready[op.rd] = (cycle + 3, op)
+            elif op.load:
+                ready[op.rd] = (cycle + 2, op)
+            else:
+                ready.pop(op.rd, None)
+    # relative to the next block, whose first op would issue at cycle + 1
+    tail = {reg: (at - cycle, op) for reg, (at, op) in ready.items() if at - cycle > 1}
+    return stalls, tail, pairs
+
+
+class Block:
+    def __init__(self, ops):
+        self.ops = ops
+        self.start = ops[0].pc
+        self.weight = 1
+        self.preds = []            # (block, edge weight or None)
+
+
+def build_cfg(ops):
+    by_pc = {op.pc: i for i, op in enumerate(ops)}
+    leaders = {ops[0].pc} if ops else set()
+    for i, op in enumerate(ops):
+        if op.target is not None and op.target in by_pc:
+            leaders.add(op.target)
+        if op.control and i + 1 < len(ops):
+            leaders.add(ops[i + 1].pc)
+    blocks, current = [], []
+    for op in ops:
+        if op.pc in leaders and current:
+            blocks.append(Block(current))
+            current = []
+        current.append(op)
+    if current:
+        blocks.append(Block(current))
+    return blocks
+
+
+def successors(blocks, start, index):
+    """(kind, block index) of every CFG successor: 'taken', 'fall' or 'call'."""
+    last = blocks[index].ops[-1]
+    fall = index + 1 if index + 1 < len(blocks) and blocks[index + 1].start == last.pc + 4 else None
+    out = []
+    if last.opcode == 0x63:
+        if last.target in start:
+            out.append(("taken", start[last.target]))
+        if fall is not None:
+            out.append(("fall", fall))
+    elif last.opcode == 0x6F:
+        if last.target in start:
+            out.append(("call" if last.rd else "taken", start[last.target]))
+    elif last.opcode != 0x67 and fall is not None:     # a system call returns after its ecall
+        out.append(("fall", fall))
+    return out
+
+
+def estimate_mispredictions(taken, not_taken):
+    """1-bit predictor starting at not taken: every change of direction mispredicts."""
+    if taken == 0:
+        return 0
+    return min(taken + not_taken, 2 * min(taken, not_taken) + (1 if taken > not_taken else 0))
+
+
+def analyze(ops, profile=None):
+    blocks = build_cfg(ops)
+    branches, counts = profile if profile else ({}, {})
+    if profile:
+        for b in blocks:
+            b.weight = counts.get(b.start, 0)
+    else:
+        # 10^(loop depth): a backward branch or jump spans the blocks of its loop
+        # from [target, pc]; depth = loops opened at or before the start - loops closed before it
+        back = [(op.target, op.pc) for op in ops if op.target is not None and op.target <= op.pc]
+        opens = sorted(lo for lo, _ in back)
+        closes = sorted(hi for _, hi in back)
+        for b in blocks:
+            depth = bisect.bisect_right(opens, b.start) - bisect.bisect_left(closes, b.start)
+            b.weight = 10 ** min(depth, MAX_LOOP_DEPTH)
+    start = {b.start: i for i, b in enumerate(blocks)}
+    for i, b in enumerate(blocks):
+        last = b.ops[-1]
+        for kind, j in successors(blocks, start, i):
+            if not profile:
+                w = None
+            elif last.opcode == 0x63:
+                taken, not_taken = branches.get(last.pc, (0, 0))
+                w = taken if kind == "taken" else not_taken
+            else:
+                w = b.weight
+            blocks[j].preds.append((b, w))
+
+    report = {"instructions_static": len(ops), "blocks": [], "models": {}}
+    dynamic_instructions = sum(b.weight * len(b.ops) for b in blocks)
+    jalr = sum(b.weight for b in blocks if b.ops[-1].opcode == 0x67)
+    structural = sum(b.weight * sum(ex_extra(op) for op in b.ops) for b in blocks)
+    mispredictions = 0
+    if profile:
+        mispredictions = sum(estimate_mispredictions(*branches.get(b.ops[-1].pc, (0, 0)))
+                             for b in blocks if b.ops[-1].opcode == 0x63)
+    rows = {b.start: {"start": b.start, "end": b.ops[-1].pc, "instructions": len(b.ops), "weight": b.weight}
+            for b in blocks}
+    chains = []
+    for model in MODELS:
+        stalls_total = 0
+        for b in blocks:
+            inner, _, pairs = issue(b.ops, model)
+            links = [(producer, consumer, cycles, b.weight) for producer, consumer, cycles in pairs]
+            # entry stalls: replay the block after each predecessor's tail. With a profile they
+            # are weighted by the edge, else the worst predecessor counts with the block weight
+            entry, worst = 0.0, (0, [])
+            for pred, w in b.preds:
+                _, tail, _ = issue(pred.ops, model)
+                s, _, p = issue(b.ops, model, tail)
+                crossing = [(producer, consumer, cycles) for producer, consumer, cycles in p if producer not in b.ops]
+                if w is None:
+                    worst = max(worst, (s - inner, crossing), key=lambda x: x[0])
+                elif w and s > inner:
+                    entry += w * (s - inner)
+                    links += [(producer, consumer, cycles, w) for producer, consumer, cycles in crossing]
+            if not profile:
+                entry = b.weight * worst[0]
+                links += [(producer, consumer, cycles, b.weight) for producer, consumer, cycles in worst[1]]
+            stalls_total += b.weight * inner + entry
+            rows[b.start][model] = {"stalls": inner, "entry_stalls": (entry / b.weight) if b.weight else 0.0}
+            chains += link_chains(model, b, links)
+        cycles = dynamic_instructions + stalls_total + jalr + mispredictions + structural + 4
+        report["models"][model] = {
+            "data_stalls": stalls_total,
+            "control_cycles": jalr + mispredictions,
+            "structural_cycles": structural,
+            "cycles": cycles,
+            "cpi": cycles / dynamic_instructions if dynamic_instructions else 0.0,
+        }
+    report["dynamic_instructions"] = dynamic_instructions
+    report["mispredictions"] = mispredictions if profile else None
+    report["jalr"] = jalr
+    report["blocks"] = [rows[b.start] for b in blocks]
+    chains.sort(key=lambda c: (-c["weighted"], c["model"], c["ops"][0]["pc"]))
+    report["chains"] = chains
+    return report
+
+
+def link_chains(model, block, links):
+    """Join the stalled (producer, consumer, cycles, weight) links of a block into chains
+    a->b->c. Every chain ends at a consumer that stalls no one else; walking back, the
+    heaviest link into each consumer is followed."""
+    into = {}
+    for link in links:
+        into.setdefault(link[1].pc, []).append(link)
+    producers = {link[0].pc for link in links}
+    out = []
+    for pc, candidates in sorted(into.items()):
+        if pc in producers:
+            continue
+        chain, stalls, weighted, seen = [], 0, 0, set()
+        link = max(candidates, key=lambda l: l[2] * l[3])
+        weight = link[3]
+        while link and link[1].pc not in seen:
+            producer, consumer, cycles, w = link
+            seen.add(consumer.pc)
+            chain.insert(0, consumer)
+            stalls += cycles
+            weighted += cycles * w
+            link = max(into[producer.pc], key=lambda l: l[2] * l[3]) if producer.pc in into else None
+            if link is None:
+                chain.insert(0, producer)
+        out.append({"model": model, "block": block.start, "stalls": stalls, "weight": weight,
+                    "weighted": weighted, "ops": [{"pc": op.pc, "asm": op.text} for op in chain]})
+    return out
+
+
+def print_report(report, top, shown_blocks, profiled):
+    # the blocks with the most weighted stalls, in address order
+    def weighted(row):
+        return sum(row["weight"] * (row[m]["stalls"] + row[m]["entry_stalls"]) for m in MODELS)
+    rows = sorted(report["blocks"], key=weighted, reverse=True)[:shown_blocks]
+    rows.sort(key=lambda row: row["start"])
+    print("%d blocks, the %d with the most weighted stalls:" % (len(report["blocks"]), len(rows)))
+    print("%-10s %-10s %6s %12s %8s %8s %8s %8s" % ("block", "end", "insts", "weight", "fwd", "fwd-in", "nofwd", "nofwd-in"))
+    for row in rows:
+        print("0x%08x 0x%08x %6d %12g %8d %8.2f %8d %8.2f" % (
+            row["start"], row["end"], row["instructions"], row["weight"],
+            row["forwarding"]["stalls"], row["forwarding"]["entry_stalls"],
+            row["no-forwarding"]["stalls"], row["no-forwarding"]["entry_stalls"]))
+    print()
+    print("%s instructions: %g" % ("profiled" if profiled else "weighted", report["dynamic_instructions"]))
+    for model in MODELS:
+        m = report["models"][model]
+        print("%-14s data stalls %10.0f  control %8d  structural %8d  cycles %10.0f  CPI %.4f"
+              % (model, m["data_stalls"], m["control_cycles"], m["structural_cycles"], m["cycles"], m["cpi"]))
+    if not profiled:
+        print("(no profile: block weights are 10^loop depth, branch mispredictions not estimated)")
+    print()
+    print("worst hazard chains:")
+    for chain in report["chains"][:top]:
+        print("  %-13s %3d stall(s), %g weighted" % (chain["model"], chain["stalls"], chain["weighted"]))
+        for op in chain["ops"]:
+            print("      0x%08x  %s" % (op["pc"], op["asm"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("mc", help=".mc file written by the assembler")
+    parser.add_argument("--profile", help="branch_profile.txt from the simulator's --branch-profile")
+    parser.add_argument("--top", type=int, default=10, help="hazard chains to list")
+    parser.add_argument("--blocks", type=int, default=20, help="blocks to list")
+    parser.add_argument("--json", help="also write the report as JSON")
+    parser.add_argument("--mul-latency", type=int, default=1, help="EX cycles of mul/mulh* (simulator default 1)")
+    parser.add_argument("--div-latency", type=int, default=1, help="EX cycles of div/rem (simulator default 1)")
+    parser.add_argument("--fp-latency", type=int, default=1, help="EX cycles of the other RV32F ops (simulator default 1)")
+    parser.add_argument("--fmul-latency", type=int, default=1, help="EX cycles of fmul.s and fmadd.s family (simulator default 1)")
+    parser.add_argument("--fdiv-latency", type=int, default=1, help="EX cycles of fdiv.s/fsqrt.s (simulator default 1)")
+    args = parser.parse_args()
+    EX_LATENCY.update(mul=max(1, args.mul_latency), div=max(1, args.div_latency), fp=max(1, args.fp_latency),
+                      fmul=max(1, args.fmul_latency), fdiv=max(1, args.fdiv_latency))
+
+    ops = read_mc(args.mc)
+    if not ops:
+        print("%s: no instructions" % args.mc)
+        return 1
+    if any(op.word & 3 != 3 for op in ops):
+        print("%s: compressed (RV32C) instructions are not supported, assemble without --compress" % args.mc)
+        return 1
+    profile = read_profile(args.profile) if args.profile else None
+    report = analyze(ops, profile)
+    print_report(report, args.top, args.blocks, profile is not None)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
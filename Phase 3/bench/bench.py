@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""Benchmark and regression driver for the Phase 3 simulator.
+
+Builds the simulator, runs every test/*.mc program, scaled-up variants of
+them and the generated corpus/*.mc and *.elf kernels under each engine configuration,
+and compares the simulated cycle and instruction counts against the
+committed baseline.
+
+    python3 bench.py                      # build, run, compare with baseline.json
+    python3 bench.py --update-baseline    # record the current counts as the baseline
+    python3 bench.py --filter fib         # only matching workloads
+    python3 bench.py --throughput         # also check host speed on this machine
+
+Simulated cycles/instructions are deterministic, so any change to them means
+the modeled microarchitecture changed; they are the only committed gate. Host
+throughput (simulated KIPS, read from simperf.txt) is noisy and machine
+dependent. With --throughput the script adds larger timing workloads, takes the
+median of several trials and compares it with throughput.local.json, which is
+recorded on the first such run on this machine and never committed. Runs
+shorter than MIN_TIMED_MS are reported but not checked.
+
+Corpus programs (written by gen.py) also carry golden results: the final a0,
+the instruction count and output.mc must match in every configuration.
+"""
+import argparse
+import hashlib
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+PHASE_DIR = os.path.dirname(BENCH_DIR)
+TEST_DIR = os.path.join(PHASE_DIR, "test")
+CORPUS_DIR = os.path.join(BENCH_DIR, "corpus")
+SOURCE = os.path.join(PHASE_DIR, "code.cpp")
+BUILD_DIR = os.path.join(BENCH_DIR, "build")
+DEFAULT_BASELINE = os.path.join(BENCH_DIR, "baseline.json")
+
+CONFIGS = {
+    "seq": ["--no-pipeline"],
+    "pipe-fwd": ["--pipeline", "--forwarding"],
+    "pipe-nofwd": ["--pipeline", "--no-forwarding"],
+}
+
+# Every test program reads its problem size n from the first data word, so a
+# scaled variant only rewrites that word (bubbleSort also needs n array words).
+SCALED = {
+    "bubbleSort": [32],
+    "factorial": [12],
+    "fibonacci": [14],
+    "towerOfHanoi": [7],
+}
+
+# Larger variants that only run with --throughput, so that every configuration
+# has runs long enough to time.
+THROUGHPUT_SCALED = {
+    "bubbleSort": [128],
+}
+
+DEFAULT_TOLERANCES = {
+    "cycles_abs": 0,      # simulated timing must match exactly
+    "instructions_abs": 0,
+}
+
+LOCAL_THROUGHPUT = os.path.join(BENCH_DIR, "throughput.local.json")
+KIPS_REL = 0.30           # fail if median KIPS drops more than 30 % below the local baseline
+MIN_TIMED_MS = 100.0      # shorter runs are dominated by timer and start-up noise
+
+
+def build(sim_path):
+    os.makedirs(os.path.dirname(sim_path), exist_ok=True)
+    cmd = ["g++", "-O2", "-std=c++17", SOURCE, "-o", sim_path]
+    print("building:", " ".join(cmd))
+    subprocess.run(cmd, check=True)
+
+
+def data_words(words):
+    """#Data Segment lines for 32-bit words at 0x10000000, one byte per line."""
+    lines = []
+    for i, word in enumerate(words):
+        for b in range(4):
+            lines.append("0x%08X 0x%08X %d" % (0x10000000 + 4 * i + b, (word >> (8 * b)) & 0xFF, (word >> (8 * b)) & 0xFF))
+    return lines
+
+
+def scaled_variant(path, name, n, out_dir):
+    with open(path) as f:
+        text = f.read()
+    head = text.split("#Data Segment")[0].rstrip("\n")
+    if name == "bubbleSort":
+        words = [n] + list(range(n, 0, -1))   # worst case: reverse sorted
+    else:
+        words = [n]
+    out = os.path.join(out_dir, "%s_n%d.mc" % (name, n))
+    with open(out, "w") as f:
+        f.write(head + "\n\n\n#Data Segment\n" + "\n".join(data_words(words)) + "\n")
+    return out
+
+
+def workloads(out_dir, timing):
+    found = []
+    for fname in sorted(os.listdir(TEST_DIR)):
+        if not fname.endswith(".mc"):
+            continue
+        name = fname[:-3]
+        path = os.path.join(TEST_DIR, fname)
+        found.append((name, path))
+        sizes = SCALED.get(name, []) + (THROUGHPUT_SCALED.get(name, []) if timing else [])
+        for n in sizes:
+            found.append(("%s_n%d" % (name, n), scaled_variant(path, name, n, out_dir)))
+    if os.path.isdir(CORPUS_DIR):
+        for fname in sorted(os.listdir(CORPUS_DIR)):
+            base, ext = os.path.splitext(fname)
+            if ext in (".mc", ".elf"):
+                found.append(("corpus/" + base, os.path.join(CORPUS_DIR, fname)))
+    return found
+
+
+def load_golden(mc_path):
+    path = os.path.splitext(mc_path)[0] + ".golden.json"
+    if not os.path.exists(path):
+        return None
+    with open(path) as f:
+        return json.load(f)
+
+
+def parse_stats(run_dir):
+    stats = {}
+    with open(os.path.join(run_dir, "stats.txt")) as f:
+        for line in f:
+            if line.startswith("Number of clock cycles:"):
+                stats["cycles"] = int(line.split(":")[1])
+            elif line.startswith("Number of instructions executed:"):
+                stats["instructions"] = int(line.split(":")[1])
+    with open(os.path.join(run_dir, "simperf.txt")) as f:
+        perf = f.read()
+    stats["kips"] = float(re.search(r"^KIPS: ([0-9.]+)", perf, re.M).group(1))
+    stats["sim_ms"] = float(re.search(r"^simulate: ([0-9.]+) ms", perf, re.M).group(1))
+    stats["cpi"] = stats["cycles"] / stats["instructions"] if stats["instructions"] else 0.0
+    with open(os.path.join(run_dir, "output.mc"), "rb") as f:
+        output = f.read()
+    stats["a0"] = int(re.search(r"^R\[10\]: 0x([0-9a-f]+)", output.decode(), re.M).group(1), 16)
+    stats["output_sha256"] = hashlib.sha256(output).hexdigest()
+    return stats
+
+
+def run_one(sim, mc_path, flags, run_dir):
+    # the simulator writes its outputs to the working directory
+    cmd = [sim] + flags + ["--simperf", "--input", mc_path]
+    subprocess.run(cmd, cwd=run_dir, stdout=subprocess.DEVNULL, check=True)
+    return parse_stats(run_dir)
+
+
+def measure(sim, mc_path, flags, warmup, trials, run_dir):
+    for _ in range(warmup):
+        run_one(sim, mc_path, flags, run_dir)
+    samples = [run_one(sim, mc_path, flags, run_dir) for _ in range(trials)]
+    result = dict(samples[0])
+    result["kips"] = statistics.median(s["kips"] for s in samples)
+    result["sim_ms"] = statistics.median(s["sim_ms"] for s in samples)
+    result["kips_min"] = min(s["kips"] for s in samples)
+    result["kips_max"] = max(s["kips"] for s in samples)
+    for s in samples[1:]:
+        if s["cycles"] != result["cycles"] or s["instructions"] != result["instructions"]:
+            raise RuntimeError("non-deterministic simulation of %s" % mc_path)
+    return result
+
+
+def compare(results, baseline):
+    tol = dict(DEFAULT_TOLERANCES)
+    tol.update(baseline.get("tolerances", {}))
+    problems = []
+    for key, cur in sorted(results.items()):
+        base = baseline.get("results", {}).get(key)
+        if base is None:
+            problems.append("%s: not in baseline" % key)
+            continue
+        for field in ("cycles", "instructions"):
+            if abs(cur[field] - base[field]) > tol[field + "_abs"]:
+                problems.append("%s: %s %d -> %d (model change, CPI %.4f -> %.4f)"
+                                % (key, field, base[field], cur[field], base["cpi"], cur["cpi"]))
+    return problems
+
+
+def compare_throughput(results, local):
+    problems = []
+    for key, cur in sorted(results.items()):
+        base = local.get(key)
+        if base is None or cur["sim_ms"] < MIN_TIMED_MS or base["sim_ms"] < MIN_TIMED_MS:
+            continue
+        if cur["kips"] < base["kips"] * (1.0 - KIPS_REL):
+            problems.append("%s: throughput %.1f -> %.1f KIPS (%.0f %% slower)"
+                            % (key, base["kips"], cur["kips"], 100.0 * (1 - cur["kips"] / base["kips"])))
+    return problems
+
+
+def write_json(path, data):
+    with open(path, "w") as f:
+        json.dump(data, f, indent=2, sort_keys=True)
+        f.write("\n")
+
+
+def check_golden(key, config, result, golden):
+    problems = []
+    if result["a0"] != golden["expected_a0"]:
+        problems.append("%s: a0 0x%08x, golden 0x%08x" % (key, result["a0"], golden["expected_a0"]))
+    if "instructions" in golden and result["instructions"] != golden["instructions"]:
+        problems.append("%s: %d instructions, golden %d" % (key, result["instructions"], golden["instructions"]))
+    if "output_sha256" in golden and result["output_sha256"] != golden["output_sha256"]:
+        problems.append("%s: output.mc differs from golden" % key)
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--sim", help="use this simulator binary instead of building one")
+    parser.add_argument("--warmup", type=int, help="untimed runs per workload (default 1 with --throughput, else 0)")
+    parser.add_argument("--trials", type=int, help="timed runs per workload (default 5 with --throughput, else 2)")
+    parser.add_argument("--quick", action="store_true", help="no warmup, 2 trials")
+    parser.add_argument("--throughput", action="store_true",
+                        help="also compare host throughput with this machine's throughput.local.json")
+    parser.add_argument("--update-throughput", action="store_true",
+                        help="re-record throughput.local.json from this run (implies --throughput)")
+    parser.add_argument("--filter", default="", help="regex on workload/config names")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument("--update-baseline", action="store_true")
+    parser.add_argument("--output", default="bench_results.json", help="where to write this run's results")
+    args = parser.parse_args()
+    args.throughput = args.throughput or args.update_throughput
+    default_warmup, default_trials = (1, 5) if args.throughput and not args.quick else (0, 2)
+    if args.warmup is None:
+        args.warmup = default_warmup
+    if args.trials is None:
+        args.trials = default_trials
+
+    sim = args.sim
+    if not sim:
+        sim = os.path.join(BUILD_DIR, "code")
+        build(sim)
+    sim = os.path.abspath(sim)
+
+    work_dir = tempfile.mkdtemp(prefix="rvbench_")
+    try:
+        results = {}
+        golden_problems = []
+        print("%-28s %-11s %10s %10s %7s %10s %10s" % ("workload", "config", "cycles", "insts", "CPI", "KIPS", "sim ms"))
+        for name, path in workloads(work_dir, args.throughput):
+            for config, flags in CONFIGS.items():
+                key = "%s/%s" % (name, config)
+                if args.filter and not re.search(args.filter, key):
+                    continue
+                r = measure(sim, path, flags, args.warmup, args.trials, work_dir)
+                results[key] = r
+                golden = load_golden(path)
+                if golden:
+                    golden_problems += check_golden(key, config, r, golden)
+                print("%-28s %-11s %10d %10d %7.4f %10.1f %10.3f"
+                      % (name, config, r["cycles"], r["instructions"], r["cpi"], r["kips"], r["sim_ms"]))
+    finally:
+        shutil.rmtree(work_dir)
+
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    for p in golden_problems:
+        print("GOLDEN MISMATCH", p)
+    if golden_problems:
+        return 1
+
+    if args.throughput:
+        local = {}
+        if os.path.exists(LOCAL_THROUGHPUT):
+            with open(LOCAL_THROUGHPUT) as f:
+                local = json.load(f)
+        fresh = {key: r for key, r in results.items() if args.update_throughput or key not in local}
+        for key, r in fresh.items():
+            local[key] = {k: r[k] for k in ("kips", "sim_ms")}
+        if fresh:
+            write_json(LOCAL_THROUGHPUT, local)
+            print("recorded throughput of %d runs in %s" % (len(fresh), LOCAL_THROUGHPUT))
+
+    if args.update_baseline:
+        baseline = {"tolerances": DEFAULT_TOLERANCES, "results": {}}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+        for key, r in results.items():
+            baseline["results"][key] = {k: r[k] for k in ("cycles", "instructions", "cpi")}
+        write_json(args.baseline, baseline)
+        print("baseline updated:", args.baseline)
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print("no baseline at %s (run with --update-baseline)" % args.baseline)
+        return 1
+    with open(args.baseline) as f:
+        problems = compare(results, json.load(f))
+    if args.throughput and not args.update_throughput:
+        problems += compare_throughput({k: r for k, r in results.items() if k not in fresh}, local)
+    for p in problems:
+        print("REGRESSION", p)
+    print("%d workloads, %d regressions" % (len(results), len(problems)))
+    return 1 if problems else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,27 @@
+.text
+addi a0, x0, 10
+jal x1, fib
+jal x0, fib_exit
+fib:
+addi sp, sp, -12
+sw x1, 8(sp)
+sw a0, 4(sp)
+addi t0, x0, 2
+blt a0, t0, fib_base
+addi a0, a0, -1
+jal x1, fib
+sw a0, 0(sp)
+lw a0, 4(sp)
+addi a0, a0, -2
+jal x1, fib
+lw t1, 0(sp)
+add a0, a0, t1
+lw x1, 8(sp)
+addi sp, sp, 12
+jalr x0, x1, 0
+fib_base:
+lw x1, 8(sp)
+addi sp, sp, 12
+jalr x0, x1, 0
+fib_exit:
+addi x0, x0, 0
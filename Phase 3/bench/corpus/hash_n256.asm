@@ -0,0 +1,35 @@
+.data
+.byte -47 -77 44 107 35 6 -26 55 -38 -62 32 33 106 -67 -78 -128
+.byte 61 87 -123 107 -109 -69 34 -87 -78 -116 -48 109 27 -58 105 34
+.byte 4 39 -119 12 -61 53 -54 -113 -89 -110 101 -41 88 74 -120 127
+.byte -41 -52 9 127 18 118 -126 -35 -48 -15 15 -2 -110 99 -105 -68
+.byte -54 55 93 56 -44 -42 -109 -116 84 -109 -19 -111 -77 21 34 10
+.byte -86 115 -19 2 49 6 114 22 2 -95 -77 -127 125 30 -71 -50
+.byte -1 -87 50 31 77 -18 -73 17 50 66 58 21 14 -101 -10 4
+.byte -59 -103 -62 -33 96 73 -75 66 -58 56 -95 58 -50 -97 27 36
+.byte -48 71 -15 -49 -6 35 -48 -12 102 44 96 112 50 41 -27 14
+.byte 60 -29 -2 -87 -83 -118 58 -78 115 -68 -40 -91 0 -125 -109 35
+.byte 91 -68 35 50 100 -56 7 -118 -65 -16 -116 40 -125 -72 88 89
+.byte -4 39 -12 50 81 27 24 -22 40 37 -9 -118 52 -30 75 -117
+.byte 59 -15 44 -37 -63 80 120 110 55 -106 107 -8 15 125 75 -126
+.byte 5 -31 -50 -71 79 71 -54 98 -97 43 84 121 -25 -11 88 -73
+.byte -64 -33 68 123 96 -6 -72 -52 -125 -37 66 -90 99 -90 -70 -39
+.byte 6 -98 3 -15 81 16 22 -110 -100 -79 -56 32 6 -7 28 60
+.text
+lui s0, 65536
+addi s1, x0, 256
+lui s2, 4096
+addi s2, s2, 403
+lui a0, 528842
+addi a0, a0, -571
+addi t0, x0, 0
+fnv:
+bge t0, s1, fnv_done
+add t1, s0, t0
+lb t2, 0(t1)
+andi t2, t2, 255
+xor a0, a0, t2
+mul a0, a0, s2
+addi t0, t0, 1
+beq x0, x0, fnv
+fnv_done:
@@ -0,0 +1,47 @@
+.data
+.byte -48 0 0 16 -119 48 0 0 -16 0 0 16 -66 44 0 0
+.byte 72 0 0 16 -50 112 0 0 8 1 0 16 -63 -128 0 0
+.byte 48 0 0 16 18 -83 0 0 40 1 0 16 -110 -82 0 0
+.byte -24 1 0 16 -28 120 0 0 96 1 0 16 24 12 0 0
+.byte -88 1 0 16 -105 -86 0 0 120 0 0 16 100 50 0 0
+.byte -32 1 0 16 8 62 0 0 112 1 0 16 -78 18 0 0
+.byte 56 0 0 16 -98 -85 0 0 -104 0 0 16 -128 117 0 0
+.byte -64 0 0 16 20 93 0 0 8 0 0 16 -79 -121 0 0
+.byte -128 1 0 16 34 -74 0 0 32 1 0 16 -60 7 0 0
+.byte -40 1 0 16 -106 -17 0 0 -112 1 0 16 -115 -84 0 0
+.byte -40 0 0 16 -60 -42 0 0 -120 1 0 16 -58 101 0 0
+.byte -120 0 0 16 -91 57 0 0 -72 1 0 16 -54 -9 0 0
+.byte 16 1 0 16 -77 -11 0 0 -16 1 0 16 -90 9 0 0
+.byte -32 0 0 16 -98 -3 0 0 24 0 0 16 -20 -84 0 0
+.byte 56 1 0 16 90 -16 0 0 40 0 0 16 36 92 0 0
+.byte -72 0 0 16 -11 55 0 0 88 0 0 16 -124 20 0 0
+.byte -96 1 0 16 -36 98 0 0 80 1 0 16 -85 -4 0 0
+.byte 24 1 0 16 106 100 0 0 0 0 0 0 94 -12 0 0
+.byte 96 0 0 16 68 -59 0 0 -88 0 0 16 -21 86 0 0
+.byte 112 0 0 16 29 -55 0 0 72 1 0 16 -107 64 0 0
+.byte 64 0 0 16 65 -95 0 0 -80 0 0 16 20 -66 0 0
+.byte -128 0 0 16 123 64 0 0 -56 0 0 16 41 -60 0 0
+.byte -48 1 0 16 -100 -83 0 0 -8 0 0 16 8 8 0 0
+.byte 88 1 0 16 -98 -2 0 0 16 0 0 16 55 -9 0 0
+.byte -24 0 0 16 -4 -71 0 0 -104 1 0 16 -17 111 0 0
+.byte 104 1 0 16 29 100 0 0 32 0 0 16 48 -35 0 0
+.byte -8 1 0 16 75 -79 0 0 -112 0 0 16 -58 14 0 0
+.byte 64 1 0 16 -104 -26 0 0 48 1 0 16 -127 50 0 0
+.byte 80 0 0 16 18 -80 0 0 -64 1 0 16 -2 -59 0 0
+.byte 104 0 0 16 36 76 0 0 0 0 0 16 -125 6 0 0
+.byte 0 1 0 16 -72 78 0 0 -56 1 0 16 90 127 0 0
+.byte 120 1 0 16 103 18 0 0 -80 1 0 16 126 41 0 0
+.text
+lui s0, 65536
+addi s0, s0, 160
+addi a0, x0, 0
+addi t0, x0, 1
+walk:
+beq s0, x0, walked
+lw t1, 4(s0)
+mul t1, t1, t0
+add a0, a0, t1
+addi t0, t0, 1
+lw s0, 0(s0)
+beq x0, x0, walk
+walked:
@@ -0,0 +1,103 @@
+.data
+.byte -104 0 0 0 34 0 0 0 48 0 0 0 -126 0 0 0
+.byte 38 0 0 0 -66 0 0 0 -74 0 0 0 4 0 0 0
+.byte -118 0 0 0 -69 0 0 0 -66 0 0 0 -39 0 0 0
+.byte -86 0 0 0 102 0 0 0 124 0 0 0 -23 0 0 0
+.byte -73 0 0 0 4 0 0 0 17 0 0 0 47 0 0 0
+.byte 91 0 0 0 95 0 0 0 -38 0 0 0 70 0 0 0
+.byte -60 0 0 0 60 0 0 0 126 0 0 0 52 0 0 0
+.byte 114 0 0 0 63 0 0 0 -89 0 0 0 -93 0 0 0
+.byte 45 0 0 0 -53 0 0 0 17 0 0 0 -95 0 0 0
+.byte -31 0 0 0 -10 0 0 0 85 0 0 0 -96 0 0 0
+.byte 28 0 0 0 79 0 0 0 43 0 0 0 -124 0 0 0
+.byte -70 0 0 0 -105 0 0 0 -116 0 0 0 -30 0 0 0
+.byte 32 0 0 0 -44 0 0 0 -88 0 0 0 -116 0 0 0
+.byte 109 0 0 0 5 0 0 0 36 0 0 0 83 0 0 0
+.byte -3 0 0 0 -73 0 0 0 -117 0 0 0 62 0 0 0
+.byte -45 0 0 0 39 0 0 0 42 0 0 0 109 0 0 0
+.byte 28 0 0 0 -45 0 0 0 -57 0 0 0 -48 0 0 0
+.byte 107 0 0 0 94 0 0 0 -120 0 0 0 -5 0 0 0
+.byte 17 0 0 0 27 0 0 0 109 0 0 0 -108 0 0 0
+.byte 120 0 0 0 -41 0 0 0 -95 0 0 0 -38 0 0 0
+.byte -46 0 0 0 88 0 0 0 108 0 0 0 30 0 0 0
+.byte -67 0 0 0 89 0 0 0 112 0 0 0 73 0 0 0
+.byte 117 0 0 0 37 0 0 0 8 0 0 0 -118 0 0 0
+.byte 39 0 0 0 -93 0 0 0 52 0 0 0 17 0 0 0
+.byte -51 0 0 0 -85 0 0 0 38 0 0 0 25 0 0 0
+.byte 54 0 0 0 60 0 0 0 44 0 0 0 4 0 0 0
+.byte -99 0 0 0 -104 0 0 0 109 0 0 0 -101 0 0 0
+.byte -7 0 0 0 15 0 0 0 -13 0 0 0 1 0 0 0
+.byte -26 0 0 0 7 0 0 0 -121 0 0 0 -16 0 0 0
+.byte -12 0 0 0 103 0 0 0 42 0 0 0 -83 0 0 0
+.byte 65 0 0 0 104 0 0 0 -23 0 0 0 37 0 0 0
+.byte -115 0 0 0 69 0 0 0 12 0 0 0 93 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.text
+lui s0, 65536
+lui s1, 65536
+addi s1, s1, 256
+lui s2, 65536
+addi s2, s2, 512
+addi s3, x0, 8
+addi s4, x0, 32
+addi t0, x0, 0
+mm_i:
+bge t0, s3, mm_done
+addi t1, x0, 0
+mm_j:
+bge t1, s3, mm_i_next
+addi t2, x0, 0
+addi t6, x0, 0
+mul t3, t0, s4
+add t3, s0, t3
+add t4, t1, t1
+add t4, t4, t4
+add t4, s1, t4
+mm_k:
+bge t2, s3, mm_k_done
+lw t5, 0(t3)
+lw a1, 0(t4)
+mul a1, t5, a1
+add t6, t6, a1
+addi t3, t3, 4
+add t4, t4, s4
+addi t2, t2, 1
+beq x0, x0, mm_k
+mm_k_done:
+sw t6, 0(s2)
+addi s2, s2, 4
+addi t1, t1, 1
+beq x0, x0, mm_j
+mm_i_next:
+addi t0, t0, 1
+beq x0, x0, mm_i
+mm_done:
+lui s10, 65536
+addi s10, s10, 512
+addi s11, x0, 64
+addi a0, x0, 0
+addi t0, x0, 0
+mm_ck:
+bge t0, s11, mm_ck_done
+lw t2, 0(s10)
+addi t0, t0, 1
+mul t3, t2, t0
+add a0, a0, t3
+addi s10, s10, 4
+beq x0, x0, mm_ck
+mm_ck_done:
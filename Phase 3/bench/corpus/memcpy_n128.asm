@@ -0,0 +1,56 @@
+.data
+.byte 61 -54 -54 -82 -80 -81 -35 64 -81 -104 -71 -74 116 -48 -110 87
+.byte -31 122 67 62 -74 101 -56 -86 70 0 21 -5 113 12 29 71
+.byte 24 -43 -65 -88 -85 -24 -57 17 -55 114 102 -52 57 -13 -91 -28
+.byte 119 70 12 -125 105 -110 124 70 50 53 -31 -78 122 29 -108 -121
+.byte -110 21 -93 -84 0 71 45 42 111 -94 -34 -53 -10 18 -53 -74
+.byte 34 -29 49 -113 97 17 24 -83 -83 -67 -115 -116 30 63 59 58
+.byte 35 -59 111 -55 53 -73 -27 111 -39 -105 -121 -85 -76 -126 11 -38
+.byte -54 60 89 125 -118 -103 -128 41 82 40 15 -37 -118 -45 28 89
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.byte 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+.text
+lui s0, 65536
+addi s0, s0, 128
+addi s1, x0, 128
+addi t0, x0, 0
+addi t2, x0, 90
+memset:
+bge t0, s1, memset_done
+add t1, s0, t0
+sb t2, 0(t1)
+addi t0, t0, 1
+beq x0, x0, memset
+memset_done:
+lui s2, 65536
+addi s3, x0, 64
+addi t0, x0, 0
+memcpy:
+bge t0, s3, memcpy_done
+add t1, s2, t0
+lw t3, 0(t1)
+add t1, s0, t0
+sw t3, 0(t1)
+addi t0, t0, 4
+beq x0, x0, memcpy
+memcpy_done:
+lui s10, 65536
+addi s10, s10, 128
+addi s11, x0, 32
+addi a0, x0, 0
+addi t0, x0, 0
+mc_ck:
+bge t0, s11, mc_ck_done
+lw t2, 0(s10)
+addi t0, t0, 1
+mul t3, t2, t0
+add a0, a0, t3
+addi s10, s10, 4
+beq x0, x0, mc_ck
+mc_ck_done:
@@ -0,0 +1,28 @@
+.data
+.byte 0 0 0 0
+.text
+lui s10, 17
+addi s10, s10, -2048
+addi s11, x0, 16
+addi a0, x0, 0
+addi t0, x0, 0
+tbl_ck:
+bge t0, s11, tbl_ck_done
+lw t2, 0(s10)
+addi t0, t0, 1
+mul t3, t2, t0
+add a0, a0, t3
+addi s10, s10, 4
+beq x0, x0, tbl_ck
+tbl_ck_done:
+lui s0, 17
+addi s0, s0, -1984
+msg:
+lb t1, 0(s0)
+beq t1, x0, msg_done
+add a0, a0, t1
+addi s0, s0, 1
+beq x0, x0, msg
+msg_done:
+lui s1, 65536
+sw a0, 0(s1)
@@ -0,0 +1,52 @@
+.data
+.byte 125 86 0 0 79 6 0 0 66 -59 0 0 103 55 0 0
+.byte 16 49 0 0 96 13 0 0 -18 63 0 0 63 23 0 0
+.byte 55 -68 0 0 52 115 0 0 116 -74 0 0 -11 -81 0 0
+.byte 123 -53 0 0 17 32 0 0 -108 106 0 0 116 127 0 0
+.byte 73 116 0 0 8 -106 0 0 -66 -43 0 0 71 41 0 0
+.byte 47 47 0 0 -58 77 0 0 33 125 0 0 127 -43 0 0
+.byte 98 -23 0 0 119 66 0 0 -30 -99 0 0 25 80 0 0
+.byte 121 -31 0 0 56 105 0 0 79 54 0 0 45 -2 0 0
+.text
+lui s0, 65536
+addi s1, x0, 32
+addi t0, x0, 1
+outer:
+bge t0, s1, sorted
+add t1, t0, t0
+add t1, t1, t1
+add t1, s0, t1
+lw t2, 0(t1)
+addi t3, t0, -1
+inner:
+blt t3, x0, place
+add t4, t3, t3
+add t4, t4, t4
+add t4, s0, t4
+lw t5, 0(t4)
+bge t2, t5, place
+sw t5, 4(t4)
+addi t3, t3, -1
+beq x0, x0, inner
+place:
+addi t3, t3, 1
+add t4, t3, t3
+add t4, t4, t4
+add t4, s0, t4
+sw t2, 0(t4)
+addi t0, t0, 1
+beq x0, x0, outer
+sorted:
+lui s10, 65536
+addi s11, x0, 32
+addi a0, x0, 0
+addi t0, x0, 0
+sort_ck:
+bge t0, s11, sort_ck_done
+lw t2, 0(s10)
+addi t0, t0, 1
+mul t3, t2, t0
+add a0, a0, t3
+addi s10, s10, 4
+beq x0, x0, sort_ck
+sort_ck_done:
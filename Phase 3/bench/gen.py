@@ -0,0 +1,501 @@
+#!/usr/bin/env python3
+"""Scalable workload generator for the simulator.
+
+Writes assembler-compatible .asm programs with a size parameter, assembles them
+with the Phase 1 assembler into .mc, and records golden results:
+
+    python3 gen.py sort --size 1000            # -> gen/sort_n1000.{asm,mc,golden.json}
+    python3 gen.py all --size 64 --out corpus  # every kernel at one size
+    python3 gen.py hash --size 50000000 --no-golden
+
+Kernels (size meaning in brackets):
+    sort     insertion sort of N words, then a weighted checksum     [N words]
+    matmul   C = A x B for NxN word matrices, checksum of C          [N]
+    list     traversal of a shuffled singly linked list of N nodes   [N nodes]
+    hash     FNV-1a over N bytes                                     [N bytes]
+    memcpy   memset N bytes, memcpy the first half from a source     [N bytes]
+    fib      recursive fibonacci                                     [n]
+    rodata   checksum of a constant table and string in .rodata      [N words]
+
+The rodata kernel is written as an RV32 ELF executable (.elf instead of .mc)
+with GNU ld's default layout: .text and .rodata share the R-X segment and
+.data has its own RW segment.
+
+Every program leaves its result in a0 (x10) and ends by running off the end of
+the text segment. gen.py computes the expected a0 itself, independently of the
+simulator. The golden file also stores the instruction count, the cycle count
+and the sha256 of output.mc from a pipelined run, and generation fails if that
+run's a0 differs from the expected value.
+
+The Phase 1 assembler has no li/la pseudo-instructions, accepts only decimal
+lui immediates and labels on their own line, and the .mc loader keeps one
+byte per data line. So constants are built with lui/addi here, and data is
+emitted as .byte runs.
+"""
+import argparse
+import hashlib
+import json
+import os
+import random
+import struct
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+PHASE_DIR = os.path.dirname(BENCH_DIR)
+REPO_DIR = os.path.dirname(PHASE_DIR)
+ASSEMBLER_SOURCE = os.path.join(REPO_DIR, "phase 1", "code.cpp")
+SIMULATOR_SOURCE = os.path.join(PHASE_DIR, "code.cpp")
+BUILD_DIR = os.path.join(BENCH_DIR, "build")
+DATA_BASE = 0x10000000
+ELF_TEXT_BASE = 0x10000
+# .rodata sits at a fixed offset after .text in the same segment, so loading its
+# address takes the same two instructions however long the text turns out to be
+RODATA_BASE = ELF_TEXT_BASE + 0x800
+MASK = 0xFFFFFFFF
+
+
+class Program:
+    """Text lines plus a flat little-endian data image starting at DATA_BASE
+    (and, for ELF output, a read-only image starting at RODATA_BASE)."""
+
+    def __init__(self):
+        self.text = []
+        self.data = bytearray()
+        self.rodata = bytearray()
+
+    def emit(self, *lines):
+        self.text.extend(lines)
+
+    def label(self, name):
+        self.text.append(name + ":")
+
+    def li(self, rd, value):
+        value &= MASK
+        lo = value & 0xFFF
+        if lo >= 0x800:
+            lo -= 0x1000
+        hi = ((value - lo) >> 12) & 0xFFFFF
+        if hi:
+            self.emit("lui %s, %d" % (rd, hi))
+            if lo:
+                self.emit("addi %s, %s, %d" % (rd, rd, lo))
+        else:
+            self.emit("addi %s, x0, %d" % (rd, lo))
+
+    def words(self, values):
+        """Append 32-bit words to the data image and return their address."""
+        addr = DATA_BASE + len(self.data)
+        for v in values:
+            self.data += (v & MASK).to_bytes(4, "little")
+        return addr
+
+    def bytes(self, values):
+        addr = DATA_BASE + len(self.data)
+        self.data += bytes(values)
+        return addr
+
+    def rodata_words(self, values):
+        addr = RODATA_BASE + len(self.rodata)
+        for v in values:
+            self.rodata += (v & MASK).to_bytes(4, "little")
+        return addr
+
+    def rodata_bytes(self, values):
+        addr = RODATA_BASE + len(self.rodata)
+        self.rodata += bytes(values)
+        return addr
+
+    def word_index(self, dst, index_reg, base_reg):
+        """dst = base + 4 * index.
+
+        Two adds rather than slli: the corpus goldens and the bench baseline were
+        recorded with this instruction mix, and the kernels keep it so they stay
+        comparable across simulator changes."""
+        self.emit("add %s, %s, %s" % (dst, index_reg, index_reg),
+                  "add %s, %s, %s" % (dst, dst, dst),
+                  "add %s, %s, %s" % (dst, base_reg, dst))
+
+    def checksum(self, base, count, prefix):
+        """a0 = sum(word[i] * (i + 1)) over count words at base."""
+        self.li("s10", base)
+        self.li("s11", count)
+        self.emit("addi a0, x0, 0", "addi t0, x0, 0")
+        self.label(prefix + "_ck")
+        self.emit("bge t0, s11, %s_ck_done" % prefix,
+                  "lw t2, 0(s10)",
+                  "addi t0, t0, 1",
+                  "mul t3, t2, t0",
+                  "add a0, a0, t3",
+                  "addi s10, s10, 4",
+                  "beq x0, x0, %s_ck" % prefix)
+        self.label(prefix + "_ck_done")
+
+    def asm(self):
+        out = []
+        if self.data:
+            out.append(".data")
+            for i in range(0, len(self.data), 16):
+                chunk = self.data[i:i + 16]
+                out.append(".byte " + " ".join(str(b - 256 if b > 127 else b) for b in chunk))
+        out.append(".text")
+        out.extend(self.text)
+        return "\n".join(out) + "\n"
+
+
+def weighted_sum(values):
+    return sum((v & MASK) * (i + 1) for i, v in enumerate(values)) & MASK
+
+
+def gen_sort(n, rng):
+    p = Program()
+    values = [rng.randrange(0, 1 << 16) for _ in range(n)]
+    base = p.words(values)
+    p.li("s0", base)
+    p.li("s1", n)
+    p.emit("addi t0, x0, 1")
+    p.label("outer")
+    p.emit("bge t0, s1, sorted")
+    p.word_index("t1", "t0", "s0")
+    p.emit("lw t2, 0(t1)", "addi t3, t0, -1")
+    p.label("inner")
+    p.emit("blt t3, x0, place")
+    p.word_index("t4", "t3", "s0")
+    p.emit("lw t5, 0(t4)",
+           "bge t2, t5, place",
+           "sw t5, 4(t4)",
+           "addi t3, t3, -1",
+           "beq x0, x0, inner")
+    p.label("place")
+    p.emit("addi t3, t3, 1")
+    p.word_index("t4", "t3", "s0")
+    p.emit("sw t2, 0(t4)", "addi t0, t0, 1", "beq x0, x0, outer")
+    p.label("sorted")
+    p.checksum(base, n, "sort")
+    return p, weighted_sum(sorted(values))
+
+
+def gen_matmul(n, rng):
+    p = Program()
+    a = [rng.randrange(0, 256) for _ in range(n * n)]
+    b = [rng.randrange(0, 256) for _ in range(n * n)]
+    a_base = p.words(a)
+    b_base = p.words(b)
+    c_base = p.words([0] * (n * n))
+    p.li("s0", a_base)
+    p.li("s1", b_base)
+    p.li("s2", c_base)
+    p.li("s3", n)
+    p.li("s4", n * 4)
+    p.emit("addi t0, x0, 0")
+    p.label("mm_i")
+    p.emit("bge t0, s3, mm_done", "addi t1, x0, 0")
+    p.label("mm_j")
+    p.emit("bge t1, s3, mm_i_next",
+           "addi t2, x0, 0",
+           "addi t6, x0, 0",
+           "mul t3, t0, s4",
+           "add t3, s0, t3")
+    p.word_index("t4", "t1", "s1")
+    p.label("mm_k")
+    p.emit("bge t2, s3, mm_k_done",
+           "lw t5, 0(t3)",
+           "lw a1, 0(t4)",
+           "mul a1, t5, a1",
+           "add t6, t6, a1",
+           "addi t3, t3, 4",
+           "add t4, t4, s4",
+           "addi t2, t2, 1",
+           "beq x0, x0, mm_k")
+    p.label("mm_k_done")
+    p.emit("sw t6, 0(s2)", "addi s2, s2, 4", "addi t1, t1, 1", "beq x0, x0, mm_j")
+    p.label("mm_i_next")
+    p.emit("addi t0, t0, 1", "beq x0, x0, mm_i")
+    p.label("mm_done")
+    p.checksum(c_base, n * n, "mm")
+    c = [sum(a[i * n + k] * b[k * n + j] for k in range(n)) & MASK for i in range(n) for j in range(n)]
+    return p, weighted_sum(c)
+
+
+def gen_list(n, rng):
+    p = Program()
+    # node k lives in slot order[k]; slots are 8 bytes: next pointer, value
+    order = list(range(n))
+    rng.shuffle(order)
+    values = [rng.randrange(0, 1 << 16) for _ in range(n)]
+    slots = [[0, 0] for _ in range(n)]
+    for k in range(n):
+        nxt = DATA_BASE + 8 * order[k + 1] if k + 1 < n else 0
+        slots[order[k]] = [nxt, values[k]]
+    p.words([w for slot in slots for w in slot])
+    p.li("s0", DATA_BASE + 8 * order[0])
+    p.emit("addi a0, x0, 0", "addi t0, x0, 1")
+    p.label("walk")
+    p.emit("beq s0, x0, walked",
+           "lw t1, 4(s0)",
+           "mul t1, t1, t0",
+           "add a0, a0, t1",
+           "addi t0, t0, 1",
+           "lw s0, 0(s0)",
+           "beq x0, x0, walk")
+    p.label("walked")
+    return p, weighted_sum(values)
+
+
+def gen_hash(n, rng):
+    p = Program()
+    data = [rng.randrange(0, 256) for _ in range(n)]
+    base = p.bytes(data)
+    p.li("s0", base)
+    p.li("s1", n)
+    p.li("s2", 16777619)
+    p.li("a0", 2166136261)
+    p.emit("addi t0, x0, 0")
+    p.label("fnv")
+    p.emit("bge t0, s1, fnv_done",
+           "add t1, s0, t0",
+           "lb t2, 0(t1)",
+           "andi t2, t2, 255",
+           "xor a0, a0, t2",
+           "mul a0, a0, s2",
+           "addi t0, t0, 1",
+           "beq x0, x0, fnv")
+    p.label("fnv_done")
+    h = 2166136261
+    for byte in data:
+        h = ((h ^ byte) * 16777619) & MASK
+    return p, h
+
+
+def gen_memcpy(n, rng):
+    n = (n + 7) // 8 * 8        # whole words in both halves
+    p = Program()
+    src = [rng.randrange(0, 256) for _ in range(n)]
+    src_base = p.bytes(src)
+    dst_base = p.bytes([0] * n)
+    p.li("s0", dst_base)
+    p.li("s1", n)
+    # memset(dst, 0x5A, n), byte at a time
+    p.emit("addi t0, x0, 0", "addi t2, x0, 90")
+    p.label("memset")
+    p.emit("bge t0, s1, memset_done", "add t1, s0, t0", "sb t2, 0(t1)", "addi t0, t0, 1", "beq x0, x0, memset")
+    p.label("memset_done")
+    # memcpy(dst, src, n / 2), word at a time
+    p.li("s2", src_base)
+    p.li("s3", n // 2)
+    p.emit("addi t0, x0, 0")
+    p.label("memcpy")
+    p.emit("bge t0, s3, memcpy_done",
+           "add t1, s2, t0",
+           "lw t3, 0(t1)",
+           "add t1, s0, t0",
+           "sw t3, 0(t1)",
+           "addi t0, t0, 4",
+           "beq x0, x0, memcpy")
+    p.label("memcpy_done")
+    p.checksum(dst_base, n // 4, "mc")
+    dst = bytes(src[:n // 2]) + bytes([0x5A] * (n - n // 2))
+    words = [int.from_bytes(dst[i:i + 4], "little") for i in range(0, n, 4)]
+    return p, weighted_sum(words)
+
+
+def gen_fib(n, rng):
+    p = Program()
+    p.li("a0", n)
+    p.emit("jal x1, fib", "jal x0, fib_exit")
+    p.label("fib")
+    p.emit("addi sp, sp, -12",
+           "sw x1, 8(sp)",
+           "sw a0, 4(sp)",
+           "addi t0, x0, 2",
+           "blt a0, t0, fib_base",
+           "addi a0, a0, -1",
+           "jal x1, fib",
+           "sw a0, 0(sp)",
+           "lw a0, 4(sp)",
+           "addi a0, a0, -2",
+           "jal x1, fib",
+           "lw t1, 0(sp)",
+           "add a0, a0, t1",
+           "lw x1, 8(sp)",
+           "addi sp, sp, 12",
+           "jalr x0, x1, 0")
+    p.label("fib_base")
+    p.emit("lw x1, 8(sp)", "addi sp, sp, 12", "jalr x0, x1, 0")
+    p.label("fib_exit")
+    # the exit label needs an instruction to bind to
+    p.emit("addi x0, x0, 0")
+    a, b = 0, 1
+    for _ in range(n):
+        a, b = b, (a + b) & MASK
+    return p, a
+
+
+def gen_rodata(n, rng):
+    p = Program()
+    table = [rng.randrange(0, 1 << 31) for _ in range(n)]
+    message = b"constants live in the text segment"
+    table_addr = p.rodata_words(table)
+    message_addr = p.rodata_bytes(message + b"\0")
+    result = p.words([0])
+    p.checksum(table_addr, n, "tbl")
+    p.li("s0", message_addr)
+    p.label("msg")
+    p.emit("lb t1, 0(s0)",
+           "beq t1, x0, msg_done",
+           "add a0, a0, t1",
+           "addi s0, s0, 1",
+           "beq x0, x0, msg")
+    p.label("msg_done")
+    p.li("s1", result)
+    p.emit("sw a0, 0(s1)")
+    return p, (weighted_sum(table) + sum(message)) & MASK
+
+
+KERNELS = {
+    "sort": gen_sort,
+    "matmul": gen_matmul,
+    "list": gen_list,
+    "hash": gen_hash,
+    "memcpy": gen_memcpy,
+    "fib": gen_fib,
+    "rodata": gen_rodata,
+}
+
+
+def build_tool(source, name):
+    path = os.path.join(BUILD_DIR, name)
+    if not os.path.exists(path) or os.path.getmtime(path) < os.path.getmtime(source):
+        os.makedirs(BUILD_DIR, exist_ok=True)
+        subprocess.run(["g++", "-O2", "-std=c++17", source, "-o", path], check=True)
+    return path
+
+
+def assemble(asm_text, mc_path, work_dir):
+    assembler = build_tool(ASSEMBLER_SOURCE, "asm")
+    with open(os.path.join(work_dir, "input.asm"), "w") as f:
+        f.write(asm_text)
+    subprocess.run([assembler], cwd=work_dir, stdout=subprocess.DEVNULL, check=True)
+    shutil.copy(os.path.join(work_dir, "output.mc"), mc_path)
+    sym = os.path.join(work_dir, "output.sym")
+    if os.path.exists(sym):
+        shutil.copy(sym, mc_path[:-3] + ".sym")
+
+
+def text_words(mc_path):
+    """Instruction words of an assembled .mc file, in address order."""
+    words = []
+    with open(mc_path) as f:
+        for line in f:
+            if line.startswith("#Data Segment"):
+                break
+            m = re.match(r"0x[0-9A-Fa-f]+ 0x([0-9A-Fa-f]{8}) ", line)
+            if m:
+                words.append(int(m.group(1), 16))
+    return words
+
+
+def write_elf(path, text, rodata, data):
+    """ET_EXEC with .text at ELF_TEXT_BASE and .rodata at RODATA_BASE in one R-X
+    segment, .data at DATA_BASE in an RW segment, and section headers."""
+    code = b"".join(struct.pack("<I", w) for w in text)
+    if len(code) > RODATA_BASE - ELF_TEXT_BASE:
+        raise SystemExit("%s: %d bytes of text do not fit below .rodata" % (path, len(code)))
+    rx = code + bytes(RODATA_BASE - ELF_TEXT_BASE - len(code)) + bytes(rodata)
+    page = 0x1000
+    rx_off = page
+    data_off = (rx_off + len(rx) + page - 1) // page * page
+    names = b"\0.text\0.rodata\0.data\0.shstrtab\0"
+    names_off = data_off + len(data)
+    sh_off = (names_off + len(names) + 3) & ~3
+    phdrs = [struct.pack("<8I", 1, rx_off, ELF_TEXT_BASE, ELF_TEXT_BASE, len(rx), len(rx), 5, page),   # R-X
+             struct.pack("<8I", 1, data_off, DATA_BASE, DATA_BASE, len(data), len(data), 6, page)]    # RW
+    shdrs = [struct.pack("<10I", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+             struct.pack("<10I", names.index(b".text"), 1, 0x6, ELF_TEXT_BASE, rx_off, len(code), 0, 0, 4, 0),
+             struct.pack("<10I", names.index(b".rodata"), 1, 0x2, RODATA_BASE, rx_off + RODATA_BASE - ELF_TEXT_BASE,
+                         len(rodata), 0, 0, 4, 0),
+             struct.pack("<10I", names.index(b".data"), 1, 0x3, DATA_BASE, data_off, len(data), 0, 0, 4, 0),
+             struct.pack("<10I", names.index(b".shstrtab"), 3, 0, 0, names_off, len(names), 0, 0, 1, 0)]
+    ident = b"\x7fELF" + bytes([1, 1, 1]) + bytes(9)
+    header = struct.pack("<16sHHIIIIIHHHHHH", ident, 2, 243, 1, ELF_TEXT_BASE, 52, sh_off, 0,
+                         52, 32, len(phdrs), 40, len(shdrs), len(shdrs) - 1)
+    image = bytearray(header + b"".join(phdrs))
+    image += bytes(rx_off - len(image)) + rx
+    image += bytes(data_off - len(image)) + bytes(data) + names
+    image += bytes(sh_off - len(image)) + b"".join(shdrs)
+    with open(path, "wb") as f:
+        f.write(image)
+
+
+def golden_run(mc_path, work_dir):
+    simulator = build_tool(SIMULATOR_SOURCE, "code")
+    subprocess.run([simulator, "--pipeline", "--forwarding", "--input", os.path.abspath(mc_path)],
+                   cwd=work_dir, stdout=subprocess.DEVNULL, check=True)
+    with open(os.path.join(work_dir, "output.mc"), "rb") as f:
+        output = f.read()
+    with open(os.path.join(work_dir, "stats.txt")) as f:
+        stats = f.read()
+    a0 = int(re.search(r"^R\[10\]: 0x([0-9a-f]+)", output.decode(), re.M).group(1), 16)
+    return {
+        "a0": a0,
+        "instructions": int(re.search(r"^Number of instructions executed: (\d+)", stats, re.M).group(1)),
+        "cycles_pipe_fwd": int(re.search(r"^Number of clock cycles: (\d+)", stats, re.M).group(1)),
+        "output_sha256": hashlib.sha256(output).hexdigest(),
+    }
+
+
+def generate(kernel, size, out_dir, seed, golden):
+    rng = random.Random("%s/%d/%d" % (kernel, size, seed))
+    program, expected = KERNELS[kernel](size, rng)
+    name = "%s_n%d" % (kernel, size)
+    os.makedirs(out_dir, exist_ok=True)
+    asm_path = os.path.join(out_dir, name + ".asm")
+    mc_path = os.path.join(out_dir, name + ".mc")
+    with open(asm_path, "w") as f:
+        f.write(program.asm())
+    work_dir = tempfile.mkdtemp(prefix="rvgen_")
+    try:
+        if program.rodata:
+            # the .mc is only an intermediate; the program runs from the ELF image
+            tmp_mc = os.path.join(work_dir, name + ".mc")
+            assemble(program.asm(), tmp_mc, work_dir)
+            mc_path = os.path.join(out_dir, name + ".elf")
+            write_elf(mc_path, text_words(tmp_mc), program.rodata, program.data)
+        else:
+            assemble(program.asm(), mc_path, work_dir)
+        record = {"kernel": kernel, "size": size, "seed": seed, "expected_a0": expected,
+                  "data_bytes": len(program.data), "static_instructions": sum(1 for l in program.text if not l.endswith(":"))}
+        if golden:
+            run = golden_run(mc_path, work_dir)
+            if run["a0"] != expected:
+                raise SystemExit("%s: simulator a0 = 0x%x, expected 0x%x" % (name, run["a0"], expected))
+            record.update({k: v for k, v in run.items() if k != "a0"})
+        with open(os.path.join(out_dir, name + ".golden.json"), "w") as f:
+            json.dump(record, f, indent=2, sort_keys=True)
+            f.write("\n")
+    finally:
+        shutil.rmtree(work_dir)
+    print("%-18s %9d data bytes  a0=0x%08x  %s" % (name, len(program.data), expected,
+                                                   "%d instructions" % record["instructions"] if golden else "no golden run"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("kernel", choices=sorted(KERNELS) + ["all"])
+    parser.add_argument("--size", type=int, action="append", required=True, help="may be given several times")
+    parser.add_argument("--out", default="gen")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--no-golden", action="store_true", help="skip the reference simulation (huge sizes)")
+    args = parser.parse_args()
+    kernels = sorted(KERNELS) if args.kernel == "all" else [args.kernel]
+    for kernel in kernels:
+        for size in args.size:
+            generate(kernel, size, args.out, args.seed, not args.no_golden)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
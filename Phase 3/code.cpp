@@ -1,5 +1,17 @@
 #include <bits/stdc++.h>
 #include <iomanip>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "../common/rv32_isa.h"
+#include "../common/rv32_vector.h"
+#include "../common/rv32_syscall.h"
 using namespace std;
 
 bool flush_if = false;
@@ -9,33 +21,54 @@ bool flag_to_print_particular = false;
 uint32_t instruction_number;
 uint32_t pc_to_print_at;
 // Structure of an instruction (for sequential simulation use)
-struct Instruction {
-    uint32_t opcode;
-    uint32_t rd;
-    uint32_t rs1;
-    uint32_t rs2;
-    uint32_t func3;
-    uint32_t func7;
-    int imm;
-    uint32_t effective_addr;
+struct Instruction : DecodedInstr {
+    uint32_t effective_addr = 0;    // load/store address or jump target
+    uint32_t result = 0;            // value written to rd
+    uint32_t length = 4;            // bytes, 2 for an RV32C instruction
+};
+
+// CPI stack buckets: every simulated cycle is charged to exactly one of these.
+// A cycle in which WB commits an instruction is a base cycle; otherwise the
+// cycle is charged to the reason the bubble in MEM/WB was created.
+enum CycleBucket {
+    CPI_BASE = 0,
+    CPI_DATA,        // RAW stall in decode (no forwarding path available)
+    CPI_LOAD_USE,    // load followed by a dependent instruction
+    CPI_CONTROL,     // wrong-path instructions squashed by a taken branch/jump
+    CPI_STRUCTURAL,  // a shared resource is busy (whole datapath in sequential mode)
+    CPI_MEMORY,      // extra cycles spent waiting on data memory
+    CPI_DRAIN,       // pipeline fill at start and drain after the last fetch
+    CPI_NUM_BUCKETS
+};
+const char *cpi_bucket_names[CPI_NUM_BUCKETS] = {
+    "base", "data", "load_use", "control", "structural", "memory", "drain"
 };
 
 // Pipeline inter-stage buffer structures
+// bubble_cause/bubble_pc are only meaningful while valid == false and say why the
+// slot is empty and which instruction the lost cycle is charged to
 struct IF_ID {
     bool valid = false;
     uint32_t pc;
-    uint32_t ir;
+    uint32_t ir;            // expanded to 32 bits if the instruction is compressed
+    uint32_t length = 4;    // bytes in memory, 2 or 4
     int inst_num;
+    int bubble_cause = CPI_DRAIN;
+    uint32_t bubble_pc = 0;
 };
 struct ID_EX {
     bool valid = false;
     uint32_t pc;
+    uint32_t length = 4;
+    const InstrDesc *desc;
     uint32_t opcode;
     uint32_t func3;
     uint32_t func7;
     uint32_t rd;
     uint32_t rs1;
     uint32_t rs2;
+    uint32_t rs3;
+    uint32_t rm;
     int imm;
     int inst_num;
     bool isBranch;
@@ -43,6 +76,8 @@ struct ID_EX {
     bool memRead;
     bool memWrite;
     bool regWrite;
+    int bubble_cause = CPI_DRAIN;
+    uint32_t bubble_pc = 0;
 };
 struct EX_MEM {
     bool valid = false;
@@ -51,15 +86,19 @@ struct EX_MEM {
     uint32_t alu_result;
     uint32_t mem_reg;
     int size;
+    bool mem_unsigned;
     bool write_enable;
     bool mem_read;
     bool mem_write;
     bool branch_taken;
     bool jump_taken;
+    bool is_branch;
     bool is_ecall;
     uint32_t next_pc;
     int inst_num;
     bool misprediction_checked = false; 
+    int bubble_cause = CPI_DRAIN;
+    uint32_t bubble_pc = 0;
 };
 struct MEM_WB {
     bool valid = false;
@@ -69,15 +108,33 @@ struct MEM_WB {
     bool reg_write;
     bool is_ecall;
     int inst_num;
+    int bubble_cause = CPI_DRAIN;
+    uint32_t bubble_pc = 0;
+};
+
+// Per-PC hot-spot profile (--profile), one entry per static instruction
+enum ProfileStage { STAGE_IF = 0, STAGE_ID, STAGE_EX, STAGE_MEM, STAGE_WB, NUM_STAGES };
+struct PCProfile {
+    unsigned long long executions = 0;
+    unsigned long long cycles = 0;              // CPI-stack cycles (base + bubbles) charged to this PC
+    unsigned long long stage_cycles[NUM_STAGES] = {0};   // cycles the instruction occupied each stage
+    unsigned long long stalls_caused = 0;       // decode stall cycles where this PC was the producer
+    unsigned long long stalls_suffered = 0;     // decode stall cycles where this PC was the consumer
+    unsigned long long mispredictions = 0;
+    unsigned long long flushes = 0;             // times this PC squashed wrong-path instructions
 };
 
 // Global state and memory
 int stat_branch_predictions = 0;
 uint32_t PC = 0;
 uint32_t IR = 0;
-uint32_t REG[32] = {0};
+uint32_t REG[NUM_REGISTERS] = {0};   // x0-x31, f0-f31 (FP_REG + n), then v0-v31 (VEC_REG + n), which stay 0
+uint32_t fcsr = 0;                 // RV32F accrued flags and rounding mode
+VectorUnit vector_unit;            // the v-register values, vl and vtype
+SyscallState syscalls;             // guest file descriptors, the heap break and the exit code
 map<uint32_t, uint32_t> instr_map;
 map<uint32_t, uint8_t> data_segment;
+uint32_t data_end = 0;             // end of the loaded data, .bss included; the heap starts above it
 
 // Writeback flags (for sequential simulation)
 bool writeBackFlag = false;
@@ -103,17 +160,59 @@ bool knob_print_logs = false;
 bool knob_print_pipeline = false;
 bool knob_trace = false;
 bool knob_print_branch = false;
+bool knob_profile = false;
+bool knob_callgraph = false;
+bool knob_simperf = false;
+bool knob_branch_profile = false;
+unsigned simperf_sample_period = 64;   // time the stages on 1 cycle in this many
+unsigned knob_load_threads = 0;        // .mc parser threads, 0 = one per hardware thread
+unsigned knob_mul_latency = 1;         // EX cycles of mul/mulh/mulhsu/mulhu
+unsigned knob_div_latency = 1;         // EX cycles of div/divu/rem/remu
+unsigned knob_fp_latency = 1;          // EX cycles of the other RV32F operations
+unsigned knob_fmul_latency = 1;        // EX cycles of fmul.s and the fused multiply-adds
+unsigned knob_fdiv_latency = 1;        // EX cycles of fdiv.s and fsqrt.s
+unsigned knob_fetch_block = 4;         // bytes fetch reads from instruction memory per cycle
+unsigned knob_vector_lanes = 4;        // elements the vector unit processes per cycle
 int trace_inst_num = -1;
 
 // Pipeline control flags
 bool pipeline_stall = false;
 bool stop_fetch = false;
+unsigned ex_cycles = 0;    // cycles the instruction in ID/EX has spent in a multi-cycle EX
+bool fetch_split = false;  // fetch has read the first block of an instruction that straddles two
+uint32_t fetch_block = UINT32_MAX;    // the aligned block in the fetch buffer
+
+// EX occupancy of a vector instruction: vl elements over knob_vector_lanes lanes,
+// one element a cycle for a strided access, plus an adder tree for a reduction.
+// Only vsetvli changes vl, and it is done before the next instruction enters EX.
+unsigned vector_latency(const InstrDesc &desc) {
+    if (desc.vop == VOP_SETVL || desc.vop == VOP_MOVE_X_S || desc.vop == VOP_MOVE_S_X) return 1;
+    uint32_t n = (vector_unit.vtype & VTYPE_VILL) ? 0 : vector_unit.vl;
+    unsigned lanes = ((desc.flags & (INSTR_LOAD | INSTR_STORE)) && (desc.flags & READS_RS2)) ? 1 : knob_vector_lanes;
+    unsigned cycles = (n + lanes - 1) / lanes;
+    if (desc.flags & VEC_REDUCE) {
+        for (unsigned width = 1; width < knob_vector_lanes; width *= 2) cycles++;
+    }
+    return max(cycles, 1u);
+}
+
+// EX occupancy of an instruction; only the multiplier, the divider, the FP unit
+// and the vector unit take longer than one cycle
+unsigned ex_latency(const InstrDesc &desc) {
+    return (desc.flags & INSTR_VECTOR) ? vector_latency(desc) :
+           (desc.flags & INSTR_MUL) ? knob_mul_latency : (desc.flags & INSTR_DIV) ? knob_div_latency :
+           (desc.flags & INSTR_FMUL) ? knob_fmul_latency : (desc.flags & INSTR_FDIV) ? knob_fdiv_latency :
+           (desc.flags & INSTR_FP) ? knob_fp_latency : 1;
+}
 
 // Statistics counters
 unsigned long long stat_cycles = 0;
 unsigned long long stat_instructions = 0;
 unsigned long long stat_load_store = 0;
 unsigned long long stat_alu = 0;
+unsigned long long stat_bitmanip = 0;      // Zba/Zbb, also counted as ALU
+unsigned long long stat_fp = 0;            // RV32F except flw/fsw, also counted as ALU
+unsigned long long stat_vector = 0;        // RVV, also counted as load/store or ALU
 unsigned long long stat_control = 0;
 unsigned long long stat_stalls = 0;
 unsigned long long stat_data_hazards = 0;
@@ -121,45 +220,718 @@ unsigned long long stat_ctrl_hazards = 0;
 unsigned long long stat_branch_misp = 0;
 unsigned long long stat_stall_data = 0;
 unsigned long long stat_stall_control = 0;
+unsigned long long stat_cpi_stack[CPI_NUM_BUCKETS] = {0};
+unsigned long long stat_fetch_blocks = 0;          // fetch blocks read from instruction memory
+unsigned long long stat_fetch_split_cycles = 0;    // extra cycles for instructions straddling two blocks
+
+// Fetch reads instruction memory in aligned blocks of knob_fetch_block bytes, one
+// block per cycle, and the last block read stays in the fetch buffer. Reads the next
+// block the instruction at pc needs; false if it needs another one after that, i.e.
+// it straddles two blocks and neither was buffered.
+bool fetch_block_ready(uint32_t pc, uint32_t length) {
+    uint32_t first = pc / knob_fetch_block, last = (pc + length - 1) / knob_fetch_block;
+    if (first != fetch_block && first != last) {
+        fetch_block = first;
+        stat_fetch_blocks++;
+        stat_fetch_split_cycles++;
+        return false;
+    }
+    if (last != fetch_block) {
+        fetch_block = last;
+        stat_fetch_blocks++;
+    }
+    return true;
+}
+
+// Counter CSRs, so that a program can time a region of itself: cycle, time and
+// instret, and mhpmcounter3-7 for the statistics below. There is no cache model,
+// so the memory counter reads the CPI stack's memory bucket. A write to a machine
+// counter (mcycle, minstret, mhpmcounterN and their ...h halves) sets the value
+// the program reads from then on; stats.txt still reports the whole run.
+enum {
+    COUNTER_CYCLE, COUNTER_TIME, COUNTER_INSTRET,
+    COUNTER_BRANCH_MISP, COUNTER_STALLS, COUNTER_STALL_DATA, COUNTER_STALL_CONTROL, COUNTER_MEMORY,
+    NUM_COUNTERS
+};
+unsigned long long counter_base[NUM_COUNTERS] = {0};   // subtracted from the total a counter reads
+
+// A counter as seen by the instruction in EX. The instruction ahead of it in
+// MEM/WB has not committed yet but will, so instret counts it.
+unsigned long long counter_total(int counter) {
+    switch (counter) {
+    case COUNTER_CYCLE:
+    case COUNTER_TIME: return stat_cycles;
+    case COUNTER_INSTRET: return stat_instructions + (knob_pipeline && mem_wb.valid);
+    case COUNTER_BRANCH_MISP: return stat_branch_misp;
+    case COUNTER_STALLS: return stat_stalls;
+    case COUNTER_STALL_DATA: return stat_stall_data;
+    case COUNTER_STALL_CONTROL: return stat_stall_control;
+    default: return stat_cpi_stack[CPI_MEMORY];
+    }
+}
+
+uint32_t csr_read(uint32_t csr) {
+    if (is_fp_csr(csr)) return fp_csr_read(csr, fcsr);
+    int counter = csr_counter(csr);
+    if (counter < 0 || counter >= NUM_COUNTERS) return 0;
+    unsigned long long value = counter_total(counter) - counter_base[counter];
+    return (uint32_t)((csr & CSR_HIGH) ? value >> 32 : value);
+}
+
+void csr_write(uint32_t csr, uint32_t value) {
+    if (is_fp_csr(csr)) {
+        fcsr = fp_csr_write(csr, fcsr, value);
+        return;
+    }
+    int counter = csr_counter(csr);
+    if (counter < 0 || counter >= NUM_COUNTERS || counter == COUNTER_TIME || csr_read_only(csr)) return;
+    // the value written to minstret already counts the instruction writing it
+    unsigned long long total = counter_total(counter) + (counter == COUNTER_INSTRET);
+    unsigned long long now = total - counter_base[counter];
+    now = (csr & CSR_HIGH) ? (now & 0xFFFFFFFFull) | (unsigned long long)value << 32 : (now & ~0xFFFFFFFFull) | value;
+    counter_base[counter] = total - now;
+}
 
 // Mapping from PC to instruction number (input program order)
 map<uint32_t, int> inst_num_map;
+// Assembly text carried as a comment after each word of the .mc file
+map<uint32_t, string> asm_text_map;
+map<uint32_t, PCProfile> pc_profile;
+
+// Call-graph profile (--callgraph). The shadow call stack is kept as a call tree
+// so that charging a cycle to the current stack is O(1); node 0 is the entry point.
+struct CallNode {
+    uint32_t entry;
+    int parent;
+    unsigned long long calls = 0;
+    unsigned long long cycles = 0;
+    unsigned long long instructions = 0;
+    map<uint32_t, int> children;
+
+    CallNode(uint32_t entry, int parent) : entry(entry), parent(parent) {}
+};
+vector<CallNode> call_tree;
+int call_current = 0;
+bool call_pending = false;   // a call committed; the next commit is the callee's entry
+map<uint32_t, string> symbol_map;
+
+// Symbol file written by the Phase 1 assembler: one "<address> <T|D> <name>" per line
+void load_symbols(const string &filename) {
+    ifstream file(filename);
+    string line;
+    while (getline(file, line)) {
+        istringstream iss(line);
+        uint32_t addr;
+        string type, name;
+        if (iss >> std::hex >> addr >> type >> name && type == "T") {
+            symbol_map[addr] = name;
+        }
+    }
+}
+
+// Name of the function entered at pc: its label, or label+offset, or the raw address
+string symbol_name(uint32_t pc) {
+    ostringstream name;
+    auto it = symbol_map.upper_bound(pc);
+    if (it == symbol_map.begin()) {
+        name << "0x" << hex << pc;
+        return name.str();
+    }
+    --it;
+    name << it->second;
+    if (it->first != pc) name << "+0x" << hex << (pc - it->first);
+    return name.str();
+}
+
+void callgraph_cycles(unsigned long long cycles) {
+    call_tree[call_current].cycles += cycles;
+}
+
+// Called for every committed instruction, in program order. JAL/JALR with rd=x1
+// is a call and "jalr x0, 0(x1)" a return; anything else stays in the current frame.
+void callgraph_commit(uint32_t pc, uint32_t inst) {
+    if (call_pending) {
+        call_pending = false;
+        auto child = call_tree[call_current].children.find(pc);
+        if (child == call_tree[call_current].children.end()) {
+            call_tree.push_back(CallNode{pc, call_current});
+            child = call_tree[call_current].children.insert({pc, (int)call_tree.size() - 1}).first;
+        }
+        call_current = child->second;
+        call_tree[call_current].calls++;
+    }
+    call_tree[call_current].instructions++;
+    uint32_t opcode = inst & 0x7F;
+    uint32_t rd = (inst >> 7) & 0x1F;
+    uint32_t rs1 = (inst >> 15) & 0x1F;
+    int32_t imm = (int32_t)inst >> 20;
+    if ((opcode == 0x6F || opcode == 0x67) && rd == 1) {
+        call_pending = true;
+    } else if (opcode == 0x67 && rd == 0 && rs1 == 1 && imm == 0 && call_tree[call_current].parent >= 0) {
+        call_current = call_tree[call_current].parent;
+    }
+}
+
+// Branch and block profile (--branch-profile), read back by the Phase 1 assembler to
+// lay out basic blocks so that hot paths fall through. Blocks start at the entry, at
+// branch/jal targets and after every branch or jump; a block's count is the number of
+// times its first instruction committed.
+struct BranchProfile {
+    unsigned long long taken = 0;
+    unsigned long long not_taken = 0;
+};
+map<uint32_t, BranchProfile> branch_profile;
+unordered_map<uint32_t, unsigned long long> block_counts;
+
+void init_block_counts() {
+    block_counts[PC] = 0;
+    for (auto &entry : instr_map) {
+        uint32_t pc = entry.first;
+        DecodedInstr instr = decode_instruction(expand_instruction(entry.second));
+        // branch and jal targets start blocks; jalr targets are only known at run time
+        if (instr.desc->type == SB_TYPE || instr.desc->type == UJ_TYPE) block_counts[pc + instr.imm] = 0;
+        if (instr.desc->flags & (INSTR_BRANCH | INSTR_JUMP)) block_counts[pc + instruction_size(entry.second)] = 0;
+    }
+}
+
+void count_block(uint32_t pc) {
+    auto it = block_counts.find(pc);
+    if (it != block_counts.end()) it->second++;
+}
+
+void write_branch_profile(const string &filename) {
+    ofstream out(filename);
+    out << "# branch <pc> <taken> <not-taken> <asm>\n";
+    out << "# block <pc> <executions>\n";
+    char pc_hex[16];
+    for (auto &entry : branch_profile) {
+        snprintf(pc_hex, sizeof(pc_hex), "0x%08X", entry.first);
+        out << "branch " << pc_hex << " " << dec << entry.second.taken << " " << entry.second.not_taken
+            << " " << asm_text_map[entry.first] << "\n";
+    }
+    map<uint32_t, unsigned long long> blocks(block_counts.begin(), block_counts.end());
+    for (auto &entry : blocks) {
+        if (instr_map.find(entry.first) == instr_map.end()) continue;
+        snprintf(pc_hex, sizeof(pc_hex), "0x%08X", entry.first);
+        out << "block " << pc_hex << " " << dec << entry.second << "\n";
+    }
+    out.close();
+}
+
+// Read-only view of a whole input file: mmap'd on Linux, read into memory elsewhere
+struct MappedFile {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    vector<uint8_t> buffer;
+
+    bool open(const string &filename) {
+#ifdef __linux__
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        bool mapped = fstat(fd, &st) == 0;
+        if (mapped && st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<const uint8_t *>(p);
+                size = st.st_size;
+            } else {
+                mapped = false;
+            }
+        }
+        ::close(fd);
+        if (mapped) return true;
+#endif
+        ifstream file(filename, ios::binary);
+        if (!file) return false;
+        buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+    }
+
+    ~MappedFile() {
+#ifdef __linux__
+        if (data && buffer.empty()) munmap(const_cast<uint8_t *>(data), size);
+#endif
+    }
+};
+
+// Host files mapped into guest memory with --map-file path@0xADDR[:ro|cow].
+// "cow" (the default) maps the file privately and writable: the kernel copies a
+// page on its first store, so the host file never changes. Only pages dirtied by
+// the program are dumped to output.mc.
+const uint32_t GUEST_PAGE_SIZE = 4096;
+struct MappedRegion {
+    string path;
+    uint32_t base = 0;
+    uint32_t size = 0;
+    bool writable = true;
+    uint8_t *host = nullptr;
+    vector<uint8_t> buffer;     // file contents where mmap is unavailable
+    vector<bool> dirty;         // one flag per guest page
+};
+vector<MappedRegion> mapped_regions;
+
+inline MappedRegion *find_mapped_region(uint32_t addr) {
+    for (auto &region : mapped_regions) {
+        if (addr - region.base < region.size) return &region;
+    }
+    return nullptr;
+}
+
+void map_guest_file(const string &spec) {
+    auto fail = [&](const string &why) {
+        cerr << "Error: --map-file " << spec << ": " << why << endl;
+        exit(1);
+    };
+    MappedRegion region;
+    size_t at = spec.rfind('@');
+    if (at == string::npos || at == 0) fail("expected path@0xADDR[:ro|cow]");
+    region.path = spec.substr(0, at);
+    string where = spec.substr(at + 1), mode = "cow";
+    size_t colon = where.find(':');
+    if (colon != string::npos) {
+        mode = where.substr(colon + 1);
+        where = where.substr(0, colon);
+    }
+    if (mode != "ro" && mode != "cow") fail("mode must be ro or cow");
+    region.writable = (mode == "cow");
+    size_t used = 0;
+    unsigned long long base = 0;
+    try {
+        base = stoull(where, &used, 0);
+    } catch (const exception &) {
+        used = 0;
+    }
+    if (used == 0 || used != where.size() || base > 0xFFFFFFFFull) fail("bad guest address");
+    region.base = base;
+
+    unsigned long long size = 0;
+#ifdef __linux__
+    int fd = ::open(region.path.c_str(), O_RDONLY);
+    if (fd < 0) fail("cannot open file");
+    struct stat st;
+    if (fstat(fd, &st) != 0) fail("cannot stat file");
+    size = st.st_size;
+    if (size == 0) fail("file is empty");
+    if (region.base + size > 0x100000000ull) fail("file does not fit below 4 GiB");
+    void *p = mmap(nullptr, size, PROT_READ | (region.writable ? PROT_WRITE : 0), MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) fail("mmap failed");
+    region.host = static_cast<uint8_t *>(p);
+#else
+    ifstream file(region.path, ios::binary);
+    if (!file) fail("cannot open file");
+    region.buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    size = region.buffer.size();
+    if (size == 0) fail("file is empty");
+    if (region.base + size > 0x100000000ull) fail("file does not fit below 4 GiB");
+    region.host = region.buffer.data();
+#endif
+    region.size = size;
+    for (auto &other : mapped_regions) {
+        if (region.base < other.base + (unsigned long long)other.size && other.base < region.base + size) {
+            fail("overlaps the mapping of " + other.path);
+        }
+    }
+    region.dirty.assign((size + GUEST_PAGE_SIZE - 1) / GUEST_PAGE_SIZE, false);
+    mapped_regions.push_back(move(region));
+}
+
+// Data memory accesses of both engines, little-endian: mapped files first, then
+// the data segment. Reading an untouched byte records it as 0, so it is listed
+// in output.mc.
+uint32_t load_guest(uint32_t addr, int size) {
+    uint32_t val = 0;
+    for (int i = 0; i < size; ++i) {
+        uint32_t a = addr + i;
+        if (MappedRegion *region = find_mapped_region(a)) {
+            val |= (uint32_t)region->host[a - region->base] << (8 * i);
+            continue;
+        }
+        val |= (uint32_t)data_segment[a] << (8 * i);
+    }
+    return val;
+}
+
+void store_guest(uint32_t addr, int size, uint32_t value, uint32_t pc) {
+    for (int i = 0; i < size; ++i) {
+        uint32_t a = addr + i;
+        uint8_t byte = (value >> (8 * i)) & 0xFF;
+        if (MappedRegion *region = find_mapped_region(a)) {
+            if (!region->writable) {
+                cerr << "Error: store to read-only mapping of " << region->path << " at 0x" << hex << a
+                     << " (pc 0x" << pc << ")" << dec << endl;
+                exit(1);
+            }
+            region->host[a - region->base] = byte;
+            region->dirty[(a - region->base) / GUEST_PAGE_SIZE] = true;
+            continue;
+        }
+        data_segment[a] = byte;
+    }
+}
+
+// The system call of the ecall at pc, once everything older has committed.
+// Returns false if the run ends here.
+bool run_syscall(uint32_t pc) {
+    bool resume = syscall_execute(syscalls, REG, stat_cycles, [](uint32_t addr, int size) { return load_guest(addr, size); },
+                                  [pc](uint32_t addr, int size, uint32_t value) { store_guest(addr, size, value, pc); });
+    REG[0] = 0;
+    return resume;
+}
+
+// Hex digit values for the .mc parser, 0xFF for anything else
+struct HexDigitTable {
+    uint8_t value[256];
+    constexpr HexDigitTable() : value() {
+        for (int c = 0; c < 256; ++c) value[c] = 0xFF;
+        for (int c = '0'; c <= '9'; ++c) value[c] = c - '0';
+        for (int c = 'a'; c <= 'f'; ++c) value[c] = c - 'a' + 10;
+        for (int c = 'A'; c <= 'F'; ++c) value[c] = c - 'A' + 10;
+    }
+};
+constexpr HexDigitTable hex_digits;
+
+// Parses one whitespace-separated hex number ("0x" optional) at p and advances p
+// past it. Like reading it with istream >> hex, a number that does not fit in 32
+// bits fails; here that is one with more than 8 digits.
+inline bool parse_hex_word(const char *&p, const char *end, uint32_t &out) {
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) ++p;
+    if (end - p >= 2 && p[0] == '0' && (p[1] | 0x20) == 'x') p += 2;
+    const char *start = p;
+    uint32_t v = 0;
+    while (p < end) {
+        uint8_t d = hex_digits.value[(uint8_t)*p];
+        if (d > 15) break;
+        v = (v << 4) | d;
+        ++p;
+    }
+    out = v;
+    return p != start && p - start <= 8;
+}
+
+// What one thread parsed from its slice of a .mc file, in file order
+struct McTextLine {
+    uint32_t pc;
+    uint32_t inst;
+    string text;
+};
+struct McChunk {
+    const char *begin;
+    const char *end;
+    bool data;
+    vector<McTextLine> text;
+    vector<pair<uint32_t, uint8_t>> bytes;
+
+    McChunk(const char *begin, const char *end, bool data) : begin(begin), end(end), data(data) {}
+};
+
+void parse_mc_chunk(McChunk &chunk) {
+    const char *p = chunk.begin;
+    if (chunk.data) chunk.bytes.reserve((chunk.end - chunk.begin) / 16);
+    while (p < chunk.end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', chunk.end - p));
+        if (!eol) eol = chunk.end;
+        const char *q = p;
+        p = eol + 1;
+        if (q == eol || *q == '#') continue;
+        uint32_t first, second;
+        if (!parse_hex_word(q, eol, first) || !parse_hex_word(q, eol, second)) continue;
+        if (chunk.data) {
+            chunk.bytes.emplace_back(first, static_cast<uint8_t>(second & 0xFF));
+            continue;
+        }
+        // whatever follows the two words up to the '#' is the source text
+        const char *text_end = static_cast<const char *>(memchr(q, '#', eol - q));
+        if (!text_end) text_end = eol;
+        auto separator = [](char c) { return c == ' ' || c == ',' || c == '\t' || c == '\r'; };
+        while (q < text_end && separator(*q)) ++q;
+        while (text_end > q && separator(text_end[-1])) --text_end;
+        chunk.text.push_back(McTextLine{first, second, string(q, text_end)});
+    }
+}
+
+// ELF32 little-endian layouts, only the fields the loader reads
+struct Elf32Header {
+    uint8_t ident[16];
+    uint16_t type, machine;
+    uint32_t version, entry, phoff, shoff, flags;
+    uint16_t ehsize, phentsize, phnum, shentsize, shnum, shstrndx;
+};
+struct Elf32ProgramHeader {
+    uint32_t type, offset, vaddr, paddr, filesz, memsz, flags, align;
+};
+struct Elf32SectionHeader {
+    uint32_t name, type, flags, addr, offset, size, link, info, addralign, entsize;
+};
+struct Elf32Symbol {
+    uint32_t name, value, size;
+    uint8_t info, other;
+    uint16_t shndx;
+};
+
+// Compact binary image written by the Phase 1 assembler with --mcb; the layout
+// must match McbHeader/McbRun/McbSymbol/McbLine there
+struct McbHeader {
+    char magic[4];
+    uint32_t version, entry;
+    uint32_t text_runs, text_run_count;
+    uint32_t data_runs, data_run_count;
+    uint32_t symbols, symbol_count;
+    uint32_t lines, line_count;
+    uint32_t strings, strings_size;
+};
+struct McbRun { uint32_t address, size, payload; };
+struct McbSymbol { uint32_t address, name, kind; };
+struct McbLine { uint32_t address, line_number, text; };
 
 // Simulator class (for loading and sequential execution)
 class RiscVsimulator {
 public:
-    void load_mc_file(const string &filename) {
-        ifstream file(filename);
-        if (!file) {
+    // Pick the loader from the file contents: ELF executables start with "\x7fELF"
+    void load_program(const string &filename) {
+        char magic[4] = {0};
+        ifstream probe(filename, ios::binary);
+        probe.read(magic, 4);
+        if (probe.gcount() == 4 && memcmp(magic, "\x7f" "ELF", 4) == 0) {
+            load_elf_file(filename);
+        } else if (probe.gcount() == 4 && memcmp(magic, "\x7f" "MCB", 4) == 0) {
+            load_mcb_file(filename);
+        } else {
+            load_mc_file(filename);
+        }
+    }
+
+    // Binary image from the assembler (--mcb): the mapped text and data runs are
+    // copied into instr_map and data_segment, and the source text of each
+    // instruction comes from the line table
+    void load_mcb_file(const string &filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
             cerr << "Error: Could not open file " << filename << endl;
             exit(1);
         }
-        string line;
-        bool data_section = false;
+        auto fail = [&](const char *why) {
+            cerr << "Error: " << filename << ": " << why << endl;
+            exit(1);
+        };
+        McbHeader h;
+        if (file.size < sizeof(h)) fail("truncated header");
+        memcpy(&h, file.data, sizeof(h));
+        if (h.version != 1) fail("unsupported .mcb version");
+        auto in_file = [&](uint32_t offset, uint64_t bytes) { return offset + bytes <= file.size; };
+        if (!in_file(h.text_runs, (uint64_t)h.text_run_count * sizeof(McbRun)) ||
+            !in_file(h.data_runs, (uint64_t)h.data_run_count * sizeof(McbRun)) ||
+            !in_file(h.symbols, (uint64_t)h.symbol_count * sizeof(McbSymbol)) ||
+            !in_file(h.lines, (uint64_t)h.line_count * sizeof(McbLine)) ||
+            !in_file(h.strings, h.strings_size) || h.strings_size == 0 ||
+            file.data[h.strings + h.strings_size - 1] != 0) {
+            fail("section past end of file");
+        }
+        const char *strings = (const char *)file.data + h.strings;
+
         int inst_count = 0;
-        while (getline(file, line)) {
-            if (line.empty() || line[0] == '#') {
-                if (line.find("#Data Segment") != string::npos) {
-                    data_section = true;
+        for (uint32_t i = 0; i < h.text_run_count; ++i) {
+            McbRun run;
+            memcpy(&run, file.data + h.text_runs + i * sizeof(run), sizeof(run));
+            if (!in_file(run.payload, run.size)) fail("text run past end of file");
+            // 2-byte RV32C parcels and 4-byte words, told apart by their low bits
+            for (uint32_t off = 0, inst = 0; off + 2 <= run.size; off += instruction_size(inst)) {
+                memcpy(&inst, file.data + run.payload + off, 2);
+                if (instruction_size(inst) == 4 && off + 4 <= run.size) memcpy(&inst, file.data + run.payload + off, 4);
+                else inst &= 0xFFFF;
+                instr_map.insert_or_assign(instr_map.end(), run.address + off, inst);
+                inst_num_map.insert_or_assign(inst_num_map.end(), run.address + off, ++inst_count);
+            }
+        }
+        for (uint32_t i = 0; i < h.data_run_count; ++i) {
+            McbRun run;
+            memcpy(&run, file.data + h.data_runs + i * sizeof(run), sizeof(run));
+            if (!in_file(run.payload, run.size)) fail("data run past end of file");
+            for (uint32_t off = 0; off < run.size; ++off) {
+                data_segment.insert_or_assign(data_segment.end(), run.address + off, file.data[run.payload + off]);
+            }
+        }
+        for (uint32_t i = 0; i < h.symbol_count; ++i) {
+            McbSymbol sym;
+            memcpy(&sym, file.data + h.symbols + i * sizeof(sym), sizeof(sym));
+            if (sym.kind == 'T' && sym.name < h.strings_size) symbol_map[sym.address] = strings + sym.name;
+        }
+        for (uint32_t i = 0; i < h.line_count; ++i) {
+            McbLine line;
+            memcpy(&line, file.data + h.lines + i * sizeof(line), sizeof(line));
+            if (line.text < h.strings_size) asm_text_map[line.address] = strings + line.text;
+        }
+        PC = h.entry;
+    }
+
+    // RV32 ELF executable. Every PT_LOAD segment is copied into data memory, and
+    // the code of the executable ones also becomes instruction words. Execution
+    // starts at e_entry, and STT_FUNC symbols from .symtab name functions for the
+    // profilers.
+    void load_elf_file(const string &filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            cerr << "Error: Could not open file " << filename << endl;
+            exit(1);
+        }
+        auto fail = [&](const char *why) {
+            cerr << "Error: " << filename << ": " << why << endl;
+            exit(1);
+        };
+        Elf32Header eh;
+        if (file.size < sizeof(eh)) fail("truncated ELF header");
+        memcpy(&eh, file.data, sizeof(eh));
+        if (eh.ident[4] != 1) fail("not a 32-bit ELF file");
+        if (eh.ident[5] != 1) fail("not a little-endian ELF file");
+        if (eh.machine != 243) fail("not a RISC-V ELF file");
+        if (eh.type != 2) fail("not an executable (ET_EXEC)");
+
+        bool have_sections = eh.shoff && eh.shentsize == sizeof(Elf32SectionHeader) &&
+                             eh.shoff + (size_t)eh.shnum * sizeof(Elf32SectionHeader) <= file.size;
+        const uint8_t *sections = file.data + eh.shoff;
+
+        // Address ranges of the executable sections. An R-X segment also holds
+        // .rodata and padding, so when the file has section headers only these
+        // ranges are decoded as instructions.
+        vector<pair<uint32_t, uint32_t>> code_ranges;
+        if (have_sections) {
+            for (int i = 0; i < eh.shnum; ++i) {
+                Elf32SectionHeader sh;
+                memcpy(&sh, sections + i * sizeof(sh), sizeof(sh));
+                if (sh.type == 1 && (sh.flags & 0x6) == 0x6 && sh.size) {   // SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR
+                    code_ranges.push_back({sh.addr, sh.addr + sh.size});
                 }
-                continue;
             }
-            istringstream iss(line);
-            if (!data_section) {
-                uint32_t pc, inst;
-                if (iss >> std::hex >> pc >> inst) {
-                    instr_map[pc] = inst;
-                    inst_count++;
-                    inst_num_map[pc] = inst_count;
+            sort(code_ranges.begin(), code_ranges.end());
+        }
+
+        int inst_count = 0;
+        for (int i = 0; i < eh.phnum; ++i) {
+            Elf32ProgramHeader ph;
+            size_t at = eh.phoff + (size_t)i * eh.phentsize;
+            if (at + sizeof(ph) > file.size) fail("truncated program header");
+            memcpy(&ph, file.data + at, sizeof(ph));
+            if (ph.type != 1 || ph.memsz == 0) continue;   // PT_LOAD only
+            if ((size_t)ph.offset + ph.filesz > file.size) fail("segment past end of file");
+            const uint8_t *bytes = file.data + ph.offset;
+            // Every segment is readable data, the executable one included: GNU ld
+            // places .rodata in it. .bss (memsz beyond filesz) reads as zero without being stored.
+            for (uint32_t off = 0; off < ph.filesz; ++off) {
+                data_segment[ph.vaddr + off] = bytes[off];
+            }
+            data_end = max(data_end, ph.vaddr + ph.memsz);
+            if (!(ph.flags & 1)) continue;   // PF_X
+
+            vector<pair<uint32_t, uint32_t>> code;   // offsets into the segment
+            if (code_ranges.empty()) code.push_back({0, ph.filesz});
+            for (auto &range : code_ranges) {
+                uint32_t from = max(range.first, ph.vaddr), to = min(range.second, ph.vaddr + ph.filesz);
+                if (from < to) code.push_back({from - ph.vaddr, to - ph.vaddr});
+            }
+            for (auto &range : code) {
+                // 2-byte RV32C parcels and 4-byte words, told apart by their low bits
+                for (uint32_t off = range.first; off + 2 <= range.second; ) {
+                    uint16_t half;
+                    memcpy(&half, bytes + off, 2);
+                    uint32_t inst = half;
+                    if (instruction_size(inst) == 4) {
+                        if (off + 4 > range.second) fail("truncated instruction at end of executable segment");
+                        memcpy(&inst, bytes + off, 4);
+                    }
+                    instr_map[ph.vaddr + off] = inst;
+                    inst_num_map[ph.vaddr + off] = ++inst_count;
+                    off += instruction_size(inst);
                 }
-            } else {
-                uint32_t addr, value;
-                if (iss >> std::hex >> addr >> value) {
-                    data_segment[addr] = static_cast<uint8_t>(value & 0xFF);
+            }
+        }
+
+        if (have_sections) {
+            for (int i = 0; i < eh.shnum; ++i) {
+                Elf32SectionHeader sh, strtab;
+                memcpy(&sh, sections + i * sizeof(sh), sizeof(sh));
+                if (sh.type != 2 || sh.link >= eh.shnum) continue;   // SHT_SYMTAB
+                memcpy(&strtab, sections + sh.link * sizeof(strtab), sizeof(strtab));
+                if ((size_t)sh.offset + sh.size > file.size || (size_t)strtab.offset + strtab.size > file.size) continue;
+                for (uint32_t off = 0; off + sizeof(Elf32Symbol) <= sh.size; off += sizeof(Elf32Symbol)) {
+                    Elf32Symbol sym;
+                    memcpy(&sym, file.data + sh.offset + off, sizeof(sym));
+                    if ((sym.info & 0xF) != 2 || sym.name >= strtab.size) continue;   // STT_FUNC
+                    const char *name = (const char *)file.data + strtab.offset + sym.name;
+                    symbol_map[sym.value] = string(name, strnlen(name, strtab.size - sym.name));
                 }
             }
         }
-        file.close();
+        PC = eh.entry;
+    }
+
+    // The file is mapped and cut at line boundaries into slices that are parsed
+    // in parallel; the slices are then merged in file order, so the result is the
+    // same as reading it line by line. Small files are parsed on this thread.
+    void load_mc_file(const string &filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            cerr << "Error: Could not open file " << filename << endl;
+            exit(1);
+        }
+        const char *begin = reinterpret_cast<const char *>(file.data);
+        const char *end = begin + file.size;
+
+        // lines after the first "#Data Segment" comment line are data
+        const char *data_begin = end, *text_end = end;
+        for (const char *p = begin; p < end; ) {
+            const char *mark = static_cast<const char *>(memmem(p, end - p, "#Data Segment", 13));
+            if (!mark) break;
+            const char *line = mark;
+            while (line > begin && line[-1] != '\n') --line;
+            p = mark + 13;
+            if (*line != '#') continue;
+            const char *eol = static_cast<const char *>(memchr(mark, '\n', end - mark));
+            text_end = line;
+            data_begin = eol ? eol + 1 : end;
+            break;
+        }
+
+        unsigned threads = knob_load_threads ? knob_load_threads : max(1u, thread::hardware_concurrency());
+        if (!knob_load_threads && file.size < (1u << 20)) threads = 1;
+        size_t slice = max<size_t>(1, file.size / threads);
+        vector<McChunk> chunks;
+        auto split = [&](const char *from, const char *to, bool data) {
+            while (from < to) {
+                const char *cut = to;
+                if ((size_t)(to - from) > slice) {
+                    const char *eol = static_cast<const char *>(memchr(from + slice, '\n', to - from - slice));
+                    cut = eol ? eol + 1 : to;
+                }
+                chunks.push_back(McChunk{from, cut, data});
+                from = cut;
+            }
+        };
+        split(begin, text_end, false);
+        split(data_begin, end, true);
+
+        if (chunks.size() > 1) {
+            vector<thread> workers;
+            for (auto &chunk : chunks) workers.emplace_back(parse_mc_chunk, ref(chunk));
+            for (auto &worker : workers) worker.join();
+        } else if (!chunks.empty()) {
+            parse_mc_chunk(chunks[0]);
+        }
+
+        // lines are normally in address order, so appending at end() is O(1)
+        int inst_count = 0;
+        for (auto &chunk : chunks) {
+            for (auto &line : chunk.text) {
+                instr_map.insert_or_assign(instr_map.end(), line.pc, line.inst);
+                inst_num_map.insert_or_assign(inst_num_map.end(), line.pc, ++inst_count);
+                asm_text_map.insert_or_assign(asm_text_map.end(), line.pc, move(line.text));
+            }
+            for (auto &byte : chunk.bytes) {
+                data_segment.insert_or_assign(data_segment.end(), byte.first, byte.second);
+            }
+        }
         if (!instr_map.empty()) {
             PC = instr_map.begin()->first;
         }
@@ -173,39 +945,78 @@ public:
         REG[10] = 0x1;
         while (instr_map.find(PC) != instr_map.end()) {
             Instruction instr;
-            fetch(instr);
-            stat_cycles++; // Fetch
+            unsigned long long cycles_before = stat_cycles;
+            uint32_t PC_of_instr = PC;
+            unsigned split_cycles = fetch(instr);
+            stat_cycles += 1 + split_cycles; // Fetch
 
             decode(instr);
             stat_cycles++; // Decode
+            uint32_t flags = instr.desc->flags;
+
+            // A word that is no instruction (e.g. the 0xFFFFFFFF end-of-text
+            // marker) never commits, as in the pipeline
+            if (instr.desc == &invalid_instruction) {
+                stat_cpi_stack[CPI_DRAIN] += stat_cycles - cycles_before;
+                continue;
+            }
 
             execute(instr);
-            stat_cycles++; // Execute
+            stat_cycles += ex_latency(*instr.desc); // Execute
 
             // Memory access only for Load/Store
-            if (instr.opcode == 0x03 || instr.opcode == 0x23) {
+            if (flags & (INSTR_LOAD | INSTR_STORE)) {
                 memory_access(instr);
                 stat_cycles++; // Memory access
             }
 
-            // Writeback only for instructions that write to registers
-            // Store (0x23) doesn't write back, rest might
-            if (instr.opcode != 0x23 && instr.opcode != 0x63) {
+            // Writeback for everything but stores and branches
+            if (!(flags & (INSTR_STORE | INSTR_BRANCH))) {
                 writeback(instr);
                 stat_cycles++; // Writeback
             }
 
             stat_instructions++; // 1 instruction retired
+            // One cycle per instruction is the base cost; the rest is the unpipelined
+            // datapath being held by this instruction, i.e. a structural cost, except
+            // for reading a second fetch block
+            stat_cpi_stack[CPI_BASE]++;
+            stat_cpi_stack[CPI_MEMORY] += split_cycles;
+            stat_cpi_stack[CPI_STRUCTURAL] += stat_cycles - cycles_before - 1 - split_cycles;
+            if (knob_callgraph) {
+                callgraph_cycles(stat_cycles - cycles_before);
+                callgraph_commit(PC_of_instr, IR);
+            }
+            if (knob_branch_profile) {
+                count_block(PC_of_instr);
+                if (flags & INSTR_BRANCH) {
+                    BranchProfile &branch = branch_profile[PC_of_instr];
+                    (PC != PC_of_instr + instr.length ? branch.taken : branch.not_taken)++;
+                }
+            }
+            if (knob_profile) {
+                PCProfile &prof = pc_profile[PC_of_instr];
+                prof.executions++;
+                prof.cycles += stat_cycles - cycles_before;
+                prof.stage_cycles[STAGE_IF]++;
+                prof.stage_cycles[STAGE_ID]++;
+                prof.stage_cycles[STAGE_EX]++;
+                if (flags & (INSTR_LOAD | INSTR_STORE)) prof.stage_cycles[STAGE_MEM]++;
+                if (!(flags & (INSTR_STORE | INSTR_BRANCH))) prof.stage_cycles[STAGE_WB]++;
+            }
             // Classify instruction type for stats
-            if (instr.opcode == 0x03 || instr.opcode == 0x23) {
+            if (flags & (INSTR_LOAD | INSTR_STORE)) {
                 stat_load_store++;
-            } else if (instr.opcode == 0x33 || instr.opcode == 0x13 || instr.opcode == 0x37 || instr.opcode == 0x17) {
-                stat_alu++;
-            } else if (instr.opcode == 0x63 || instr.opcode == 0x6F || instr.opcode == 0x67) {
+            } else if (flags & (INSTR_BRANCH | INSTR_JUMP)) {
                 stat_control++;
+            } else if (!(flags & INSTR_ECALL)) {
+                stat_alu++;
+                if (flags & INSTR_BITMANIP) stat_bitmanip++;
+                if (flags & INSTR_FP) stat_fp++;
             }
-            // Terminate on ECALL
-            if (instr.opcode == 0x73) {
+            if (flags & INSTR_VECTOR) stat_vector++;
+            // Run the system call; exit, or an ecall that is no system call, terminates
+            if ((flags & INSTR_ECALL) && !run_syscall(PC_of_instr)) {
                 break;
             }
             if (knob_print_regs) {
@@ -225,303 +1036,125 @@ public:
         for (int i = 0; i < 32; ++i) {
             outFile << "R[" << dec << i << "]: 0x" << hex << REG[i] << "\n";
         }
+        // the f-registers, for programs with RV32F instructions
+        bool uses_fp = any_of(instr_map.begin(), instr_map.end(), [](const pair<const uint32_t, uint32_t> &entry) {
+            return (instruction_decoder.lookup(expand_instruction(entry.second)).flags & (INSTR_FP | FP_RD | FP_RS2)) != 0;
+        });
+        if (uses_fp) {
+            outFile << "\nFinal FP Registers:\n";
+            for (uint32_t i = 0; i < 32; ++i) {
+                outFile << "F[" << dec << i << "]: 0x" << hex << REG[FP_REG + i] << " (" << defaultfloat
+                        << fp_value(REG[FP_REG + i]) << ")\n";
+            }
+            outFile << "fcsr: 0x" << hex << fcsr << "\n";
+        }
+        // the v-registers as 32-bit words, for programs with RVV instructions
+        bool uses_vector = any_of(instr_map.begin(), instr_map.end(), [](const pair<const uint32_t, uint32_t> &entry) {
+            return (instruction_decoder.lookup(expand_instruction(entry.second)).flags & INSTR_VECTOR) != 0;
+        });
+        if (uses_vector) {
+            outFile << "\nFinal Vector Registers (VLEN " << dec << vector_unit.vlen << ", vl " << vector_unit.vl
+                    << ", vtype 0x" << hex << vector_unit.vtype << "):\n";
+            for (uint32_t i = 0; i < 32; ++i) {
+                outFile << "V[" << dec << i << "]:" << hex << setfill('0');
+                for (uint32_t byte = 0; byte < vector_unit.vlen / 8; byte += 4) {
+                    uint32_t word;
+                    memcpy(&word, vector_unit.reg[i] + byte, sizeof word);
+                    outFile << " 0x" << setw(8) << word;
+                }
+                outFile << setfill(' ') << "\n";
+            }
+        }
         outFile << "\nFinal Memory State (Used Addresses):\n";
         for (auto &entry : data_segment) {
             outFile << "Mem[0x" << hex << entry.first << "] = 0x" << (int)entry.second << "\n";
         }
+        for (auto &region : mapped_regions) {
+            for (size_t page = 0; page < region.dirty.size(); ++page) {
+                if (!region.dirty[page]) continue;
+                uint32_t first = page * GUEST_PAGE_SIZE;
+                uint32_t last = min<uint32_t>(first + GUEST_PAGE_SIZE, region.size);
+                for (uint32_t off = first; off < last; ++off) {
+                    outFile << "Mem[0x" << hex << region.base + off << "] = 0x" << (int)region.host[off] << "\n";
+                }
+            }
+        }
         outFile.close();
     }
 
 private:
     // Phase 2 (non-pipelined) stage implementations
-    void fetch(Instruction &instr) {
-        IR = instr_map[PC];
+    // returns the extra cycles spent on a second fetch block
+    unsigned fetch(Instruction &instr) {
+        uint32_t parcel = instr_map[PC];
+        unsigned split_cycles = 0;
+        instr.length = instruction_size(parcel);
+        while (!fetch_block_ready(PC, instr.length)) split_cycles++;
+        IR = expand_instruction(parcel);
         printf("[FETCH] PC: 0x%08X -> Instruction: 0x%08X\n", PC, IR);
-        PC += 4;
+        PC += instr.length;
         cout << endl;
+        return split_cycles;
     }
 
     void decode(Instruction &instr) {
-        instr.opcode = IR & 0x7F; // Extract instr.opcode (7 bits)
-        instr.rd = (IR >> 7) & 0x1F; // Extract instr.rd (5 bits)
-        instr.func3 = (IR >> 12) & 0x07; // Extract instr.func3 (3 bits)
-        instr.rs1 = (IR >> 15) & 0x1F; // Extract instr.rs1 (5 bits)
-        instr.rs2 = (IR >> 20) & 0x1F; // Extract instr.rs2 (5 bits)
-        instr.func7 = (IR >> 25) & 0x7F; // Extract instr.func7 (7 bits)
-    
-        // Decode instr.immediate based on instruction type
-        switch (instr.opcode) {
-            case 0x33: // R-Type (e.g., ADD, SUB, AND, OR, SLL, SLT, SRA, SRL, XOR, MUL, DIV, REM)
-                instr.imm = 0; // No instr.immediate field in R-Type instructions
-                // All fields (instr.rd, instr.rs1, instr.rs2) are used in R-Type instructions
-                break;
-    
-            case 0x03: // I-Type (Load: LB, LH, LW, LD)
-                instr.imm = (int32_t)(IR >> 20); // Extract bits 31:20
-                instr.imm = instr.imm | ((instr.imm & (1 << 11)) ? 0xFFFFF000 : 0x00000000); // Sign extend
-                // Shift left, then right to sign extend
-                instr.rs2 = 0; // instr.rs2 is not used in I-Type instructions
-                break;
-            case 0x13: // I-Type (ALU: ADDI, ANDI, ORI)
-                instr.imm = (int32_t)(IR >> 20); // Extract bits 31:20
-                instr.imm = instr.imm | ((instr.imm & (1 << 11)) ? 0xFFFFF000 : 0x00000000); // Sign extend
-                // Shift left, then right to sign extend
-                instr.rs2 = 0; // instr.rs2 is not used in I-Type instructions
-                break;
-            case 0x67: // I-Type (JALR)
-                instr.imm = (int32_t)(IR >> 20); // Sign-extended 12-bit instr.immediate
-                instr.rs2 = 0; // instr.rs2 is not used in I-Type instructions
-                break;
-    
-            case 0x23: // S-Type (Store: SB, SH, SW, SD)
-                instr.imm = ((IR >> 25) << 5) | ((IR >> 7) & 0x1F); // Sign-extended 12-bit instr.immediate
-                instr.rd = 0; // instr.rd is not used in S-Type instructions
-                break;
-    
-            case 0x63: // SB-Type (Branch: BEQ, BNE, BGE, BLT)
-                instr.imm = ((IR >> 31) << 12) | // Extract bit 31 to instr.imm[12]
-                      (((IR >> 7) & 1) << 11) | // Extract bit 7 to instr.imm[11]
-                      (((IR >> 25) & 0x3F) << 5) | // Extract bits 30-25 to instr.imm[10:5]
-                      ((IR >> 8) & 0xF) << 1;  // Extract bits 11-8 to instr.imm[4:1]
-            
-                // Sign extend 13-bit instr.immediate
-                if (instr.imm & (1 << 12)) {
-                    instr.imm |= 0xFFFFE000; // Extend sign to 32 bits
-                }
-                instr.imm/=2;
-                // cout << "instr.immediate: " << instr.imm << endl;
-                instr.rd = 0; // instr.rd is not used in SB-Type instructions
-                break;
-            
-            
-            case 0x17: // U-Type (AUIPC)
-            case 0x37: // U-Type (LUI)
-            instr.imm = (IR & 0xFFFFF000);  // Extract bits 31:12
-            // Sign-extend the 20-bit immediate to 32 bits
-            if (IR & 0x80000000) {  // Check if sign bit is set
-                instr.imm |= 0xFFF00000;
-            }
-            instr.rs1 = 0;
-            instr.rs2 = 0;
-            break;
-
-    
-            case 0x6F: // UJ-Type (JAL)
-            instr.imm = ((IR >> 31) & 1) << 20 | // instr.imm[20]
-                  ((IR >> 21) & 0x3FF) << 1 | // instr.imm[10:1]
-                  ((IR >> 20) & 1) << 11 | // instr.imm[11]
-                  ((IR >> 12) & 0xFF) << 12; // instr.imm[19:12]
-        
-            // Sign extension for 21-bit instr.immediate
-            if (instr.imm & (1 << 20)) {
-                instr.imm |= 0xFFE00000; // Extend negative sign to 32-bit
-            }
-        
-            // instr.imm <<= 1; // JAL instr.immediate is always even, so shift left by 1
-        
-            printf("[EXECUTE] JAL with instr.imm: 0x%08X\n", instr.imm);
-            break;        
-    
-            default:
-                instr.imm = 0; // Unknown instr.opcode
-                instr.rd = 0; // Default to 0 if unknown
-                instr.rs1 = 0; // Default to 0 if unknown
-                instr.rs2 = 0; // Default to 0 if unknown
-                break;
-        }
-    
-        printf("[DECODE] Opcode: 0x%02X, RD: %d, instr.rs1: %d, instr.rs2: %d, instr.func3: %d, instr.func7: %d, instr.imm: 0x%X\n", instr.opcode, instr.rd, instr.rs1, instr.rs2, instr.func3, instr.func7, instr.imm);
+        static_cast<DecodedInstr &>(instr) = decode_instruction(IR);
+        printf("[DECODE] %s: RD: %d, RS1: %d, RS2: %d, imm: 0x%X\n", instr.desc->name, instr.rd, instr.rs1, instr.rs2, instr.imm);
         cout << endl;
     }
 
-
+    // The handler gives the result, the memory address, the jump target or the
+    // branch outcome. PC already points past the instruction.
     void execute(Instruction &instr) {
-        switch (instr.opcode) {
-            case 0x33: // R-Type
-                if (instr.func3 == 0x0 && instr.func7 == 0x00) {
-                    REG[instr.rd] = REG[instr.rs1] + REG[instr.rs2]; // ADD
-                    printf("[EXECUTE] REG[%d] = REG[%d] + REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x7 && instr.func7 == 0x00) {
-                    REG[instr.rd] = REG[instr.rs1] & REG[instr.rs2]; // AND
-                    printf("[EXECUTE] REG[%d] = REG[%d] & REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x6 && instr.func7 == 0x00) {
-                    REG[instr.rd] = REG[instr.rs1] | REG[instr.rs2]; // OR
-                    printf("[EXECUTE] REG[%d] = REG[%d] | REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x1 && instr.func7 == 0x00) {
-                    REG[instr.rd] = REG[instr.rs1] << REG[instr.rs2]; // SLL
-                    printf("[EXECUTE] REG[%d] = REG[%d] << REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x2 && instr.func7 == 0x00) {
-                    REG[instr.rd] = (int32_t)REG[instr.rs1] < (int32_t)REG[instr.rs2] ? 1 : 0; // SLT
-                    printf("[EXECUTE] REG[%d] = (REG[%d] < REG[%d]) ? 1 : 0 -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x5 && instr.func7 == 0x20) {
-                    REG[instr.rd] = (int32_t)REG[instr.rs1] >> REG[instr.rs2]; // SRA
-                    printf("[EXECUTE] REG[%d] = REG[%d] >> REG[%d] (Arithmetic) -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x5 && instr.func7 == 0x00) {
-                    REG[instr.rd] = REG[instr.rs1] >> REG[instr.rs2]; // SRL
-                    printf("[EXECUTE] REG[%d] = REG[%d] >> REG[%d] (Logical) -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x0 && instr.func7 == 0x20) {
-                    REG[instr.rd] = REG[instr.rs1] - REG[instr.rs2]; // SUB
-                    printf("[EXECUTE] REG[%d] = REG[%d] - REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x4 && instr.func7 == 0x00) {
-                    REG[instr.rd] = REG[instr.rs1] ^ REG[instr.rs2]; // XOR
-                    printf("[EXECUTE] REG[%d] = REG[%d] ^ REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x0 && instr.func7 == 0x01) {
-                    REG[instr.rd] = REG[instr.rs1] * REG[instr.rs2]; // MUL
-                    printf("[EXECUTE] REG[%d] = REG[%d] * REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x4 && instr.func7 == 0x01) {
-                    REG[instr.rd] = REG[instr.rs1] / REG[instr.rs2]; // DIV
-                    printf("[EXECUTE] REG[%d] = REG[%d] / REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x6 && instr.func7 == 0x01) {
-                    REG[instr.rd] = REG[instr.rs1] % REG[instr.rs2]; // REM
-                    printf("[EXECUTE] REG[%d] = REG[%d] %% REG[%d] -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.rs2, instr.rd, REG[instr.rd]);
-                }
-                break;
-                case 0x13: // I-Type: ADDI, ANDI, ORI (instr.opcode: 0010011)
-                if (instr.func3 == 0x0) {
-                    REG[instr.rd] = REG[instr.rs1] + instr.imm; // ADDI
-                    printf("[EXECUTE] REG[%d] = REG[%d] + 0x%X -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.imm, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x7) {
-                    REG[instr.rd] = REG[instr.rs1] & instr.imm; // ANDI
-                    printf("[EXECUTE] REG[%d] = REG[%d] & 0x%X -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.imm, instr.rd, REG[instr.rd]);
-                } else if (instr.func3 == 0x6) {
-                    REG[instr.rd] = REG[instr.rs1] | instr.imm; // ORI
-                    printf("[EXECUTE] REG[%d] = REG[%d] | 0x%X -> Updated REG[%d] = 0x%08X\n", instr.rd, instr.rs1, instr.imm, instr.rd, REG[instr.rd]);
-                }
-                break;
-            
-            case 0x03: // I-Type: LB, LD, LH, LW (instr.opcode: 0000011)
-                instr.effective_addr = REG[instr.rs1] + instr.imm;
-                if (instr.func3 == 0x0) {
-                    printf("[EXECUTE] LB Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                } else if (instr.func3 == 0x3) {
-                    printf("[EXECUTE] LD Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                } else if (instr.func3 == 0x1) {
-                    printf("[EXECUTE] LH Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                } else if (instr.func3 == 0x2) {
-                    printf("[EXECUTE] LW Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                }
-                break;
-            
-            case 0x67: // I-Type: JALR (instr.opcode: 1100111)
-                instr.effective_addr = (REG[instr.rs1] + instr.imm) & ~1; // Ensure LSB is cleared
-                printf("[EXECUTE] JALR Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                break;
-            
-            case 0x23: // S-Type
-                if (instr.func3 == 0x0) {
-                    instr.effective_addr = REG[instr.rs1] + instr.imm; // SB
-                    printf("[EXECUTE] Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                } else if (instr.func3 == 0x2) {
-                    instr.effective_addr = REG[instr.rs1] + instr.imm; // SW
-                    printf("[EXECUTE] Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                } else if (instr.func3 == 0x3) {
-                    instr.effective_addr = REG[instr.rs1] + instr.imm; // SD
-                    printf("[EXECUTE] Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                } else if (instr.func3 == 0x1) {
-                    instr.effective_addr = REG[instr.rs1] + instr.imm; // SH
-                    printf("[EXECUTE] Effective Address = 0x%08X (instr.rs1: 0x%08X + instr.imm: 0x%08X)\n", instr.effective_addr, REG[instr.rs1], instr.imm);
-                }
-                break;
-            case 0x63: // SB-Type
-                {
-                    int32_t offset = instr.imm << 1;
-                    if (instr.func3 == 0x0 && REG[instr.rs1] == REG[instr.rs2]) { // BEQ
-                        PC += offset - 4;
-                        printf("[EXECUTE] BEQ: PC = 0x%08X\n", PC);
-                    } else if (instr.func3 == 0x1 && REG[instr.rs1] != REG[instr.rs2]) { // BNE
-                        cout<<"i am here"<<endl;
-                        cout<<REG[instr.rs1]<<" "<<REG[instr.rs2]<<endl;
-                        PC += offset - 4;
-                        printf("[EXECUTE] BNE: PC = 0x%08X\n", PC);
-                    } else if (instr.func3 == 0x5 && (int32_t)REG[instr.rs1] >= (int32_t)REG[instr.rs2]) { // BGE
-                        PC += offset - 4;
-                        printf("[EXECUTE] BGE: PC = 0x%08X\n", PC);
-                    } else if (instr.func3 == 0x4 && (int32_t)REG[instr.rs1] < (int32_t)REG[instr.rs2]) { // BLT
-                        PC += offset - 4;
-                        printf("[EXECUTE] BLT: PC = 0x%08X\n", PC);
-                    }
-                }
-                break;
-            case 0x17: // U-Type (AUIPC)
-                REG[instr.rd] = PC + instr.imm;
-                printf("[EXECUTE] AUIPC: REG[%d] = 0x%08X\n", instr.rd, REG[instr.rd]);
-                break;
-            case 0x37: // U-Type (LUI)
-                REG[instr.rd] = instr.imm;  // Immediate is already properly shifted
-                printf("[EXECUTE] LUI: REG[%d] = 0x%08X\n", instr.rd, REG[instr.rd]);
-                break;
-            case 0x6F: // UJ-Type (JAL)
-                REG[instr.rd] = PC;
-                PC += instr.imm - 4;
-                printf("[EXECUTE] JAL: REG[%d] = 0x%08X, PC = 0x%08X\n", instr.rd, REG[instr.rd], PC);
-                break;
+        const InstrDesc &desc = *instr.desc;
+        uint32_t pc = PC - instr.length;
+        if (desc.flags & INSTR_VECTOR) {
+            // the vector unit does its own loads and stores
+            instr.result = vector_execute(vector_unit, instr, REG[instr.rs1], REG[instr.rs2],
+                                          [](uint32_t addr, int size) { return load_guest(addr, size); },
+                                          [pc](uint32_t addr, int size, uint32_t value) { store_guest(addr, size, value, pc); });
+            printf("[EXECUTE] %s: vl = %u, result = 0x%08X\n", desc.name, vector_unit.vl, instr.result);
+            cout << endl;
+            return;
+        }
+        uint32_t result = (desc.flags & INSTR_FP) ? fp_execute(instr, REG[instr.rs1], REG[instr.rs2], REG[instr.rs3], fcsr) :
+                          (desc.flags & INSTR_CSR) ? csr_execute(instr, REG[instr.rs1], csr_read, csr_write)
+                                                   : desc.exec(operand_a(instr, REG[instr.rs1], pc), operand_b(instr, REG[instr.rs2]));
+        if (desc.flags & INSTR_BRANCH) {
+            if (result) PC = pc + instr.imm;
+            printf("[EXECUTE] %s: %s, PC = 0x%08X\n", desc.name, result ? "taken" : "not taken", PC);
+        } else if (desc.flags & (INSTR_LOAD | INSTR_STORE | INSTR_JUMP)) {
+            instr.effective_addr = result;
+            instr.result = PC;      // return address of jal/jalr
+            printf("[EXECUTE] %s Effective Address = 0x%08X\n", desc.name, result);
+        } else {
+            instr.result = result;
+            printf("[EXECUTE] %s: result = 0x%08X\n", desc.name, result);
         }
         cout << endl;
     }
 
     void memory_access(Instruction &instr) {
-        if (instr.opcode == 0x03) { // Load instructions (I-Type: LB, LH, LW, LD)
-            switch (instr.func3) {
-                case 0x0: // LB (Load Byte)
-                    instr.effective_addr = REG[instr.rs1] + instr.imm;
-                    REG[instr.rd] = (int8_t)data_segment[instr.effective_addr]; // Sign-extend to 32 bits
-                    printf("[MEMORY] Loaded REG[%d] = 0x%08X (LB) from Address 0x%08X\n", instr.rd, REG[instr.rs2], instr.effective_addr);
-                    break;
-                case 0x1: // LH (Load Halfword)
-                    instr.effective_addr = REG[instr.rs1] + instr.imm;
-                    REG[instr.rd] = (int16_t)data_segment[instr.effective_addr]; // Sign-extend to 32 bits
-                    printf("[MEMORY] Loaded REG[%d] = 0x%08X (LH) from Address 0x%08X\n", instr.rd, REG[instr.rs2], instr.effective_addr);
-                    break;
-                case 0x2: // LW (Load Word)
-                    instr.effective_addr = REG[instr.rs1] + instr.imm;
-                    REG[instr.rd] = data_segment[instr.effective_addr]; // Directly load 32 bits
-                    printf("[MEMORY] Loaded REG[%d] = 0x%08X (LW) from Address 0x%08X\n", instr.rd, REG[instr.rs2], instr.effective_addr);
-                    break;
-                case 0x3: // LD (Load Doubleword) - Not supported in 32-bit, but included for completeness
-                    instr.effective_addr = REG[instr.rs1] + instr.imm;
-                    REG[instr.rd] = data_segment[instr.effective_addr]; // Directly load 32 bits (truncate for 32-bit)
-                    printf("[MEMORY] Loaded REG[%d] = 0x%08X (LD) from Address 0x%08X\n", instr.rd, REG[instr.rs2], instr.effective_addr);
-                    break;
-                default:
-                    printf("[MEMORY] Unknown load instruction (instr.func3) { = 0x%X)\n", instr.func3);
-                    break;
-            }
-        } else if (instr.opcode == 0x23) { // Store instructions (S-Type: SB, SH, SW, SD)
-            switch (instr.func3) {
-                case 0x0: // SB (Store Byte)
-                    data_segment[instr.effective_addr] = (uint8_t)REG[instr.rs2]; // Store lower 8 bits
-                    printf("[MEMORY] Stored REG[%d] = 0x%02X (SB) to Address 0x%08X\n", instr.rs2, (uint8_t)REG[instr.rs2], instr.effective_addr);
-                    break;
-                case 0x1: // SH (Store Halfword)
-                    data_segment[instr.effective_addr] = (uint16_t)REG[instr.rs2]; // Store lower 16 bits
-                    printf("[MEMORY] Stored REG[%d] = 0x%04X (SH) to Address 0x%08X\n", instr.rs2, (uint16_t)REG[instr.rs2], instr.effective_addr);
-                    break;
-                case 0x2: // SW (Store Word)
-                    data_segment[instr.effective_addr] = REG[instr.rs2]; // Store full 32 bits
-                    printf("[MEMORY] Stored REG[%d] = 0x%08X (SW) to Address 0x%08X\n", instr.rs2, REG[instr.rs2], instr.effective_addr);
-                    break;
-                case 0x3: // SD (Store Doubleword) - Not supported in 32-bit, but included for completeness
-                    data_segment[instr.effective_addr] = REG[instr.rs2]; // Store full 32 bits (truncate for 32-bit)
-                    printf("[MEMORY] Stored REG[%d] = 0x%08X (SD) to Address 0x%08X\n", instr.rs2, REG[instr.rs2], instr.effective_addr);
-                    break;
-                default:
-                    printf("[MEMORY] Unknown store instruction (instr.func3) { = 0x%X)\n", instr.func3);
-                    break;
-            }
+        const InstrDesc &desc = *instr.desc;
+        if (desc.flags & INSTR_VECTOR) return;     // accessed in execute
+        if (desc.flags & INSTR_LOAD) {
+            instr.result = extend_load(desc, load_guest(instr.effective_addr, desc.mem_size));
+            printf("[MEMORY] %s: Loaded 0x%08X from Address 0x%08X\n", desc.name, instr.result, instr.effective_addr);
+        } else {
+            store_guest(instr.effective_addr, desc.mem_size, REG[instr.rs2], PC - instr.length);
+            printf("[MEMORY] %s: Stored REG[%d] = 0x%08X to Address 0x%08X\n", desc.name, instr.rs2, REG[instr.rs2], instr.effective_addr);
         }
         cout << endl;
     }
-    
+
     void writeback(Instruction &instr) {
-        if (instr.opcode == 0x67) { // JALR
-            REG[0] = 0;
-            REG[instr.rd] = PC; // Save return address (PC + 4)
-            REG[0] = 0;
-            PC = instr.effective_addr & ~1; // Jump to effective address (clear LSB for alignment)
-            printf("[WRITEBACK] REG[%d] = 0x%08X (JALR), Updated PC = 0x%08X\n", instr.rd, REG[instr.rd], PC);
-        } else if (instr.opcode != 0x23) { // Skip writeback for SW only
-            printf("[WRITEBACK] REG[%d] = 0x%08X\n", instr.rd, REG[instr.rd]);
+        if (instr.desc->flags & INSTR_JUMP) {
+            PC = instr.effective_addr;
+        }
+        if (instr.rd != 0) {
+            REG[instr.rd] = instr.result;
         }
+        printf("[WRITEBACK] REG[%d] = 0x%08X, PC = 0x%08X\n", instr.rd, REG[instr.rd], PC);
         cout << endl;
     }
     // void save_final_state() {
@@ -553,6 +1186,9 @@ uint32_t get_forwarded_value(uint32_t reg) {
 // Pipeline stage functions
 void pipeline_fetch() {
     if (pipeline_stall || if_id.valid || stop_fetch) {
+        if (stop_fetch && !if_id.valid) if_id.bubble_cause = CPI_DRAIN;
+        // the instruction at PC waits in IF while fetch is held
+        if (knob_profile && !stop_fetch && instr_map.count(PC)) pc_profile[PC].stage_cycles[STAGE_IF]++;
         logs << "returned from fetch because pipeline_stall or if_id is valid or stop_fetch is true" << endl;
         return;
     }
@@ -560,14 +1196,28 @@ void pipeline_fetch() {
     auto it = instr_map.find(PC);
     if (it == instr_map.end()) {
         stop_fetch = true;
+        if_id.bubble_cause = CPI_DRAIN;
+        return;
+    }
+    uint32_t length = instruction_size(it->second);
+    if (!fetch_block_ready(PC, length)) {
+        // the rest of the instruction is in the next block, read in the next cycle
+        fetch_split = true;
+        if_id.pc = PC;
+        if_id.bubble_cause = CPI_MEMORY;
+        if_id.bubble_pc = PC;
+        if (knob_profile) pc_profile[PC].stage_cycles[STAGE_IF]++;
         return;
     }
-    uint32_t inst = it->second;
+    fetch_split = false;
+    uint32_t inst = expand_instruction(it->second);
     if_id.ir = inst;
     if_id.pc = PC;
+    if_id.length = length;
     if_id.inst_num = inst_num_map[PC];
     if_id.valid = true;
-    uint32_t opcode = inst & 0x7F;
+    if (knob_profile) pc_profile[PC].stage_cycles[STAGE_IF]++;
+    const InstrDesc &desc = instruction_decoder.lookup(inst);
     if (if_id.pc == pc_to_print_at && flag_to_print_particular){
         cout << endl;
         cout << "FETCH-DECODE BUFFER" << endl;
@@ -583,16 +1233,8 @@ void pipeline_fetch() {
     logs << "instruction number is: " << dec << if_id.inst_num << endl;
     logs << "valid is: " << if_id.valid << endl;
 
-    if (opcode == 0x63 && enableBranchPrediction) {  // Branch instruction
-        // Extract the immediate value for the branch
-        int32_t imm = 0;
-        imm |= ((inst >> 31) & 0x1) << 12;    // imm[12]
-        imm |= ((inst >> 25) & 0x3F) << 5;    // imm[10:5]
-        imm |= ((inst >> 8) & 0xF) << 1;      // imm[4:1]
-        imm |= ((inst >> 7) & 0x1) << 11;     // imm[11]
-        if (imm & (1 << 12)) imm |= 0xFFFFE000;  // Sign-extend
-
-        uint32_t target = PC + imm;  // Calculate branch target address
+    if ((desc.flags & INSTR_BRANCH) && enableBranchPrediction) {  // Branch instruction
+        uint32_t target = PC + decode_immediate(inst, SB_TYPE);  // Calculate branch target address
 
         // If the branch instruction has not been predicted before, set the default prediction
         if (branchPred.find(PC) == branchPred.end()) {
@@ -609,23 +1251,17 @@ void pipeline_fetch() {
         if (prediction == 'T') {  // Taken prediction
             PC = branchPred[PC].target;
         } else {  // Not Taken prediction
-            PC += 4;  // Move to the next sequential instruction
+            PC += length;  // Move to the next sequential instruction
         }
 
     } 
-    else if (opcode == 0x6F) { // jal
-        int imm20 = ((inst >> 31) & 1) << 20;
-        int imm10_1 = ((inst >> 21) & 0x3FF) << 1;
-        int imm11 = ((inst >> 20) & 1) << 11;
-        int imm19_12 = ((inst >> 12) & 0xFF) << 12;
-        int imm = imm20 | imm19_12 | imm11 | imm10_1;
-        if (imm & (1 << 20)) imm |= 0xFFE00000; // Sign-extend
-        PC += imm;
+    else if (desc.type == UJ_TYPE) { // jal
+        PC += decode_immediate(inst, UJ_TYPE);
         stat_stall_control++;
         stat_stalls++;
     }
     else {
-        PC += 4;
+        PC += length;
     }
 
     logs << "updated pc after fetch is: " << dec << PC << endl;
@@ -635,73 +1271,37 @@ void pipeline_fetch() {
 
 
 void pipeline_decode() {
+    if (ex_cycles) {
+        // EX is still busy with a mul/div: keep it in ID/EX and the next instruction in IF/ID
+        logs<<"returned from decode because execute is busy"<<endl;
+        return;
+    }
     if (!if_id.valid) {
         id_ex.valid = false;
+        id_ex.bubble_cause = if_id.bubble_cause;
+        id_ex.bubble_pc = if_id.bubble_pc;
         logs<<"returned from decode because if_id is not valid"<<endl;
         return;
     }
     logs<<"DECODE"<<endl;
     uint32_t ir = if_id.ir;
     uint32_t pc = if_id.pc;
-    uint32_t opcode = ir & 0x7F;
-    uint32_t rd = (ir >> 7) & 0x1F;
-    uint32_t func3 = (ir >> 12) & 0x07;
-    uint32_t rs1 = (ir >> 15) & 0x1F;
-    uint32_t rs2 = (ir >> 20) & 0x1F;
-    uint32_t func7 = (ir >> 25) & 0x7F;
-    int imm = 0;
-    switch (opcode) {
-        case 0x33: imm = 0; break;
-        case 0x03: case 0x13: case 0x67: {
-            imm = (int32_t)(ir >> 20);
-            imm |= ((imm & (1 << 11)) ? 0xFFFFF000 : 0);
-            if (opcode != 0x03) rs2 = 0;
-            break;
-        }
-        case 0x23: {
-            int imm4_0 = (ir >> 7) & 0x1F;
-            int imm11_5 = (ir >> 25) & 0x7F;
-            imm = (imm11_5 << 5) | imm4_0;
-            if (imm & (1 << 11)) imm |= 0xFFFFF000;
-            rd = 0;
-            break;
-        }
-        case 0x63: {
-            int imm11 = ((ir >> 7) & 0x1) << 11;
-            int imm4_1 = ((ir >> 8) & 0xF) << 1;
-            int imm10_5 = ((ir >> 25) & 0x3F) << 5;
-            int imm12 = ((ir >> 31) & 0x1) << 12;
-            imm = imm12 | imm11 | imm10_5 | imm4_1;
-            if (imm & (1 << 12)) imm |= 0xFFFFE000;
-            imm >>= 1;
-            rd = 0;
-            break;
-        }
-        case 0x37: case 0x17: {
-            imm = ir & 0xFFFFF000;
-            if (ir & 0x80000000) imm |= 0xFFF00000;
-            rs1 = rs2 = 0;
-            break;
-        }
-        case 0x6F: {
-            int imm20 = ((ir >> 31) & 1) << 20;
-            int imm10_1 = ((ir >> 21) & 0x3FF) << 1;
-            int imm11 = ((ir >> 20) & 1) << 11;
-            int imm19_12 = ((ir >> 12) & 0xFF) << 12;
-            imm = imm20 | imm19_12 | imm11 | imm10_1;
-            if (imm & (1 << 20)) imm |= 0xFFE00000;
-            break;
-        }
-        case 0x73:
-            imm = 0;
-            break;
-        default:
-            imm = 0;
-            break;
-    }
+    if (knob_profile) pc_profile[pc].stage_cycles[STAGE_ID]++;
+    // rs1/rs2 are 0 unless the instruction reads them, so x0 never looks like a dependency
+    DecodedInstr instr = decode_instruction(ir);
+    const InstrDesc &desc = *instr.desc;
+    uint32_t opcode = desc.opcode;
+    uint32_t rd = instr.rd;
+    uint32_t func3 = desc.func3;
+    uint32_t rs1 = instr.rs1;
+    uint32_t rs2 = instr.rs2;
+    uint32_t rs3 = instr.rs3;    // an f-register, like rd/rs1/rs2 of the RV32F instructions
+    uint32_t func7 = desc.func7;
+    int imm = instr.imm;
     bool hazard = false;
     bool stall = false;
-    if ((opcode == 0x33 || opcode == 0x63 || opcode == 0x23 || opcode == 0x13 || opcode == 0x03 || opcode == 0x67) && rs1 != 0) {
+    bool load_use = false;
+    if (rs1 != 0) {
         if ((ex_mem.valid && ex_mem.write_enable && ex_mem.rd == rs1) ||
             (mem_wb.valid && mem_wb.reg_write && mem_wb.rd == rs1)) {
             logs<<"hazard detected"<<endl;
@@ -712,7 +1312,7 @@ void pipeline_decode() {
             }
         }
     }
-    if ((opcode == 0x33 || opcode == 0x63 || opcode == 0x23) && rs2 != 0) {
+    if (rs2 != 0) {
         if ((ex_mem.valid && ex_mem.write_enable && ex_mem.rd == rs2) ||
             (mem_wb.valid && mem_wb.reg_write && mem_wb.rd == rs2)) {
             hazard = true;
@@ -722,30 +1322,65 @@ void pipeline_decode() {
             }
         }
     }
+    if (rs3 != 0) {
+        if ((ex_mem.valid && ex_mem.write_enable && ex_mem.rd == rs3) ||
+            (mem_wb.valid && mem_wb.reg_write && mem_wb.rd == rs3)) {
+            hazard = true;
+            if (!knob_forwarding){
+                logs<<"stalling because knob_forwarding is false"<<endl;
+                stall = true;
+            }
+        }
+    }
     if (ex_mem.valid && ex_mem.mem_read) {
         if (rs1 != 0 && ex_mem.rd == rs1) {
             hazard = true;
             stall = true;
+            load_use = true;
         }
         if (rs2 != 0 && ex_mem.rd == rs2) {
             hazard = true;
             stall = true;
+            load_use = true;
+        }
+        if (rs3 != 0 && ex_mem.rd == rs3) {
+            hazard = true;
+            stall = true;
+            load_use = true;
         }
     }
     if (hazard) {
         int count = 0;
-        if ((opcode == 0x33 || opcode == 0x63 || opcode == 0x23 || opcode == 0x13 || opcode == 0x03 || opcode == 0x67) && rs1 != 0) {
+        if (rs1 != 0) {
             if ((ex_mem.valid && ex_mem.write_enable && ex_mem.rd == rs1) ||
                 (mem_wb.valid && mem_wb.reg_write && mem_wb.rd == rs1)) count++;
         }
-        if ((opcode == 0x33 || opcode == 0x63 || opcode == 0x23) && rs2 != 0) {
+        if (rs2 != 0) {
             if ((ex_mem.valid && ex_mem.write_enable && ex_mem.rd == rs2) ||
                 (mem_wb.valid && mem_wb.reg_write && mem_wb.rd == rs2)) count++;
         }
+        if (rs3 != 0) {
+            if ((ex_mem.valid && ex_mem.write_enable && ex_mem.rd == rs3) ||
+                (mem_wb.valid && mem_wb.reg_write && mem_wb.rd == rs3)) count++;
+        }
         stat_data_hazards += count;
     }
     if (stall) {
         id_ex.valid = false;
+        // with forwarding only a load can hold decode, so charge it to load-use
+        id_ex.bubble_cause = (load_use && knob_forwarding) ? CPI_LOAD_USE : CPI_DATA;
+        id_ex.bubble_pc = pc;
+        if (knob_profile) {
+            // the nearest older writer of a source register is the one holding decode;
+            // if neither one writes a source register, no producer is charged
+            bool ex_mem_writes = ex_mem.valid && (ex_mem.write_enable || ex_mem.mem_read) && ex_mem.rd != 0 &&
+                                 (ex_mem.rd == rs1 || ex_mem.rd == rs2 || ex_mem.rd == rs3);
+            bool mem_wb_writes = mem_wb.valid && mem_wb.reg_write && mem_wb.rd != 0 &&
+                                 (mem_wb.rd == rs1 || mem_wb.rd == rs2 || mem_wb.rd == rs3);
+            if (ex_mem_writes) pc_profile[ex_mem.pc].stalls_caused++;
+            else if (mem_wb_writes) pc_profile[mem_wb.pc].stalls_caused++;
+            pc_profile[pc].stalls_suffered++;
+        }
         pipeline_stall = true;
         stat_stalls++;
         stat_stall_data++;
@@ -754,24 +1389,24 @@ void pipeline_decode() {
     pipeline_stall = false;
     id_ex.valid = true;
     id_ex.pc = pc;
+    id_ex.length = if_id.length;
+    id_ex.desc = &desc;
     id_ex.opcode = opcode;
     id_ex.func3 = func3;
     id_ex.func7 = func7;
     id_ex.rd = rd;
     id_ex.rs1 = rs1;
     id_ex.rs2 = rs2;
+    id_ex.rs3 = rs3;
+    id_ex.rm = instr.rm;
     id_ex.imm = imm;
     id_ex.inst_num = if_id.inst_num;
-    id_ex.isBranch = (opcode == 0x63);
-    id_ex.isJump   = (opcode == 0x6F || opcode == 0x67);
-    id_ex.memRead  = (opcode == 0x03);
-    id_ex.memWrite = (opcode == 0x23);
-    id_ex.regWrite = false;
-    if ((opcode == 0x33 || opcode == 0x13 || opcode == 0x37 || opcode == 0x17 ||
-         opcode == 0x6F || opcode == 0x67 || opcode == 0x03) && rd != 0) {
-        id_ex.regWrite = true;
-    }
-    if (opcode == 0x73) {
+    id_ex.isBranch = (desc.flags & INSTR_BRANCH) != 0;
+    id_ex.isJump   = (desc.flags & INSTR_JUMP) != 0;
+    id_ex.memRead  = (desc.flags & INSTR_LOAD) != 0;
+    id_ex.memWrite = (desc.flags & INSTR_STORE) != 0;
+    id_ex.regWrite = rd != 0;
+    if (desc.flags & INSTR_ECALL) {
         stop_fetch = true;
     }
     if_id.valid = false;
@@ -819,192 +1454,157 @@ void pipeline_decode() {
 void pipeline_execute() {
     if (!id_ex.valid) {
         ex_mem.valid = false;
+        ex_mem.bubble_cause = id_ex.bubble_cause;
+        ex_mem.bubble_pc = id_ex.bubble_pc;
         logs<<"returned from execute because id_ex is not valid"<<endl;
         return;
     }
     logs<<"EXECUTE"<<endl;
     logs<<"PC while entering the execute is " << dec << id_ex.pc <<endl; 
+    if (knob_profile) pc_profile[id_ex.pc].stage_cycles[STAGE_EX]++;
+    if (++ex_cycles < ex_latency(*id_ex.desc)) {
+        // the multiplier/divider is not done: nothing leaves EX this cycle
+        ex_mem.valid = false;
+        ex_mem.bubble_cause = CPI_STRUCTURAL;
+        ex_mem.bubble_pc = id_ex.pc;
+        return;
+    }
+    ex_cycles = 0;
     ex_mem.valid = true;
     ex_mem.write_enable = false;
     ex_mem.mem_read = false;
     ex_mem.mem_write = false;
     ex_mem.branch_taken = false;
+    ex_mem.is_branch = false;
     ex_mem.jump_taken = false;
     ex_mem.is_ecall = false;
     ex_mem.rd = 0;
     ex_mem.mem_reg = 0;
     ex_mem.size = 0;
+    ex_mem.mem_unsigned = false;
     ex_mem.pc = id_ex.pc;
     ex_mem.inst_num = id_ex.inst_num;
-    ex_mem.next_pc = id_ex.pc + 4;
+    ex_mem.next_pc = id_ex.pc + id_ex.length;
     uint32_t op = id_ex.opcode;
     uint32_t rs1 = id_ex.rs1, rs2 = id_ex.rs2, rd = id_ex.rd;
     uint32_t func3 = id_ex.func3, func7 = id_ex.func7;
     int imm = id_ex.imm;
-    uint32_t val1 = 0, val2 = 0;
-
-    if (op == 0x33 || op == 0x13 || op == 0x03 || op == 0x67 || op == 0x63 || op == 0x23) { //R-type, I-type, S-type, B-type
-        val1 = get_forwarded_value(rs1);
-    }
-    if (op == 0x33 || op == 0x63 || op == 0x23) { //R-type, B-type, S-type
-        val2 = get_forwarded_value(rs2);
+    const InstrDesc &desc = *id_ex.desc;
+    uint32_t val1 = (desc.flags & READS_RS1) ? get_forwarded_value(rs1) : 0;
+    uint32_t val2 = (desc.flags & READS_RS2) ? get_forwarded_value(rs2) : 0;
+    DecodedInstr instr = {&desc, rd, rs1, rs2, imm, id_ex.rs3, id_ex.rm};
+    uint32_t result;
+    if (desc.flags & INSTR_VECTOR) {
+        uint32_t pc = id_ex.pc;
+        result = vector_execute(vector_unit, instr, val1, val2, [](uint32_t addr, int size) { return load_guest(addr, size); },
+                                [pc](uint32_t addr, int size, uint32_t value) { store_guest(addr, size, value, pc); });
+    } else if (desc.flags & INSTR_CSR) {
+        // CSRs are read and written in EX, in program order, as fcsr is by FP instructions
+        result = csr_execute(instr, val1, csr_read, csr_write);
+    } else {
+        result = (desc.flags & INSTR_FP) ? fp_execute(instr, val1, val2, get_forwarded_value(id_ex.rs3), fcsr)
+                                         : desc.exec(operand_a(instr, val1, id_ex.pc), operand_b(instr, val2));
     }
-    switch (op) {
-        case 0x33:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            switch (func3) {
-                case 0x0:
-                    ex_mem.alu_result = (func7 == 0x20) ? (int32_t)val1 - (int32_t)val2 : (int32_t)val1 + (int32_t)val2;
-                    break;
-                case 0x7: ex_mem.alu_result = val1 & val2; break;
-                case 0x6: ex_mem.alu_result = val1 | val2; break;
-                case 0x4: ex_mem.alu_result = val1 ^ val2; break;
-                case 0x1: ex_mem.alu_result = val1 << (val2 & 0x1F); break;
-                case 0x5:
-                    ex_mem.alu_result = (func7 == 0x20) ? ((int32_t)val1 >> (val2 & 0x1F)) : (val1 >> (val2 & 0x1F));
-                    break;
-                case 0x2: ex_mem.alu_result = ((int32_t)val1 < (int32_t)val2) ? 1 : 0; break;
-                case 0x3: ex_mem.alu_result = (val1 < val2) ? 1 : 0; break;
-            }
-            if (func7 == 0x01) {
-                if (func3 == 0x0) ex_mem.alu_result = (int32_t)val1 * (int32_t)val2;
-                if (func3 == 0x4) ex_mem.alu_result = ((int32_t)val2 != 0 ? (int32_t)val1 / (int32_t)val2 : 0);
-                if (func3 == 0x6) ex_mem.alu_result = ((int32_t)val2 != 0 ? (int32_t)val1 % (int32_t)val2 : 0);
-            }
-            break;
-        case 0x13:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            switch (func3) {
-                case 0x0: ex_mem.alu_result = (int32_t)val1 + imm; break;
-                case 0x7: ex_mem.alu_result = val1 & imm; break;
-                case 0x6: ex_mem.alu_result = val1 | imm; break;
-                case 0x4: ex_mem.alu_result = val1 ^ imm; break;
-                case 0x2: ex_mem.alu_result = ((int32_t)val1 < imm) ? 1 : 0; break;
-                case 0x3: ex_mem.alu_result = ((uint32_t)val1 < (uint32_t)imm) ? 1 : 0; break;
-                case 0x1: ex_mem.alu_result = val1 << (imm & 0x1F); break;
-                case 0x5:
-                    ex_mem.alu_result = ((imm & 0x400) ? (int32_t)val1 >> (imm & 0x1F) : (val1 >> (imm & 0x1F)));
-                    break;
-            }
-            break;
-        case 0x03:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            ex_mem.mem_read = true;
-            ex_mem.size = (func3 == 0x0 ? 1 : func3 == 0x1 ? 2 : 4);
-            ex_mem.alu_result = val1 + imm;
-            break;
-        case 0x23:
-            ex_mem.write_enable = false;
-            ex_mem.mem_write = true;
-            ex_mem.mem_reg = rs2;
-            ex_mem.size = (func3 == 0x0 ? 1 : func3 == 0x1 ? 2 : 4);
-            ex_mem.alu_result = val1 + imm;
-            break;
-        case 0x37:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            ex_mem.alu_result = imm;
-            break;
-        case 0x17:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            ex_mem.alu_result = id_ex.pc + imm;
-            break;
-        case 0x6F:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            ex_mem.jump_taken = true;
-            ex_mem.alu_result = id_ex.pc + 4;
-            ex_mem.next_pc = id_ex.pc + imm;
-            stat_ctrl_hazards++;
-            break;
-        case 0x67:
-            ex_mem.rd = rd;
-            ex_mem.write_enable = true;
-            ex_mem.jump_taken = true;
-            ex_mem.alu_result = id_ex.pc + 4;
-            ex_mem.next_pc = (val1 + imm) & ~1;
-            stat_ctrl_hazards++;
-            break;
-        case 0x63: {
-            bool taken = false;
-            switch (func3) {
-                case 0x0: taken = (val1 == val2); break;
-                case 0x1: taken = (val1 != val2); break;
-                case 0x4: taken = ((int32_t)val1 < (int32_t)val2); break;
-                case 0x5: taken = ((int32_t)val1 >= (int32_t)val2); break;
-                case 0x6: taken = (val1 < val2); break;
-                case 0x7: taken = (val1 >= val2); break;
-            }
 
-            ex_mem.branch_taken = taken;
-            //if this is not the same as the prediction of map, increment mispredictions
-            logs << "taken is : " << taken << endl;
-            logs << "branch prediction is " << branchPred[ex_mem.pc].prediction << endl;
-            int tempu;
-            //map taken and not taken to 1 and 0 respectively
-            if (branchPred[ex_mem.pc].prediction == 'T' ){
-                tempu = 1;
-            }
-            else{
-                tempu = 0;
-            }
-            // cout << "tempu is " << tempu << endl;
-            if (taken != tempu){
-                stat_branch_misp++;
-                // cout << "misprediction count " << stat_branch_misp << endl;
-            }
+    if (&desc == &invalid_instruction) {
+        // unknown word (e.g. the 0xFFFFFFFF end-of-text marker) never commits
+        ex_mem.valid = false;
+        ex_mem.bubble_cause = CPI_DRAIN;
+    } else if (desc.flags & INSTR_BRANCH) {
+        bool taken = result != 0;
+
+        ex_mem.branch_taken = taken;
+        ex_mem.is_branch = true;
+        //if this is not the same as the prediction of map, increment mispredictions
+        logs << "taken is : " << taken << endl;
+        logs << "branch prediction is " << branchPred[ex_mem.pc].prediction << endl;
+        int tempu;
+        //map taken and not taken to 1 and 0 respectively
+        if (branchPred[ex_mem.pc].prediction == 'T' ){
+            tempu = 1;
+        }
+        else{
+            tempu = 0;
+        }
+        // cout << "tempu is " << tempu << endl;
+        if (knob_branch_profile) {
+            BranchProfile &branch = branch_profile[id_ex.pc];
+            (taken ? branch.taken : branch.not_taken)++;
+        }
+        if (taken != tempu){
+            stat_branch_misp++;
+            if (knob_profile) pc_profile[id_ex.pc].mispredictions++;
+            // cout << "misprediction count " << stat_branch_misp << endl;
+        }
 
-            if (taken) {
-                ex_mem.next_pc = id_ex.pc + (id_ex.imm << 1);  // imm is already sign-extended
-                // cout << "i am here and this branch is taken" << endl;
-                // cout << "next pc is: " << hex << ex_mem.next_pc << endl;
-            } else {
-                ex_mem.next_pc = id_ex.pc + 4;
-            }
+        if (taken) {
+            ex_mem.next_pc = id_ex.pc + imm;
+            // cout << "i am here and this branch is taken" << endl;
+            // cout << "next pc is: " << hex << ex_mem.next_pc << endl;
+        } else {
+            ex_mem.next_pc = id_ex.pc + id_ex.length;
+        }
 
-            if (enableBranchPrediction) {
-                if (branchPred.find(id_ex.pc) != branchPred.end()) {
-                    char pred = branchPred[id_ex.pc].prediction;
-                    bool wasPredictedTaken = (pred == 'T');
+        if (enableBranchPrediction) {
+            if (branchPred.find(id_ex.pc) != branchPred.end()) {
+                char pred = branchPred[id_ex.pc].prediction;
+                bool wasPredictedTaken = (pred == 'T');
 
-                    // ✅ NOTE: Misprediction count happens in main(), so don't do it here again!
+                // ✅ NOTE: Misprediction count happens in main(), so don't do it here again!
 
-                    // Update prediction to reflect actual outcome
-                    branchPred[id_ex.pc].prediction = taken ? 'T' : 'N';
-                    if (taken) {
-                        branchPred[id_ex.pc].target = ex_mem.next_pc;
-                    }
+                // Update prediction to reflect actual outcome
+                branchPred[id_ex.pc].prediction = taken ? 'T' : 'N';
+                if (taken) {
+                    branchPred[id_ex.pc].target = ex_mem.next_pc;
                 }
-                // if (taken){
-                //     stat_stalls++;
-                // }
-                if (tempu != taken){
-                    stat_ctrl_hazards++;
-                    stat_stalls += 2;
-                    stat_stall_control += 2;
-
-                }
-                // if (taken == 1 && tempu == 0){
-                //     stat_stall_control += 2;
-                // }
             }
-            ex_mem.misprediction_checked = false; // ✅ reset here so main() can use it
+            // if (taken){
+            //     stat_stalls++;
+            // }
+            if (tempu != taken){
+                stat_ctrl_hazards++;
+                stat_stalls += 2;
+                stat_stall_control += 2;
 
-            break;
+            }
+            // if (taken == 1 && tempu == 0){
+            //     stat_stall_control += 2;
+            // }
         }
-
-
-        case 0x73:
-            ex_mem.is_ecall = true;
-            ex_mem.write_enable = false;
-            break;
-        default:
-            ex_mem.valid = false;
-            break;
+        ex_mem.misprediction_checked = false; // ✅ reset here so main() can use it
+    } else if (desc.flags & INSTR_JUMP) {
+        ex_mem.rd = rd;
+        ex_mem.write_enable = true;
+        ex_mem.jump_taken = true;
+        ex_mem.alu_result = id_ex.pc + id_ex.length;
+        ex_mem.next_pc = result;
+        stat_ctrl_hazards++;
+    } else if (desc.flags & INSTR_VECTOR) {
+        // vector loads and stores are done: the vector unit reaches memory from EX,
+        // and MEM passes on the integer result of vsetvli and vmv.x.s
+        ex_mem.rd = rd;
+        ex_mem.write_enable = (desc.flags & WRITES_RD) != 0;
+        ex_mem.alu_result = result;
+    } else if (desc.flags & INSTR_LOAD) {
+        ex_mem.rd = rd;
+        ex_mem.write_enable = true;
+        ex_mem.mem_read = true;
+        ex_mem.size = desc.mem_size;
+        ex_mem.mem_unsigned = (desc.flags & LOAD_UNSIGNED) != 0;
+        ex_mem.alu_result = result;
+    } else if (desc.flags & INSTR_STORE) {
+        ex_mem.write_enable = false;
+        ex_mem.mem_write = true;
+        ex_mem.mem_reg = rs2;
+        ex_mem.size = desc.mem_size;
+        ex_mem.alu_result = result;
+    } else if (desc.flags & INSTR_ECALL) {
+        ex_mem.is_ecall = true;
+        ex_mem.write_enable = false;
+    } else {
+        ex_mem.rd = rd;
+        ex_mem.write_enable = true;
+        ex_mem.alu_result = result;
     }
     if (ex_mem.pc == pc_to_print_at && flag_to_print_particular){
         cout <<"EXECUTE-MEMORY BUFFER"<<endl;
@@ -1059,6 +1659,8 @@ void pipeline_memory() {
     if (!ex_mem.valid) {
         logs<<"returned from memory because ex_mem is not valid"<<endl;
         mem_wb.valid = false;
+        mem_wb.bubble_cause = ex_mem.bubble_cause;
+        mem_wb.bubble_pc = ex_mem.bubble_pc;
         return;
     }
     logs<<"MEMORY"<<endl;
@@ -1068,26 +1670,15 @@ void pipeline_memory() {
     mem_wb.is_ecall = ex_mem.is_ecall;
     mem_wb.inst_num = ex_mem.inst_num;
     mem_wb.pc = ex_mem.pc;
+    if (knob_profile) pc_profile[ex_mem.pc].stage_cycles[STAGE_MEM]++;
     uint32_t addr = ex_mem.alu_result;
     if (ex_mem.mem_read) {
-        uint32_t val = 0;
-        for (int i = 0; i < ex_mem.size; ++i) {
-            uint32_t a = addr + i;
-            if (data_segment.find(a) == data_segment.end()) {
-                data_segment[a] = 0;
-            }
-            val |= (data_segment[a] << (8 * i));
-        }
-        if (ex_mem.size == 1) val = (int8_t)(val & 0xFF);
-        if (ex_mem.size == 2) val = (int16_t)(val & 0xFFFF);
+        uint32_t val = load_guest(addr, ex_mem.size);
+        if (ex_mem.size == 1) val = ex_mem.mem_unsigned ? val & 0xFF : (int8_t)(val & 0xFF);
+        if (ex_mem.size == 2) val = ex_mem.mem_unsigned ? val & 0xFFFF : (int16_t)(val & 0xFFFF);
         mem_wb.write_value = val;
     } else if (ex_mem.mem_write) {
-        uint32_t store_val = get_forwarded_value(ex_mem.mem_reg);
-        for (int i = 0; i < ex_mem.size; ++i) {
-            uint32_t a = addr + i;
-            uint8_t byte = (store_val >> (8 * i)) & 0xFF;
-            data_segment[a] = byte;
-        }
+        store_guest(addr, ex_mem.size, get_forwarded_value(ex_mem.mem_reg), ex_mem.pc);
         mem_wb.reg_write = false;
         mem_wb.write_value = 0;
     } else {
@@ -1123,10 +1714,25 @@ void pipeline_memory() {
 
 void pipeline_writeback() {
     if (!mem_wb.valid){
+        stat_cpi_stack[mem_wb.bubble_cause]++;
+        if (knob_profile && mem_wb.bubble_cause != CPI_DRAIN) pc_profile[mem_wb.bubble_pc].cycles++;
+        if (knob_callgraph) callgraph_cycles(1);
         logs<<"returned from writeback because mem_wb is not valid"<<endl;
         return;
     }
     logs<<"WRITEBACK"<<endl;
+    stat_cpi_stack[CPI_BASE]++;
+    if (knob_profile) {
+        PCProfile &prof = pc_profile[mem_wb.pc];
+        prof.executions++;
+        prof.cycles++;
+        prof.stage_cycles[STAGE_WB]++;
+    }
+    if (knob_callgraph) {
+        callgraph_cycles(1);
+        callgraph_commit(mem_wb.pc, expand_instruction(instr_map[mem_wb.pc]));
+    }
+    if (knob_branch_profile) count_block(mem_wb.pc);
     if (mem_wb.reg_write && mem_wb.rd != 0) {
         REG[mem_wb.rd] = mem_wb.write_value;
     }
@@ -1134,13 +1740,22 @@ void pipeline_writeback() {
     stat_instructions++;
     uint32_t committed_pc = mem_wb.pc;
     if (instr_map.find(committed_pc) != instr_map.end()) {
-        uint32_t inst_bits = instr_map[committed_pc];
-        uint32_t op = inst_bits & 0x7F;
-        if (op == 0x03 || op == 0x23) stat_load_store++;
-        else if (op == 0x33 || op == 0x13 || op == 0x37 || op == 0x17) stat_alu++;
-        else if (op == 0x6F || op == 0x67 || op == 0x63) stat_control++; //jal jalr branch
+        uint32_t flags = instruction_decoder.lookup(expand_instruction(instr_map[committed_pc])).flags;
+        if (flags & (INSTR_LOAD | INSTR_STORE)) stat_load_store++;
+        else if (flags & (INSTR_BRANCH | INSTR_JUMP)) stat_control++; //jal jalr branch
+        else if (!(flags & INSTR_ECALL)) stat_alu++;
+        if (flags & INSTR_BITMANIP) stat_bitmanip++;
+        if (flags & INSTR_FP) stat_fp++;
+        if (flags & INSTR_VECTOR) stat_vector++;
     }
     REG[0] = 0;
+    // Decode stopped fetching behind the ecall, so it is the only instruction in
+    // flight: its system call sees every older result, and fetch resumes after it
+    if (mem_wb.is_ecall && run_syscall(mem_wb.pc)) {
+        mem_wb.is_ecall = false;
+        stop_fetch = false;
+        PC = mem_wb.pc + 4;
+    }
     mem_wb.valid = false;
     logs<<"write_value is: "<<hex<<mem_wb.write_value<<endl;
     logs<<"reg_write is: "<<mem_wb.reg_write<<endl;
@@ -1151,8 +1766,215 @@ void pipeline_writeback() {
     logs<<"----------------------------------------"<<endl;
     logs<<endl;
 }
+// Hot-spot report: static instructions sorted by the cycles charged to them.
+// Cycles are the CPI-stack cycles (commit + stall/flush bubbles caused), so the
+// column adds up to the total cycle count minus pipeline fill/drain.
+void write_profile(const string &filename) {
+    vector<pair<uint32_t, PCProfile*>> rows;
+    for (auto &entry : pc_profile) rows.push_back({entry.first, &entry.second});
+    stable_sort(rows.begin(), rows.end(), [](const pair<uint32_t, PCProfile*> &a, const pair<uint32_t, PCProfile*> &b) {
+        return a.second->cycles > b.second->cycles;
+    });
+    ofstream out(filename);
+    out << "Per-PC profile (" << dec << stat_cycles << " cycles, " << stat_instructions << " instructions)\n";
+    out << "cycles = commit cycles + stall/flush bubbles charged to the instruction\n";
+    out << "IF..WB = cycles the instruction spent in each stage, IF and ID include stall cycles\n\n";
+    out << left << setw(10) << "PC" << right << setw(6) << "inst#" << setw(10) << "execs" << setw(10) << "cycles"
+        << setw(8) << "%cyc" << setw(8) << "IF" << setw(8) << "ID" << setw(8) << "EX" << setw(8) << "MEM" << setw(8) << "WB"
+        << setw(9) << "stl_cau" << setw(9) << "stl_suf" << setw(7) << "misp" << setw(7) << "flush" << "  asm\n";
+    for (auto &row : rows) {
+        PCProfile &p = *row.second;
+        double share = stat_cycles ? 100.0 * p.cycles / stat_cycles : 0.0;
+        ostringstream pc_hex;
+        pc_hex << "0x" << hex << row.first;
+        out << left << setw(10) << pc_hex.str() << right << dec << setw(6) << inst_num_map[row.first]
+            << setw(10) << p.executions << setw(10) << p.cycles << setw(8) << fixed << setprecision(2) << share;
+        for (int s = 0; s < NUM_STAGES; ++s) out << setw(8) << p.stage_cycles[s];
+        out << setw(9) << p.stalls_caused << setw(9) << p.stalls_suffered << setw(7) << p.mispredictions
+            << setw(7) << p.flushes << "  " << asm_text_map[row.first] << "\n";
+    }
+    out.close();
+}
+
+// Folded stacks (one "caller;callee;... <cycles>" line per call path, for
+// flamegraph.pl) and a per-function inclusive/exclusive table.
+void write_callgraph(const string &folded_file, const string &table_file) {
+    struct FuncStats {
+        unsigned long long calls = 0, incl_cycles = 0, excl_cycles = 0, incl_inst = 0, excl_inst = 0;
+    };
+    map<uint32_t, FuncStats> funcs;
+    ofstream folded(folded_file);
+    for (int n = 0; n < (int)call_tree.size(); ++n) {
+        CallNode &node = call_tree[n];
+        funcs[node.entry].calls += node.calls;
+        funcs[node.entry].excl_cycles += node.cycles;
+        funcs[node.entry].excl_inst += node.instructions;
+        // a recursive function is counted once per path, not once per frame
+        vector<uint32_t> path;
+        for (int p = n; p >= 0; p = call_tree[p].parent) path.push_back(call_tree[p].entry);
+        set<uint32_t> seen;
+        for (uint32_t entry : path) {
+            if (!seen.insert(entry).second) continue;
+            funcs[entry].incl_cycles += node.cycles;
+            funcs[entry].incl_inst += node.instructions;
+        }
+        if (node.cycles == 0) continue;
+        for (int i = (int)path.size() - 1; i >= 0; --i) {
+            folded << symbol_name(path[i]) << (i ? ";" : " ");
+        }
+        folded << dec << node.cycles << "\n";
+    }
+    folded.close();
+
+    vector<pair<uint32_t, FuncStats>> rows(funcs.begin(), funcs.end());
+    stable_sort(rows.begin(), rows.end(), [](const pair<uint32_t, FuncStats> &a, const pair<uint32_t, FuncStats> &b) {
+        return a.second.incl_cycles > b.second.incl_cycles;
+    });
+    ofstream table(table_file);
+    table << "Call-graph profile (" << dec << stat_cycles << " cycles, " << stat_instructions << " instructions)\n\n";
+    table << left << setw(24) << "function" << right << setw(8) << "calls" << setw(12) << "incl_cyc" << setw(8) << "%incl"
+          << setw(12) << "excl_cyc" << setw(8) << "%excl" << setw(12) << "incl_inst" << setw(12) << "excl_inst" << "\n";
+    for (auto &row : rows) {
+        FuncStats &f = row.second;
+        table << left << setw(24) << symbol_name(row.first) << right << dec << setw(8) << f.calls
+              << setw(12) << f.incl_cycles << setw(8) << fixed << setprecision(2) << (stat_cycles ? 100.0 * f.incl_cycles / stat_cycles : 0.0)
+              << setw(12) << f.excl_cycles << setw(8) << (stat_cycles ? 100.0 * f.excl_cycles / stat_cycles : 0.0)
+              << setw(12) << f.incl_inst << setw(12) << f.excl_inst << "\n";
+    }
+    table.close();
+}
+
+// Host-side self-profile (--simperf): how fast the simulator itself runs
+using perf_clock = chrono::steady_clock;
+unsigned long long simperf_stage_ns[NUM_STAGES] = {0};
+unsigned long long simperf_sampled_cycles = 0;
+
+double elapsed_ms(perf_clock::time_point from, perf_clock::time_point to) {
+    return chrono::duration<double, milli>(to - from).count();
+}
+
+// Runs one pipeline stage. Only sampled cycles read the clock, so the common
+// path costs a single branch.
+inline void run_stage(void (*stage)(), int which, bool sample) {
+    if (!sample) {
+        stage();
+        return;
+    }
+    perf_clock::time_point start = perf_clock::now();
+    stage();
+    simperf_stage_ns[which] += chrono::duration_cast<chrono::nanoseconds>(perf_clock::now() - start).count();
+}
+
+// Host hardware counters around the simulation loop, via perf_event_open on Linux
+struct HostCounter {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+    uint64_t value;
+};
+#ifdef __linux__
+HostCounter host_counters[] = {
+    {"host cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 0},
+    {"host instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, 0},
+    {"host cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, 0},
+    {"host branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, 0},
+};
+#else
+array<HostCounter, 0> host_counters;   // ISO C++ has no zero-length built-in arrays
+#endif
+string host_counters_error;
+
+void host_counters_start() {
+#ifdef __linux__
+    for (HostCounter &c : host_counters) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = c.type;
+        attr.config = c.config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        c.fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (c.fd < 0 && host_counters_error.empty()) host_counters_error = strerror(errno);
+    }
+    for (HostCounter &c : host_counters) {
+        if (c.fd >= 0) {
+            ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    host_counters_error = "perf_event_open is Linux only";
+#endif
+}
+
+void host_counters_stop() {
+#ifdef __linux__
+    for (HostCounter &c : host_counters) {
+        if (c.fd < 0) continue;
+        ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(c.fd, &c.value, sizeof(c.value)) != sizeof(c.value)) c.value = 0;
+        close(c.fd);
+    }
+#endif
+}
+
+void write_simperf(const string &filename, double load_ms, double sim_ms, double output_ms, double total_ms) {
+    ofstream out(filename);
+    double sim_s = sim_ms / 1000.0;
+    out << "[simulator]\n";
+    out << "engine: " << (knob_pipeline ? (knob_forwarding ? "pipelined, forwarding" : "pipelined, no forwarding") : "sequential") << "\n";
+    out << "simulated cycles: " << dec << stat_cycles << "\n";
+    out << "simulated instructions: " << stat_instructions << "\n";
+    out << "vector kernels: " << vector_unit.kernels->name << "\n";
+    out << "\n[wall clock]\n" << fixed << setprecision(3);
+    out << "load: " << load_ms << " ms\n";
+    out << "simulate: " << sim_ms << " ms\n";
+    out << "write outputs: " << output_ms << " ms\n";
+    out << "total: " << total_ms << " ms\n";
+    out << "\n[speed]\n";
+    out << "KIPS: " << (sim_s > 0 ? stat_instructions / sim_s / 1e3 : 0.0) << "\n";
+    out << "MIPS: " << (sim_s > 0 ? stat_instructions / sim_s / 1e6 : 0.0) << "\n";
+    out << "simulated kHz: " << (sim_s > 0 ? stat_cycles / sim_s / 1e3 : 0.0) << "\n";
+    out << "host ns per simulated instruction: " << (stat_instructions ? sim_ms * 1e6 / stat_instructions : 0.0) << "\n";
+
+    if (knob_pipeline) {
+        // sampled totals are scaled up by the sampling period to estimate the whole run
+        const char *names[NUM_STAGES] = {"pipeline_fetch", "pipeline_decode", "pipeline_execute", "pipeline_memory", "pipeline_writeback"};
+        double scale = simperf_sampled_cycles ? (double)stat_cycles / simperf_sampled_cycles : 0.0;
+        double staged_ms = 0;
+        out << "\n[host time per stage] sampled 1 in " << simperf_sample_period << " cycles ("
+            << simperf_sampled_cycles << " samples), scaled to the whole run\n";
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            double ms = simperf_stage_ns[s] * scale / 1e6;
+            staged_ms += ms;
+            out << left << setw(20) << names[s] << right << setw(12) << ms << " ms  "
+                << setw(10) << (simperf_sampled_cycles ? (double)simperf_stage_ns[s] / simperf_sampled_cycles : 0.0) << " ns/cycle  "
+                << setw(7) << setprecision(2) << (sim_ms > 0 ? 100.0 * ms / sim_ms : 0.0) << " %\n" << setprecision(3);
+        }
+        out << left << setw(20) << "other" << right << setw(12) << max(0.0, sim_ms - staged_ms)
+            << " ms  (flush handling, tracing, loop control)\n";
+    }
+
+    out << "\n[host hardware counters] simulate phase only\n";
+    bool any = false;
+    for (HostCounter &c : host_counters) {
+        if (c.fd < 0) continue;
+        any = true;
+        out << left << setw(20) << c.name << right << setw(16) << c.value << "  "
+            << setprecision(2) << (stat_instructions ? (double)c.value / stat_instructions : 0.0) << " per simulated instruction\n";
+    }
+    if (!any) out << "unavailable: " << (host_counters_error.empty() ? "no counters" : host_counters_error) << "\n";
+    out.close();
+}
+
 int main(int argc, char* argv[]) {
+    perf_clock::time_point run_start = perf_clock::now();
     string input_file = "input.mc";
+    string symbol_file;
+    vector<string> map_files;
     
     // Parse command-line arguments for knobs and input file
     for (int i = 1; i < argc; ++i) {
@@ -1178,6 +2000,81 @@ int main(int argc, char* argv[]) {
             }
         }
         else if (arg == "--print-branch") knob_print_branch = true; //knob 6
+        else if (arg == "--profile") knob_profile = true;
+        else if (arg == "--callgraph") knob_callgraph = true;
+        else if (arg == "--simperf") knob_simperf = true;
+        else if (arg == "--branch-profile") knob_branch_profile = true;
+        else if (arg == "--simperf-sample") {
+            if (i + 1 < argc) simperf_sample_period = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--symbols") {
+            if (i + 1 < argc) symbol_file = argv[++i];
+        }
+        else if (arg == "--map-file") {
+            if (i + 1 < argc) map_files.push_back(argv[++i]);
+        }
+        else if (arg == "--load-threads") {
+            if (i + 1 < argc) knob_load_threads = max(0, stoi(argv[++i]));
+        }
+        else if (arg == "--mul-latency") {
+            if (i + 1 < argc) knob_mul_latency = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--div-latency") {
+            if (i + 1 < argc) knob_div_latency = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--fp-latency") {
+            if (i + 1 < argc) knob_fp_latency = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--fmul-latency") {
+            if (i + 1 < argc) knob_fmul_latency = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--fdiv-latency") {
+            if (i + 1 < argc) knob_fdiv_latency = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--fetch-block") {
+            if (i + 1 < argc) knob_fetch_block = max(4, stoi(argv[++i]));
+        }
+        else if (arg == "--guest-stdin" || arg == "--guest-stdout") {
+            if (i + 1 < argc) {
+                const char *path = argv[++i];
+                bool input = arg == "--guest-stdin";
+                int fd = input ? open(path, O_RDONLY) : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    cerr << "Error: " << arg << " " << path << ": " << strerror(errno) << endl;
+                    return 1;
+                }
+                syscalls.host_fd[input ? 0 : 1] = fd;
+            }
+        }
+        else if (arg == "--clock-mhz") {
+            if (i + 1 < argc) syscalls.clock_hz = max(1, stoi(argv[++i])) * 1000000ull;
+        }
+        else if (arg == "--random-seed") {
+            if (i + 1 < argc) syscalls.random.seed(stoul(argv[++i]));
+        }
+        else if (arg == "--vlen") {
+            if (i + 1 < argc) {
+                int vlen = stoi(argv[++i]);
+                if (vlen < 32 || vlen > (int)VLEN_MAX || (vlen & (vlen - 1))) {
+                    cerr << "Error: --vlen must be a power of 2 from 32 to " << VLEN_MAX << endl;
+                    return 1;
+                }
+                vector_unit.vlen = vlen;
+            }
+        }
+        else if (arg == "--vector-lanes") {
+            if (i + 1 < argc) knob_vector_lanes = max(1, stoi(argv[++i]));
+        }
+        else if (arg == "--vector-kernels") {
+            if (i + 1 < argc) {
+                const char *name = argv[++i];
+                vector_unit.kernels = vector_kernels(name);
+                if (!vector_unit.kernels) {
+                    cerr << "Error: --vector-kernels " << name << ": unknown or not supported by this CPU" << endl;
+                    return 1;
+                }
+            }
+        }
         else if (arg == "--input") {
             if (i + 1 < argc) input_file = argv[++i];
         }
@@ -1192,8 +2089,22 @@ int main(int argc, char* argv[]) {
     
 
     // Load machine code
-    simulator.load_mc_file(input_file);
+    simulator.load_program(input_file);
+    for (auto &spec : map_files) map_guest_file(spec);
+    // the heap (brk) starts above the data, at the data segment base at the earliest
+    if (!data_segment.empty()) data_end = max(data_end, data_segment.rbegin()->first + 1);
+    syscalls.brk_start = syscalls.brk = (max(data_end, 0x10000000u) + 15) & ~15u;
+    if (knob_branch_profile) init_block_counts();
+    if (knob_callgraph) {
+        // default to the assembler's symbol file next to the input, e.g. prog.mc -> prog.sym
+        if (symbol_file.empty()) symbol_file = input_file.substr(0, input_file.rfind('.')) + ".sym";
+        load_symbols(symbol_file);
+        call_tree.push_back(CallNode{PC, -1});
+        call_tree[0].calls = 1;
+    }
 
+    perf_clock::time_point sim_start = perf_clock::now();
+    if (knob_simperf) host_counters_start();
     if (!knob_pipeline) {
         simulator.run_sequential();
     } else {
@@ -1215,12 +2126,16 @@ int main(int argc, char* argv[]) {
 
         // Begin pipeline loop
         while (true) {
-            pipeline_writeback();
-            pipeline_memory();
-            pipeline_execute();
-
-            // Handle branch/jump misprediction and flush
-            if (ex_mem.valid && (ex_mem.branch_taken || ex_mem.jump_taken)) {
+            bool sample = knob_simperf && stat_cycles % simperf_sample_period == 0;
+            if (sample) simperf_sampled_cycles++;
+            run_stage(pipeline_writeback, STAGE_WB, sample);
+            run_stage(pipeline_memory, STAGE_MEM, sample);
+            run_stage(pipeline_execute, STAGE_EX, sample);
+
+            // Handle branch/jump misprediction and flush. A branch predicted taken that
+            // falls through also has wrong-path instructions behind it, possibly one
+            // fetch is still reading (then if_id.pc is its pc).
+            if (ex_mem.valid && (ex_mem.branch_taken || ex_mem.jump_taken || (ex_mem.is_branch && (if_id.valid || fetch_split)))) {
                 logs << "i am in flushing pipeline where pc is " << dec << PC << endl;
                 logs << "the contents of ex_mem are: " << endl;
                 logs << "valid is: " << ex_mem.valid << endl;
@@ -1254,7 +2169,16 @@ int main(int argc, char* argv[]) {
                     logs << "Flushing pipeline due to control hazard" << endl;
                     if_id.valid = false;
                     id_ex.valid = false;
+                    if_id.bubble_cause = CPI_CONTROL;
+                    id_ex.bubble_cause = CPI_CONTROL;
+                    if_id.bubble_pc = ex_mem.pc;
+                    id_ex.bubble_pc = ex_mem.pc;
+                    if (knob_profile) pc_profile[ex_mem.pc].flushes++;
                     PC = ex_mem.next_pc;
+                    fetch_split = false;
+                    // a wrong-path fetch may have run off the end of the text segment
+                    // (e.g. the word after a function's final jalr); that must not end fetching
+                    stop_fetch = false;
                     
                     // if(ex_mem.branch_taken){
                     //     stat_stalls++;
@@ -1267,8 +2191,8 @@ int main(int argc, char* argv[]) {
                 logs << "----------------------------------------" << endl << endl;
             }
 
-            pipeline_decode();
-            pipeline_fetch();
+            run_stage(pipeline_decode, STAGE_ID, sample);
+            run_stage(pipeline_fetch, STAGE_IF, sample);
             stat_cycles++;
 
             logs << "No of cycles: " << dec << stat_cycles << endl;
@@ -1356,6 +2280,9 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (knob_simperf) host_counters_stop();
+    perf_clock::time_point sim_end = perf_clock::now();
+
     // CPI Calculation
     double cpi = (stat_instructions == 0) ? 0.0 : (double)stat_cycles / stat_instructions;
 
@@ -1366,6 +2293,10 @@ int main(int argc, char* argv[]) {
     stats << "Cycles per instruction (CPI): " << fixed << setprecision(2) << cpi << "\n"; ////checked
     stats << "Number of load/store instructions: " << stat_load_store << "\n"; //checked
     stats << "Number of ALU instructions: " << stat_alu << "\n"; //checked
+    stats << "Number of bit-manipulation (Zba/Zbb) instructions: " << stat_bitmanip << "\n";
+    stats << "Number of floating-point (RV32F) instructions: " << stat_fp << "\n";
+    stats << "Number of vector (RVV) instructions: " << stat_vector << "\n";
+    stats << "Vector elements processed: " << vector_unit.elements << "\n";
     stats << "Number of control instructions: " << stat_control << "\n"; //checked
     stats << "Number of stalls: " << stat_stalls << "\n"; //checked
     stats << "Number of data hazards: " << stat_data_hazards << "\n"; //checked
@@ -1374,8 +2305,48 @@ int main(int argc, char* argv[]) {
     stats << "Number of branch mispredictions: " << stat_branch_misp << "\n"; //checked
     stats << "Number of stalls due to data hazards: " << stat_stall_data << "\n"; //checked
     stats << "Number of stalls due to control hazards: " << stat_stall_control << "\n"; //checked
+    stats << "Number of system calls: " << syscalls.calls << "\n";
+    if (syscalls.exited) stats << "Exit code: " << syscalls.exit_code << "\n";
+
+    // code size of the text segment, against the same instructions all 32 bits wide
+    unsigned long long text_bytes = 0, text_instructions = 0, text_compressed = 0;
+    for (auto &entry : instr_map) {
+        if (&instruction_decoder.lookup(expand_instruction(entry.second)) == &invalid_instruction) continue;
+        text_bytes += instruction_size(entry.second);
+        text_instructions++;
+        text_compressed += instruction_size(entry.second) == 2;
+    }
+    stats << "\nCode size: " << text_bytes << " bytes, " << text_compressed << " of " << text_instructions
+          << " instructions compressed (" << fixed << setprecision(1)
+          << (text_instructions ? 100.0 - 25.0 * text_bytes / text_instructions : 0.0) << " % smaller than RV32I)\n";
+    stats << "Fetch blocks read: " << stat_fetch_blocks << " of " << knob_fetch_block << " bytes ("
+          << setprecision(2) << (stat_instructions ? (double)stat_fetch_blocks * knob_fetch_block / stat_instructions : 0.0)
+          << " bytes per instruction executed)\n";
+    stats << "Fetch cycles for instructions split across blocks: " << stat_fetch_split_cycles << "\n";
+
+    // CPI stack: the buckets partition stat_cycles, so the components add up to the CPI above
+    stats << "\nCPI stack (cycles, CPI contribution):\n";
+    ofstream cpi_csv("cpi_stack.csv");
+    cpi_csv << "bucket,cycles,cpi\n";
+    for (int b = 0; b < CPI_NUM_BUCKETS; ++b) {
+        double part = (stat_instructions == 0) ? 0.0 : (double)stat_cpi_stack[b] / stat_instructions;
+        stats << "  " << left << setw(11) << cpi_bucket_names[b] << right << ": "
+              << stat_cpi_stack[b] << " cycles, " << fixed << setprecision(4) << part << "\n";
+        cpi_csv << cpi_bucket_names[b] << "," << stat_cpi_stack[b] << "," << fixed << setprecision(6) << part << "\n";
+    }
+    cpi_csv << "total," << stat_cycles << "," << fixed << setprecision(6) << cpi << "\n";
+    cpi_csv.close();
     stats.close();
 
+    if (knob_profile) write_profile("profile.txt");
+    if (knob_callgraph) write_callgraph("callgraph.folded", "callgraph.txt");
+    if (knob_branch_profile) write_branch_profile("branch_profile.txt");
+
     simulator.save_final_state();
-    return 0;
+    if (knob_simperf) {
+        perf_clock::time_point run_end = perf_clock::now();
+        write_simperf("simperf.txt", elapsed_ms(run_start, sim_start), elapsed_ms(sim_start, sim_end),
+                      elapsed_ms(sim_end, run_end), elapsed_ms(run_start, run_end));
+    }
+    return syscalls.exit_code;
 }
\ No newline at end of file
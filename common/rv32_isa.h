@@ -0,0 +1,887 @@
+// RV32 instruction description shared by the assembler (phase 1), the Phase2
+// simulator and both Phase 3 engines.
+//
+// instruction_table lists every supported instruction once: its encoding
+// fields, its format, the handler that computes its result and the registers
+// it reads and writes. The decoder below is generated from that table at
+// compile time, so the engines cannot disagree on immediates or on which
+// registers take part in a hazard.
+#ifndef RV32_ISA_H
+#define RV32_ISA_H
+
+#include <cfenv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//instruction formats; R4_TYPE adds a third source register (fused multiply-add),
+//V_TYPE is the RVV arithmetic and load/store layout (its immediate is the 5-bit
+//simm5 in the rs1 field), CSR_TYPE is Zicsr (its immediate is the CSR number and
+//the rs1 field), SYS_TYPE has no register or immediate operands (ecall)
+enum InstrType { R_TYPE, I_TYPE, S_TYPE, SB_TYPE, U_TYPE, UJ_TYPE, R4_TYPE, V_TYPE, CSR_TYPE, SYS_TYPE, NUM_INSTR_TYPES };
+
+// f0-f31 are register numbers FP_REG + 0-31 wherever a register number is
+// decoded, so hazards, forwarding and writeback treat both files alike
+constexpr uint32_t FP_REG = 32;
+// v0-v31 are VEC_REG + 0-31. Their values live in the vector unit
+// (rv32_vector.h); the numbers only take part in hazards
+constexpr uint32_t VEC_REG = 2 * FP_REG;
+constexpr uint32_t NUM_REGISTERS = VEC_REG + 32;   // every register number decode_instruction produces is below
+
+// Register usage and instruction class. x0 is never reported as a source or
+// destination, so a decoded rs1/rs2/rd of 0 means "no dependency".
+enum InstrFlag : uint32_t {
+    READS_RS1     = 1 << 0,
+    READS_RS2     = 1 << 1,
+    WRITES_RD     = 1 << 2,
+    INSTR_LOAD    = 1 << 3,
+    INSTR_STORE   = 1 << 4,
+    INSTR_BRANCH  = 1 << 5,
+    INSTR_JUMP    = 1 << 6,
+    INSTR_ECALL   = 1 << 7,
+    LOAD_UNSIGNED = 1 << 8,   // lbu/lhu zero-extend
+    MATCH_FUNC7   = 1 << 9,   // func7 selects the instruction (R-type, shift-immediates)
+    INSTR_MUL     = 1 << 10,  // multiplier: timed by the engines' mul latency
+    INSTR_DIV     = 1 << 11,  // divider: timed by the engines' div latency
+    INSTR_BITMANIP = 1 << 12, // Zba/Zbb
+    MATCH_RS2     = 1 << 13,  // the rs2 field selects the instruction too (unary Zbb ops)
+    INSTR_FP      = 1 << 14,  // executed by fp_exec on the FP unit
+    INSTR_FMUL    = 1 << 15,  // FP multiplier (fmul, fused multiply-add)
+    INSTR_FDIV    = 1 << 16,  // FP divider (fdiv, fsqrt)
+    FP_RD         = 1 << 17,  // rd, rs1, rs2 name f-registers; rs3 always does
+    FP_RS1        = 1 << 18,
+    FP_RS2        = 1 << 19,
+    READS_RS3     = 1 << 20,
+    FUNC3_RM      = 1 << 21,  // func3 is the rounding mode
+    INSTR_VECTOR  = 1 << 22,  // executed by the vector unit (vector_execute)
+    VEC_RD        = 1 << 23,  // rd, rs1, rs2 name v-registers
+    VEC_RS1       = 1 << 24,
+    VEC_RS2       = 1 << 25,
+    VEC_RS3       = 1 << 26,  // rs3 is the v-register in the rd field (the data of a vector store)
+    VEC_REDUCE    = 1 << 27,  // reduction: vd[0] = vs1[0] combined with every active element of vs2
+    FUNC7_LOW     = 1 << 28,  // func7 bit 6 (word bit 31) must be clear, the rest is immediate
+    INSTR_CSR     = 1 << 29,  // Zicsr: the handler combines the old CSR value with the operand
+};
+
+constexpr uint32_t type_flags(InstrType type) {
+    return type == R_TYPE  ? READS_RS1 | READS_RS2 | WRITES_RD | MATCH_FUNC7 :
+           type == I_TYPE  ? READS_RS1 | WRITES_RD :
+           type == S_TYPE  ? READS_RS1 | READS_RS2 | INSTR_STORE :
+           type == SB_TYPE ? READS_RS1 | READS_RS2 | INSTR_BRANCH :
+           type == U_TYPE  ? WRITES_RD :
+           type == UJ_TYPE ? WRITES_RD | INSTR_JUMP :
+           type == R4_TYPE ? READS_RS1 | READS_RS2 | READS_RS3 | WRITES_RD :
+           type == V_TYPE  ? (uint32_t)MATCH_FUNC7 : 0;
+}
+
+// Handlers take the two operands of the instruction:
+//   a = rs1, or the pc when the instruction reads no rs1 (lui, auipc, jal)
+//   b = rs2 for R-type and branches, the immediate otherwise
+// and return the ALU result, the memory address (loads/stores), the jump
+// target (jal/jalr) or 1 if a branch is taken.
+typedef uint32_t (*InstrHandler)(uint32_t a, uint32_t b);
+
+constexpr uint32_t exec_none(uint32_t, uint32_t) { return 0; }
+constexpr uint32_t exec_add(uint32_t a, uint32_t b) { return a + b; }
+constexpr uint32_t exec_sub(uint32_t a, uint32_t b) { return a - b; }
+constexpr uint32_t exec_sll(uint32_t a, uint32_t b) { return a << (b & 0x1F); }
+constexpr uint32_t exec_slt(uint32_t a, uint32_t b) { return (int32_t)a < (int32_t)b; }
+constexpr uint32_t exec_sltu(uint32_t a, uint32_t b) { return a < b; }
+constexpr uint32_t exec_xor(uint32_t a, uint32_t b) { return a ^ b; }
+constexpr uint32_t exec_srl(uint32_t a, uint32_t b) { return a >> (b & 0x1F); }
+constexpr uint32_t exec_sra(uint32_t a, uint32_t b) { return (uint32_t)((int32_t)a >> (b & 0x1F)); }
+constexpr uint32_t exec_or(uint32_t a, uint32_t b) { return a | b; }
+constexpr uint32_t exec_and(uint32_t a, uint32_t b) { return a & b; }
+constexpr uint32_t exec_mul(uint32_t a, uint32_t b) { return a * b; }
+constexpr uint32_t exec_mulh(uint32_t a, uint32_t b) {
+    return (uint32_t)((uint64_t)((int64_t)(int32_t)a * (int32_t)b) >> 32);
+}
+constexpr uint32_t exec_mulhsu(uint32_t a, uint32_t b) {
+    return (uint32_t)((uint64_t)((int64_t)(int32_t)a * (int64_t)b) >> 32);
+}
+constexpr uint32_t exec_mulhu(uint32_t a, uint32_t b) { return (uint32_t)(((uint64_t)a * b) >> 32); }
+// division never traps: x/0 is all ones, x%0 is x, and INT_MIN/-1 overflows to INT_MIN rem 0
+constexpr uint32_t exec_div(uint32_t a, uint32_t b) {
+    return b == 0 ? 0xFFFFFFFFu : (a == 0x80000000u && b == 0xFFFFFFFFu) ? a : (uint32_t)((int32_t)a / (int32_t)b);
+}
+constexpr uint32_t exec_divu(uint32_t a, uint32_t b) { return b == 0 ? 0xFFFFFFFFu : a / b; }
+constexpr uint32_t exec_rem(uint32_t a, uint32_t b) {
+    return b == 0 ? a : (a == 0x80000000u && b == 0xFFFFFFFFu) ? 0 : (uint32_t)((int32_t)a % (int32_t)b);
+}
+constexpr uint32_t exec_remu(uint32_t a, uint32_t b) { return b == 0 ? a : a % b; }
+// Zba/Zbb, on the host's bit instructions
+constexpr uint32_t exec_sh1add(uint32_t a, uint32_t b) { return (a << 1) + b; }
+constexpr uint32_t exec_sh2add(uint32_t a, uint32_t b) { return (a << 2) + b; }
+constexpr uint32_t exec_sh3add(uint32_t a, uint32_t b) { return (a << 3) + b; }
+constexpr uint32_t exec_andn(uint32_t a, uint32_t b) { return a & ~b; }
+constexpr uint32_t exec_orn(uint32_t a, uint32_t b) { return a | ~b; }
+constexpr uint32_t exec_xnor(uint32_t a, uint32_t b) { return ~(a ^ b); }
+constexpr uint32_t exec_clz(uint32_t a, uint32_t) { return a ? __builtin_clz(a) : 32; }
+constexpr uint32_t exec_ctz(uint32_t a, uint32_t) { return a ? __builtin_ctz(a) : 32; }
+constexpr uint32_t exec_cpop(uint32_t a, uint32_t) { return __builtin_popcount(a); }
+constexpr uint32_t exec_min(uint32_t a, uint32_t b) { return (int32_t)a < (int32_t)b ? a : b; }
+constexpr uint32_t exec_minu(uint32_t a, uint32_t b) { return a < b ? a : b; }
+constexpr uint32_t exec_max(uint32_t a, uint32_t b) { return (int32_t)a < (int32_t)b ? b : a; }
+constexpr uint32_t exec_maxu(uint32_t a, uint32_t b) { return a < b ? b : a; }
+constexpr uint32_t exec_rol(uint32_t a, uint32_t b) { return a << (b & 0x1F) | a >> (-b & 0x1F); }
+constexpr uint32_t exec_ror(uint32_t a, uint32_t b) { return a >> (b & 0x1F) | a << (-b & 0x1F); }
+constexpr uint32_t exec_rev8(uint32_t a, uint32_t) { return __builtin_bswap32(a); }
+constexpr uint32_t exec_sext_b(uint32_t a, uint32_t) { return (uint32_t)(int8_t)a; }
+constexpr uint32_t exec_sext_h(uint32_t a, uint32_t) { return (uint32_t)(int16_t)a; }
+constexpr uint32_t exec_lui(uint32_t, uint32_t b) { return b; }
+constexpr uint32_t exec_csrrw(uint32_t, uint32_t b) { return b; }
+constexpr uint32_t exec_jalr(uint32_t a, uint32_t b) { return (a + b) & ~1u; }
+constexpr uint32_t exec_beq(uint32_t a, uint32_t b) { return a == b; }
+constexpr uint32_t exec_bne(uint32_t a, uint32_t b) { return a != b; }
+constexpr uint32_t exec_bge(uint32_t a, uint32_t b) { return (int32_t)a >= (int32_t)b; }
+constexpr uint32_t exec_bgeu(uint32_t a, uint32_t b) { return a >= b; }
+
+// RV32F handlers compute on host floats and take the f-register bit patterns
+// (or integer registers) of rs1, rs2 and rs3. They run under fp_execute(),
+// which sets the rounding mode and collects the IEEE flags the host FPU
+// raised; the handlers raise the ones it does not produce itself.
+typedef uint32_t (*FpHandler)(uint32_t a, uint32_t b, uint32_t c);
+
+constexpr uint32_t CANONICAL_NAN = 0x7FC00000;
+constexpr bool fp_is_nan(uint32_t x) { return (x & 0x7FFFFFFF) > 0x7F800000; }
+constexpr bool fp_is_snan(uint32_t x) { return fp_is_nan(x) && !(x & 0x00400000); }
+inline float fp_value(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof f);
+    return f;
+}
+// every NaN an operation produces is the canonical one
+inline uint32_t fp_bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof bits);
+    return fp_is_nan(bits) ? CANONICAL_NAN : bits;
+}
+
+inline uint32_t fp_add(uint32_t a, uint32_t b, uint32_t) { return fp_bits(fp_value(a) + fp_value(b)); }
+inline uint32_t fp_sub(uint32_t a, uint32_t b, uint32_t) { return fp_bits(fp_value(a) - fp_value(b)); }
+inline uint32_t fp_mul(uint32_t a, uint32_t b, uint32_t) { return fp_bits(fp_value(a) * fp_value(b)); }
+inline uint32_t fp_div(uint32_t a, uint32_t b, uint32_t) { return fp_bits(fp_value(a) / fp_value(b)); }
+inline uint32_t fp_sqrt(uint32_t a, uint32_t, uint32_t) { return fp_bits(sqrtf(fp_value(a))); }
+// infinity times zero is invalid even when the addend is a quiet NaN
+inline uint32_t fp_fma(float x, float y, float z) {
+    if ((std::isinf(x) && y == 0) || (x == 0 && std::isinf(y))) feraiseexcept(FE_INVALID);
+    return fp_bits(fmaf(x, y, z));
+}
+inline uint32_t fp_fmadd(uint32_t a, uint32_t b, uint32_t c) { return fp_fma(fp_value(a), fp_value(b), fp_value(c)); }
+inline uint32_t fp_fmsub(uint32_t a, uint32_t b, uint32_t c) { return fp_fma(fp_value(a), fp_value(b), -fp_value(c)); }
+inline uint32_t fp_fnmsub(uint32_t a, uint32_t b, uint32_t c) { return fp_fma(-fp_value(a), fp_value(b), fp_value(c)); }
+inline uint32_t fp_fnmadd(uint32_t a, uint32_t b, uint32_t c) { return fp_fma(-fp_value(a), fp_value(b), -fp_value(c)); }
+constexpr uint32_t fp_sgnj(uint32_t a, uint32_t b, uint32_t) { return (a & 0x7FFFFFFF) | (b & 0x80000000); }
+constexpr uint32_t fp_sgnjn(uint32_t a, uint32_t b, uint32_t) { return (a & 0x7FFFFFFF) | (~b & 0x80000000); }
+constexpr uint32_t fp_sgnjx(uint32_t a, uint32_t b, uint32_t) { return a ^ (b & 0x80000000); }
+// fmin/fmax return the other operand if one is a NaN, and order -0 below +0
+inline uint32_t fp_minmax(uint32_t a, uint32_t b, bool max) {
+    if (fp_is_snan(a) || fp_is_snan(b)) feraiseexcept(FE_INVALID);
+    if (fp_is_nan(a)) return fp_is_nan(b) ? CANONICAL_NAN : b;
+    if (fp_is_nan(b)) return a;
+    float x = fp_value(a), y = fp_value(b);
+    if (x == y) return max ? a & b : a | b;
+    return (x < y) != max ? a : b;
+}
+inline uint32_t fp_min(uint32_t a, uint32_t b, uint32_t) { return fp_minmax(a, b, false); }
+inline uint32_t fp_max(uint32_t a, uint32_t b, uint32_t) { return fp_minmax(a, b, true); }
+// feq is quiet (invalid only for signaling NaNs), flt and fle signal on any NaN
+inline uint32_t fp_eq(uint32_t a, uint32_t b, uint32_t) {
+    if (fp_is_snan(a) || fp_is_snan(b)) feraiseexcept(FE_INVALID);
+    return !fp_is_nan(a) && !fp_is_nan(b) && fp_value(a) == fp_value(b);
+}
+inline uint32_t fp_lt(uint32_t a, uint32_t b, uint32_t) {
+    if (fp_is_nan(a) || fp_is_nan(b)) return feraiseexcept(FE_INVALID), 0;
+    return fp_value(a) < fp_value(b);
+}
+inline uint32_t fp_le(uint32_t a, uint32_t b, uint32_t) {
+    if (fp_is_nan(a) || fp_is_nan(b)) return feraiseexcept(FE_INVALID), 0;
+    return fp_value(a) <= fp_value(b);
+}
+// float to integer saturates out-of-range values and NaN (to the largest value) as invalid
+inline uint32_t fp_cvt_w(uint32_t a, uint32_t, uint32_t) {
+    float x = fp_value(a);
+    if (fp_is_nan(a)) return feraiseexcept(FE_INVALID), 0x7FFFFFFF;
+    float r = nearbyintf(x);
+    if (!(r >= -2147483648.0f && r < 2147483648.0f)) return feraiseexcept(FE_INVALID), x > 0 ? 0x7FFFFFFF : 0x80000000;
+    if (r != x) feraiseexcept(FE_INEXACT);
+    return (uint32_t)(int32_t)r;
+}
+inline uint32_t fp_cvt_wu(uint32_t a, uint32_t, uint32_t) {
+    float x = fp_value(a);
+    if (fp_is_nan(a)) return feraiseexcept(FE_INVALID), 0xFFFFFFFF;
+    float r = nearbyintf(x);
+    if (!(r > -1.0f && r < 4294967296.0f)) return feraiseexcept(FE_INVALID), x > 0 ? 0xFFFFFFFF : 0;
+    if (r != x) feraiseexcept(FE_INEXACT);
+    return (uint32_t)r;
+}
+inline uint32_t fp_cvt_s_w(uint32_t a, uint32_t, uint32_t) { return fp_bits((float)(int32_t)a); }
+inline uint32_t fp_cvt_s_wu(uint32_t a, uint32_t, uint32_t) { return fp_bits((float)a); }
+constexpr uint32_t fp_move(uint32_t a, uint32_t, uint32_t) { return a; }
+// one of the 10 fclass bits: -inf, -normal, -subnormal, -0, +0, +subnormal, +normal, +inf, sNaN, qNaN
+constexpr uint32_t fp_class(uint32_t a, uint32_t, uint32_t) {
+    uint32_t sign = a >> 31, exponent = (a >> 23) & 0xFF, fraction = a & 0x7FFFFF;
+    return exponent == 0xFF ? (fraction ? (fraction & 0x400000 ? 1u << 9 : 1u << 8) : (sign ? 1u << 0 : 1u << 7)) :
+           exponent == 0    ? (fraction ? (sign ? 1u << 2 : 1u << 5) : (sign ? 1u << 3 : 1u << 4)) :
+                              (sign ? 1u << 1 : 1u << 6);
+}
+
+// What the vector unit does for an INSTR_VECTOR entry. The element-wise
+// operations come first; a VEC_REDUCE entry combines elements with one of them.
+enum VectorOp : uint8_t {
+    VOP_ADD, VOP_SUB, VOP_AND, VOP_OR, VOP_XOR, VOP_MUL, VOP_MINU, VOP_MIN, VOP_MAXU, VOP_MAX,
+    VOP_MOVE,                   // vd = the second operand (vmv.v.*)
+    NUM_VECTOR_ALU_OPS,
+    VOP_SETVL = NUM_VECTOR_ALU_OPS,
+    VOP_LOAD, VOP_STORE,
+    VOP_MOVE_X_S,               // x[rd] = vs2[0]
+    VOP_MOVE_S_X,               // vd[0] = x[rs1]
+};
+
+struct InstrDesc {
+    const char *name;
+    uint32_t opcode;
+    uint32_t func3;
+    uint32_t func7;
+    InstrType type;
+    InstrHandler exec;
+    uint32_t flags;       // type_flags(type) plus the extra flags of the entry
+    uint8_t mem_size;     // bytes accessed by a load or store
+    uint8_t rs2;          // MATCH_RS2: the fixed rs2 field
+    FpHandler fp_exec;    // INSTR_FP entries, which have exec_none as exec
+    uint8_t vop;          // INSTR_VECTOR entries: a VectorOp
+
+    constexpr InstrDesc(const char *name, uint32_t opcode, uint32_t func3, uint32_t func7, InstrType type,
+                        InstrHandler exec, uint32_t extra = 0, uint8_t mem_size = 0, uint8_t rs2 = 0)
+        : name(name), opcode(opcode), func3(func3), func7(func7), type(type), exec(exec),
+          flags(type_flags(type) | extra), mem_size(mem_size), rs2(rs2), fp_exec(nullptr), vop(0) {}
+    constexpr InstrDesc(const char *name, uint32_t opcode, uint32_t func3, uint32_t func7, InstrType type,
+                        FpHandler fp_exec, uint32_t extra, uint8_t rs2 = 0)
+        : name(name), opcode(opcode), func3(func3), func7(func7), type(type), exec(exec_none),
+          flags(type_flags(type) | INSTR_FP | extra), mem_size(0), rs2(rs2), fp_exec(fp_exec), vop(0) {}
+    constexpr InstrDesc(const char *name, uint32_t opcode, uint32_t func3, uint32_t func7, InstrType type,
+                        VectorOp vop, uint32_t extra, uint8_t mem_size = 0, uint8_t rs2 = 0)
+        : name(name), opcode(opcode), func3(func3), func7(func7), type(type), exec(exec_none),
+          flags(type_flags(type) | INSTR_VECTOR | extra), mem_size(mem_size), rs2(rs2), fp_exec(nullptr), vop(vop) {}
+};
+
+// register operands of the RVV forms: .vv reads vs2 and vs1, .vx vs2 and x[rs1],
+// .vi vs2 and the immediate
+constexpr uint32_t VEC_VV = READS_RS1 | READS_RS2 | WRITES_RD | VEC_RD | VEC_RS1 | VEC_RS2;
+constexpr uint32_t VEC_VX = READS_RS1 | READS_RS2 | WRITES_RD | VEC_RD | VEC_RS2;
+constexpr uint32_t VEC_VI = READS_RS2 | WRITES_RD | VEC_RD | VEC_RS2;
+
+constexpr InstrDesc instruction_table[] = {
+    // R-type
+    {"add",  0x33, 0x0, 0x00, R_TYPE, exec_add},
+    {"sub",  0x33, 0x0, 0x20, R_TYPE, exec_sub},
+    {"sll",  0x33, 0x1, 0x00, R_TYPE, exec_sll},
+    {"slt",  0x33, 0x2, 0x00, R_TYPE, exec_slt},
+    {"sltu", 0x33, 0x3, 0x00, R_TYPE, exec_sltu},
+    {"xor",  0x33, 0x4, 0x00, R_TYPE, exec_xor},
+    {"srl",  0x33, 0x5, 0x00, R_TYPE, exec_srl},
+    {"sra",  0x33, 0x5, 0x20, R_TYPE, exec_sra},
+    {"or",   0x33, 0x6, 0x00, R_TYPE, exec_or},
+    {"and",  0x33, 0x7, 0x00, R_TYPE, exec_and},
+
+    // M extension
+    {"mul",    0x33, 0x0, 0x01, R_TYPE, exec_mul,    INSTR_MUL},
+    {"mulh",   0x33, 0x1, 0x01, R_TYPE, exec_mulh,   INSTR_MUL},
+    {"mulhsu", 0x33, 0x2, 0x01, R_TYPE, exec_mulhsu, INSTR_MUL},
+    {"mulhu",  0x33, 0x3, 0x01, R_TYPE, exec_mulhu,  INSTR_MUL},
+    {"div",    0x33, 0x4, 0x01, R_TYPE, exec_div,    INSTR_DIV},
+    {"divu",   0x33, 0x5, 0x01, R_TYPE, exec_divu,   INSTR_DIV},
+    {"rem",    0x33, 0x6, 0x01, R_TYPE, exec_rem,    INSTR_DIV},
+    {"remu",   0x33, 0x7, 0x01, R_TYPE, exec_remu,   INSTR_DIV},
+
+    // Zba/Zbb register-register
+    {"sh1add", 0x33, 0x2, 0x10, R_TYPE, exec_sh1add, INSTR_BITMANIP},
+    {"sh2add", 0x33, 0x4, 0x10, R_TYPE, exec_sh2add, INSTR_BITMANIP},
+    {"sh3add", 0x33, 0x6, 0x10, R_TYPE, exec_sh3add, INSTR_BITMANIP},
+    {"andn",   0x33, 0x7, 0x20, R_TYPE, exec_andn,   INSTR_BITMANIP},
+    {"orn",    0x33, 0x6, 0x20, R_TYPE, exec_orn,    INSTR_BITMANIP},
+    {"xnor",   0x33, 0x4, 0x20, R_TYPE, exec_xnor,   INSTR_BITMANIP},
+    {"min",    0x33, 0x4, 0x05, R_TYPE, exec_min,    INSTR_BITMANIP},
+    {"minu",   0x33, 0x5, 0x05, R_TYPE, exec_minu,   INSTR_BITMANIP},
+    {"max",    0x33, 0x6, 0x05, R_TYPE, exec_max,    INSTR_BITMANIP},
+    {"maxu",   0x33, 0x7, 0x05, R_TYPE, exec_maxu,   INSTR_BITMANIP},
+    {"rol",    0x33, 0x1, 0x30, R_TYPE, exec_rol,    INSTR_BITMANIP},
+    {"ror",    0x33, 0x5, 0x30, R_TYPE, exec_ror,    INSTR_BITMANIP},
+
+    // Zbb immediate and unary forms; a unary op has rs2 fixed and reads only rs1
+    {"rori",   0x13, 0x5, 0x30, I_TYPE, exec_ror,    INSTR_BITMANIP | MATCH_FUNC7},
+    {"clz",    0x13, 0x1, 0x30, I_TYPE, exec_clz,    INSTR_BITMANIP | MATCH_FUNC7 | MATCH_RS2, 0, 0x00},
+    {"ctz",    0x13, 0x1, 0x30, I_TYPE, exec_ctz,    INSTR_BITMANIP | MATCH_FUNC7 | MATCH_RS2, 0, 0x01},
+    {"cpop",   0x13, 0x1, 0x30, I_TYPE, exec_cpop,   INSTR_BITMANIP | MATCH_FUNC7 | MATCH_RS2, 0, 0x02},
+    {"sext.b", 0x13, 0x1, 0x30, I_TYPE, exec_sext_b, INSTR_BITMANIP | MATCH_FUNC7 | MATCH_RS2, 0, 0x04},
+    {"sext.h", 0x13, 0x1, 0x30, I_TYPE, exec_sext_h, INSTR_BITMANIP | MATCH_FUNC7 | MATCH_RS2, 0, 0x05},
+    {"rev8",   0x13, 0x5, 0x34, I_TYPE, exec_rev8,   INSTR_BITMANIP | MATCH_FUNC7 | MATCH_RS2, 0, 0x18},
+
+    // I-type ALU; the shift amount sits in the low 5 immediate bits and func7 in the rest
+    {"addi",  0x13, 0x0, 0x00, I_TYPE, exec_add},
+    {"slti",  0x13, 0x2, 0x00, I_TYPE, exec_slt},
+    {"sltiu", 0x13, 0x3, 0x00, I_TYPE, exec_sltu},
+    {"xori",  0x13, 0x4, 0x00, I_TYPE, exec_xor},
+    {"ori",   0x13, 0x6, 0x00, I_TYPE, exec_or},
+    {"andi",  0x13, 0x7, 0x00, I_TYPE, exec_and},
+    {"slli",  0x13, 0x1, 0x00, I_TYPE, exec_sll, MATCH_FUNC7},
+    {"srli",  0x13, 0x5, 0x00, I_TYPE, exec_srl, MATCH_FUNC7},
+    {"srai",  0x13, 0x5, 0x20, I_TYPE, exec_sra, MATCH_FUNC7},
+
+    // loads (ld is accepted from older programs and moves 4 bytes on RV32)
+    {"lb",  0x03, 0x0, 0x00, I_TYPE, exec_add, INSTR_LOAD, 1},
+    {"lh",  0x03, 0x1, 0x00, I_TYPE, exec_add, INSTR_LOAD, 2},
+    {"lw",  0x03, 0x2, 0x00, I_TYPE, exec_add, INSTR_LOAD, 4},
+    {"ld",  0x03, 0x3, 0x00, I_TYPE, exec_add, INSTR_LOAD, 4},
+    {"lbu", 0x03, 0x4, 0x00, I_TYPE, exec_add, INSTR_LOAD | LOAD_UNSIGNED, 1},
+    {"lhu", 0x03, 0x5, 0x00, I_TYPE, exec_add, INSTR_LOAD | LOAD_UNSIGNED, 2},
+
+    {"jalr", 0x67, 0x0, 0x00, I_TYPE, exec_jalr, INSTR_JUMP},
+
+    // S-type (sd, like ld, is a 4-byte store)
+    {"sb", 0x23, 0x0, 0x00, S_TYPE, exec_add, 0, 1},
+    {"sh", 0x23, 0x1, 0x00, S_TYPE, exec_add, 0, 2},
+    {"sw", 0x23, 0x2, 0x00, S_TYPE, exec_add, 0, 4},
+    {"sd", 0x23, 0x3, 0x00, S_TYPE, exec_add, 0, 4},
+
+    // SB-type
+    {"beq",  0x63, 0x0, 0x00, SB_TYPE, exec_beq},
+    {"bne",  0x63, 0x1, 0x00, SB_TYPE, exec_bne},
+    {"blt",  0x63, 0x4, 0x00, SB_TYPE, exec_slt},
+    {"bge",  0x63, 0x5, 0x00, SB_TYPE, exec_bge},
+    {"bltu", 0x63, 0x6, 0x00, SB_TYPE, exec_sltu},
+    {"bgeu", 0x63, 0x7, 0x00, SB_TYPE, exec_bgeu},
+
+    // U-type and UJ-type
+    {"auipc", 0x17, 0x0, 0x00, U_TYPE, exec_add},
+    {"lui",   0x37, 0x0, 0x00, U_TYPE, exec_lui},
+    {"jal",   0x6F, 0x0, 0x00, UJ_TYPE, exec_add},
+
+    // RV32F loads and stores (the address comes from an x-register)
+    {"flw", 0x07, 0x2, 0x00, I_TYPE, exec_add, INSTR_LOAD | FP_RD, 4},
+    {"fsw", 0x27, 0x2, 0x00, S_TYPE, exec_add, FP_RS2, 4},
+
+    // RV32F computational; the FUNC3_RM entries take their rounding mode from func3
+    {"fmadd.s",  0x43, 0x0, 0x00, R4_TYPE, fp_fmadd,  INSTR_FMUL | FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fmsub.s",  0x47, 0x0, 0x00, R4_TYPE, fp_fmsub,  INSTR_FMUL | FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fnmsub.s", 0x4B, 0x0, 0x00, R4_TYPE, fp_fnmsub, INSTR_FMUL | FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fnmadd.s", 0x4F, 0x0, 0x00, R4_TYPE, fp_fnmadd, INSTR_FMUL | FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fadd.s",   0x53, 0x0, 0x00, R_TYPE, fp_add,   FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fsub.s",   0x53, 0x0, 0x04, R_TYPE, fp_sub,   FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fmul.s",   0x53, 0x0, 0x08, R_TYPE, fp_mul,   INSTR_FMUL | FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fdiv.s",   0x53, 0x0, 0x0C, R_TYPE, fp_div,   INSTR_FDIV | FUNC3_RM | FP_RD | FP_RS1 | FP_RS2},
+    {"fsqrt.s",  0x53, 0x0, 0x2C, I_TYPE, fp_sqrt,  INSTR_FDIV | FUNC3_RM | MATCH_FUNC7 | MATCH_RS2 | FP_RD | FP_RS1, 0},
+    {"fsgnj.s",  0x53, 0x0, 0x10, R_TYPE, fp_sgnj,  FP_RD | FP_RS1 | FP_RS2},
+    {"fsgnjn.s", 0x53, 0x1, 0x10, R_TYPE, fp_sgnjn, FP_RD | FP_RS1 | FP_RS2},
+    {"fsgnjx.s", 0x53, 0x2, 0x10, R_TYPE, fp_sgnjx, FP_RD | FP_RS1 | FP_RS2},
+    {"fmin.s",   0x53, 0x0, 0x14, R_TYPE, fp_min,   FP_RD | FP_RS1 | FP_RS2},
+    {"fmax.s",   0x53, 0x1, 0x14, R_TYPE, fp_max,   FP_RD | FP_RS1 | FP_RS2},
+    {"fle.s",    0x53, 0x0, 0x50, R_TYPE, fp_le,    FP_RS1 | FP_RS2},
+    {"flt.s",    0x53, 0x1, 0x50, R_TYPE, fp_lt,    FP_RS1 | FP_RS2},
+    {"feq.s",    0x53, 0x2, 0x50, R_TYPE, fp_eq,    FP_RS1 | FP_RS2},
+    {"fcvt.w.s", 0x53, 0x0, 0x60, I_TYPE, fp_cvt_w,    FUNC3_RM | MATCH_FUNC7 | MATCH_RS2 | FP_RS1, 0},
+    {"fcvt.wu.s", 0x53, 0x0, 0x60, I_TYPE, fp_cvt_wu,  FUNC3_RM | MATCH_FUNC7 | MATCH_RS2 | FP_RS1, 1},
+    {"fcvt.s.w", 0x53, 0x0, 0x68, I_TYPE, fp_cvt_s_w,  FUNC3_RM | MATCH_FUNC7 | MATCH_RS2 | FP_RD, 0},
+    {"fcvt.s.wu", 0x53, 0x0, 0x68, I_TYPE, fp_cvt_s_wu, FUNC3_RM | MATCH_FUNC7 | MATCH_RS2 | FP_RD, 1},
+    {"fmv.x.w",  0x53, 0x0, 0x70, I_TYPE, fp_move,  MATCH_FUNC7 | MATCH_RS2 | FP_RS1, 0},
+    {"fclass.s", 0x53, 0x1, 0x70, I_TYPE, fp_class, MATCH_FUNC7 | MATCH_RS2 | FP_RS1, 0},
+    {"fmv.w.x",  0x53, 0x0, 0x78, I_TYPE, fp_move,  MATCH_FUNC7 | MATCH_RS2 | FP_RD, 0},
+
+    // RVV subset, unmasked forms only (vm = 1 is the low bit of func7). vsetvli keeps
+    // vtype in the I-type immediate below bit 31, which vsetvl and vsetivli set; the
+    // others have funct6 and vm in func7, and the unit-stride loads and stores and the
+    // vmv forms a fixed rs2 field
+    {"vsetvli", 0x57, 0x7, 0x00, I_TYPE, VOP_SETVL, FUNC7_LOW},
+    {"vle8.v",   0x07, 0x0, 0x01, V_TYPE, VOP_LOAD,  INSTR_LOAD | READS_RS1 | WRITES_RD | VEC_RD | MATCH_RS2, 1, 0},
+    {"vle16.v",  0x07, 0x5, 0x01, V_TYPE, VOP_LOAD,  INSTR_LOAD | READS_RS1 | WRITES_RD | VEC_RD | MATCH_RS2, 2, 0},
+    {"vle32.v",  0x07, 0x6, 0x01, V_TYPE, VOP_LOAD,  INSTR_LOAD | READS_RS1 | WRITES_RD | VEC_RD | MATCH_RS2, 4, 0},
+    {"vlse8.v",  0x07, 0x0, 0x05, V_TYPE, VOP_LOAD,  INSTR_LOAD | READS_RS1 | READS_RS2 | WRITES_RD | VEC_RD, 1},
+    {"vlse16.v", 0x07, 0x5, 0x05, V_TYPE, VOP_LOAD,  INSTR_LOAD | READS_RS1 | READS_RS2 | WRITES_RD | VEC_RD, 2},
+    {"vlse32.v", 0x07, 0x6, 0x05, V_TYPE, VOP_LOAD,  INSTR_LOAD | READS_RS1 | READS_RS2 | WRITES_RD | VEC_RD, 4},
+    {"vse8.v",   0x27, 0x0, 0x01, V_TYPE, VOP_STORE, INSTR_STORE | READS_RS1 | READS_RS3 | VEC_RS3 | MATCH_RS2, 1, 0},
+    {"vse16.v",  0x27, 0x5, 0x01, V_TYPE, VOP_STORE, INSTR_STORE | READS_RS1 | READS_RS3 | VEC_RS3 | MATCH_RS2, 2, 0},
+    {"vse32.v",  0x27, 0x6, 0x01, V_TYPE, VOP_STORE, INSTR_STORE | READS_RS1 | READS_RS3 | VEC_RS3 | MATCH_RS2, 4, 0},
+    {"vsse8.v",  0x27, 0x0, 0x05, V_TYPE, VOP_STORE, INSTR_STORE | READS_RS1 | READS_RS2 | READS_RS3 | VEC_RS3, 1},
+    {"vsse16.v", 0x27, 0x5, 0x05, V_TYPE, VOP_STORE, INSTR_STORE | READS_RS1 | READS_RS2 | READS_RS3 | VEC_RS3, 2},
+    {"vsse32.v", 0x27, 0x6, 0x05, V_TYPE, VOP_STORE, INSTR_STORE | READS_RS1 | READS_RS2 | READS_RS3 | VEC_RS3, 4},
+    {"vadd.vv",  0x57, 0x0, 0x01, V_TYPE, VOP_ADD,  VEC_VV},
+    {"vadd.vx",  0x57, 0x4, 0x01, V_TYPE, VOP_ADD,  VEC_VX},
+    {"vadd.vi",  0x57, 0x3, 0x01, V_TYPE, VOP_ADD,  VEC_VI},
+    {"vsub.vv",  0x57, 0x0, 0x05, V_TYPE, VOP_SUB,  VEC_VV},
+    {"vsub.vx",  0x57, 0x4, 0x05, V_TYPE, VOP_SUB,  VEC_VX},
+    {"vminu.vv", 0x57, 0x0, 0x09, V_TYPE, VOP_MINU, VEC_VV},
+    {"vminu.vx", 0x57, 0x4, 0x09, V_TYPE, VOP_MINU, VEC_VX},
+    {"vmin.vv",  0x57, 0x0, 0x0B, V_TYPE, VOP_MIN,  VEC_VV},
+    {"vmin.vx",  0x57, 0x4, 0x0B, V_TYPE, VOP_MIN,  VEC_VX},
+    {"vmaxu.vv", 0x57, 0x0, 0x0D, V_TYPE, VOP_MAXU, VEC_VV},
+    {"vmaxu.vx", 0x57, 0x4, 0x0D, V_TYPE, VOP_MAXU, VEC_VX},
+    {"vmax.vv",  0x57, 0x0, 0x0F, V_TYPE, VOP_MAX,  VEC_VV},
+    {"vmax.vx",  0x57, 0x4, 0x0F, V_TYPE, VOP_MAX,  VEC_VX},
+    {"vand.vv",  0x57, 0x0, 0x13, V_TYPE, VOP_AND,  VEC_VV},
+    {"vand.vx",  0x57, 0x4, 0x13, V_TYPE, VOP_AND,  VEC_VX},
+    {"vand.vi",  0x57, 0x3, 0x13, V_TYPE, VOP_AND,  VEC_VI},
+    {"vor.vv",   0x57, 0x0, 0x15, V_TYPE, VOP_OR,   VEC_VV},
+    {"vor.vx",   0x57, 0x4, 0x15, V_TYPE, VOP_OR,   VEC_VX},
+    {"vor.vi",   0x57, 0x3, 0x15, V_TYPE, VOP_OR,   VEC_VI},
+    {"vxor.vv",  0x57, 0x0, 0x17, V_TYPE, VOP_XOR,  VEC_VV},
+    {"vxor.vx",  0x57, 0x4, 0x17, V_TYPE, VOP_XOR,  VEC_VX},
+    {"vxor.vi",  0x57, 0x3, 0x17, V_TYPE, VOP_XOR,  VEC_VI},
+    {"vmv.v.v",  0x57, 0x0, 0x2F, V_TYPE, VOP_MOVE, READS_RS1 | WRITES_RD | VEC_RD | VEC_RS1 | MATCH_RS2, 0, 0},
+    {"vmv.v.x",  0x57, 0x4, 0x2F, V_TYPE, VOP_MOVE, READS_RS1 | WRITES_RD | VEC_RD | MATCH_RS2, 0, 0},
+    {"vmv.v.i",  0x57, 0x3, 0x2F, V_TYPE, VOP_MOVE, WRITES_RD | VEC_RD | MATCH_RS2, 0, 0},
+    {"vmul.vv",  0x57, 0x2, 0x4B, V_TYPE, VOP_MUL,  VEC_VV},
+    {"vmul.vx",  0x57, 0x6, 0x4B, V_TYPE, VOP_MUL,  VEC_VX},
+    {"vredsum.vs",  0x57, 0x2, 0x01, V_TYPE, VOP_ADD,  VEC_VV | VEC_REDUCE},
+    {"vredand.vs",  0x57, 0x2, 0x03, V_TYPE, VOP_AND,  VEC_VV | VEC_REDUCE},
+    {"vredor.vs",   0x57, 0x2, 0x05, V_TYPE, VOP_OR,   VEC_VV | VEC_REDUCE},
+    {"vredxor.vs",  0x57, 0x2, 0x07, V_TYPE, VOP_XOR,  VEC_VV | VEC_REDUCE},
+    {"vredminu.vs", 0x57, 0x2, 0x09, V_TYPE, VOP_MINU, VEC_VV | VEC_REDUCE},
+    {"vredmin.vs",  0x57, 0x2, 0x0B, V_TYPE, VOP_MIN,  VEC_VV | VEC_REDUCE},
+    {"vredmaxu.vs", 0x57, 0x2, 0x0D, V_TYPE, VOP_MAXU, VEC_VV | VEC_REDUCE},
+    {"vredmax.vs",  0x57, 0x2, 0x0F, V_TYPE, VOP_MAX,  VEC_VV | VEC_REDUCE},
+    {"vmv.x.s",  0x57, 0x2, 0x21, V_TYPE, VOP_MOVE_X_S, READS_RS2 | WRITES_RD | VEC_RS2},
+    {"vmv.s.x",  0x57, 0x6, 0x21, V_TYPE, VOP_MOVE_S_X, READS_RS1 | WRITES_RD | VEC_RD | MATCH_RS2, 0, 0},
+
+    // Zicsr: the register forms read x[rs1], the immediate forms use the rs1 field
+    {"csrrw",  0x73, 0x1, 0x00, CSR_TYPE, exec_csrrw, INSTR_CSR | READS_RS1 | WRITES_RD},
+    {"csrrs",  0x73, 0x2, 0x00, CSR_TYPE, exec_or,    INSTR_CSR | READS_RS1 | WRITES_RD},
+    {"csrrc",  0x73, 0x3, 0x00, CSR_TYPE, exec_andn,  INSTR_CSR | READS_RS1 | WRITES_RD},
+    {"csrrwi", 0x73, 0x5, 0x00, CSR_TYPE, exec_csrrw, INSTR_CSR | WRITES_RD},
+    {"csrrsi", 0x73, 0x6, 0x00, CSR_TYPE, exec_or,    INSTR_CSR | WRITES_RD},
+    {"csrrci", 0x73, 0x7, 0x00, CSR_TYPE, exec_andn,  INSTR_CSR | WRITES_RD},
+
+    {"ecall", 0x73, 0x0, 0x00, SYS_TYPE, exec_none, INSTR_ECALL},
+};
+constexpr size_t NUM_INSTRUCTIONS = sizeof(instruction_table) / sizeof(instruction_table[0]);
+
+// what every word that matches no table entry decodes to
+constexpr InstrDesc invalid_instruction = {"invalid", 0, 0, 0, SYS_TYPE, exec_none};
+
+// Sign-extended immediate of a word in the given format: I and S as written,
+// SB and UJ as byte offsets from the instruction, U already shifted into the
+// upper 20 bits. All layouts are computed and one is picked, so the hot loop
+// has no branch on the format.
+constexpr int32_t decode_immediate(uint32_t word, InstrType type) {
+    int32_t sign = (int32_t)word >> 31;         // 0 or -1
+    int32_t imm[NUM_INSTR_TYPES] = {
+        0,
+        (int32_t)word >> 20,
+        sign * (1 << 12) | (int32_t)((word >> 25) << 5 | ((word >> 7) & 0x1F)),
+        sign * (1 << 12) | (int32_t)(((word >> 7) & 1) << 11 | ((word >> 25) & 0x3F) << 5 | ((word >> 8) & 0xF) << 1),
+        (int32_t)(word & 0xFFFFF000),
+        sign * (1 << 20) | (int32_t)((word & 0xFF000) | ((word >> 20) & 1) << 11 | ((word >> 21) & 0x3FF) << 1),
+        0,
+        (int32_t)(word << 12) >> 27,
+        (int32_t)(word >> 15),
+        0,
+    };
+    return imm[type];
+}
+
+// Opcode-class x func3 x func7-class lookup generated from instruction_table.
+// Each opcode the table uses gets a class, and so does each func7 a
+// MATCH_FUNC7 entry uses; the other func7 values with bit 6 set share a class,
+// func7 class 0 stands for the rest, opcode class 0 decodes to nothing. func7 only matters for MATCH_FUNC7 entries, and U/UJ
+// instructions have no func3 while FUNC3_RM ones keep a rounding mode there,
+// so those entries fill every slot their other fields leave open; FUNC7_LOW
+// entries skip the func7 classes with bit 6 set. The MATCH_RS2 entries of one slot share a group, which rs2 indexes.
+struct InstructionDecoder {
+    enum { OPCODE_CLASSES = 32, FUNC7_CLASSES = 32, RS2_GROUPS = 32, RS2_GROUP = 0x8000 };
+    uint8_t opcode_class[128];
+    uint8_t func7_class[128];
+    uint16_t slot[OPCODE_CLASSES * 8 * FUNC7_CLASSES];  // 1 + index into instruction_table, 0 = invalid, or RS2_GROUP | group
+    uint16_t rs2_slot[RS2_GROUPS * 32];                 // 1 + index into instruction_table, 0 = invalid
+    uint32_t opcode_classes, func7_classes, rs2_groups; // in use, checked below
+
+    constexpr InstructionDecoder()
+        : opcode_class(), func7_class(), slot(), rs2_slot(), opcode_classes(1), func7_classes(1), rs2_groups(0) {
+        for (size_t i = 0; i < NUM_INSTRUCTIONS; ++i) {
+            const InstrDesc &d = instruction_table[i];
+            if (!opcode_class[d.opcode]) opcode_class[d.opcode] = (uint8_t)opcode_classes++;
+            if ((d.flags & MATCH_FUNC7) && !func7_class[d.func7]) func7_class[d.func7] = (uint8_t)func7_classes++;
+        }
+        bool func7_high[FUNC7_CLASSES] = {};
+        uint8_t high_class = (uint8_t)func7_classes++;
+        for (uint32_t f7 = 0x40; f7 < 0x80; ++f7) {
+            if (!func7_class[f7]) func7_class[f7] = high_class;
+            func7_high[func7_class[f7]] = true;
+        }
+        for (size_t i = 0; i < NUM_INSTRUCTIONS; ++i) {
+            const InstrDesc &d = instruction_table[i];
+            bool any_func3 = d.type == U_TYPE || d.type == UJ_TYPE || (d.flags & FUNC3_RM);
+            uint16_t group = 0;
+            for (uint32_t f3 = 0; f3 < 8; ++f3) {
+                if (!any_func3 && f3 != d.func3) continue;
+                for (uint32_t c = 0; c < FUNC7_CLASSES; ++c) {
+                    if ((d.flags & MATCH_FUNC7) && c != func7_class[d.func7]) continue;
+                    if ((d.flags & FUNC7_LOW) && func7_high[c]) continue;
+                    uint16_t &entry = slot[key(opcode_class[d.opcode], f3, c)];
+                    if (d.flags & MATCH_RS2) {
+                        if (!entry) entry = group ? group : (group = (uint16_t)(RS2_GROUP | rs2_groups++));
+                        rs2_slot[(entry & ~RS2_GROUP) << 5 | d.rs2] = (uint16_t)(i + 1);
+                    } else {
+                        entry = (uint16_t)(i + 1);
+                    }
+                }
+            }
+        }
+    }
+    static constexpr uint32_t key(uint32_t opcode_cls, uint32_t func3, uint32_t func7_cls) {
+        return opcode_cls << 8 | func3 << 5 | func7_cls;
+    }
+    constexpr const InstrDesc &lookup(uint32_t word) const {
+        uint32_t index = slot[key(opcode_class[word & 0x7F], (word >> 12) & 0x7, func7_class[word >> 25])];
+        if (index & RS2_GROUP) index = rs2_slot[(index & ~RS2_GROUP) << 5 | ((word >> 20) & 0x1F)];
+        return index ? instruction_table[index - 1] : invalid_instruction;
+    }
+};
+constexpr InstructionDecoder instruction_decoder;
+static_assert(instruction_decoder.opcode_classes <= InstructionDecoder::OPCODE_CLASSES &&
+              instruction_decoder.func7_classes <= InstructionDecoder::FUNC7_CLASSES &&
+              instruction_decoder.rs2_groups <= InstructionDecoder::RS2_GROUPS, "decoder tables too small");
+
+// A decoded word. Register fields the instruction does not use are 0,
+// f-registers are numbered from FP_REG and v-registers from VEC_REG.
+struct DecodedInstr {
+    const InstrDesc *desc;
+    uint32_t rd;
+    uint32_t rs1;
+    uint32_t rs2;
+    int32_t imm;
+    uint32_t rs3;
+    uint32_t rm;          // func3 of the word: the rounding mode of FUNC3_RM entries
+};
+
+// the first register number of the file a register field names
+constexpr uint32_t register_file(uint32_t flags, uint32_t fp_flag, uint32_t vec_flag) {
+    return (flags & fp_flag) ? FP_REG : (flags & vec_flag) ? VEC_REG : 0;
+}
+
+constexpr DecodedInstr decode_instruction(uint32_t word) {
+    const InstrDesc &d = instruction_decoder.lookup(word);
+    return {
+        &d,
+        (d.flags & WRITES_RD) ? ((word >> 7) & 0x1F) + register_file(d.flags, FP_RD, VEC_RD) : 0,
+        (d.flags & READS_RS1) ? ((word >> 15) & 0x1F) + register_file(d.flags, FP_RS1, VEC_RS1) : 0,
+        (d.flags & READS_RS2) ? ((word >> 20) & 0x1F) + register_file(d.flags, FP_RS2, VEC_RS2) : 0,
+        decode_immediate(word, d.type),
+        (d.flags & READS_RS3) ? ((d.flags & VEC_RS3) ? ((word >> 7) & 0x1F) + VEC_REG : (word >> 27) + FP_REG) : 0,
+        (word >> 12) & 0x7,
+    };
+}
+
+// handler operands for a decoded instruction, given its register values and pc
+constexpr uint32_t operand_a(const DecodedInstr &instr, uint32_t rs1_value, uint32_t pc) {
+    return (instr.desc->flags & READS_RS1) ? rs1_value : pc;
+}
+constexpr uint32_t operand_b(const DecodedInstr &instr, uint32_t rs2_value) {
+    return (instr.desc->type == R_TYPE || instr.desc->type == R4_TYPE || instr.desc->type == SB_TYPE) ? rs2_value : (uint32_t)instr.imm;
+}
+
+// fcsr holds the accrued exception flags in bits 0-4 and the dynamic rounding
+// mode frm in bits 5-7
+constexpr uint32_t FFLAG_NX = 1, FFLAG_UF = 2, FFLAG_OF = 4, FFLAG_DZ = 8, FFLAG_NV = 16;
+constexpr uint32_t FRM_SHIFT = 5;
+constexpr uint32_t RM_DYN = 7;
+
+// Runs an INSTR_FP instruction on the values of rs1, rs2 and rs3 under its
+// rounding mode (frm for RM_DYN) and ORs the flags it raises into fcsr. RMM
+// has no host rounding mode and rounds like RNE, as do the reserved modes.
+inline uint32_t fp_execute(const DecodedInstr &instr, uint32_t a, uint32_t b, uint32_t c, uint32_t &fcsr) {
+    static const int host_rounding[8] = {FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD,
+                                         FE_TONEAREST, FE_TONEAREST, FE_TONEAREST, FE_TONEAREST};
+    uint32_t rm = instr.rm == RM_DYN ? (fcsr >> FRM_SHIFT) & 7 : instr.rm;
+    fesetround(host_rounding[rm]);
+    feclearexcept(FE_ALL_EXCEPT);
+    uint32_t result = instr.desc->fp_exec(a, b, c);
+    int raised = fetestexcept(FE_ALL_EXCEPT);
+    fesetround(FE_TONEAREST);
+    fcsr |= ((raised & FE_INEXACT) ? FFLAG_NX : 0) | ((raised & FE_UNDERFLOW) ? FFLAG_UF : 0) |
+            ((raised & FE_OVERFLOW) ? FFLAG_OF : 0) | ((raised & FE_DIVBYZERO) ? FFLAG_DZ : 0) |
+            ((raised & FE_INVALID) ? FFLAG_NV : 0);
+    return result;
+}
+
+// Zicsr. A CSR_TYPE immediate is the 12-bit CSR number above the 5-bit rs1
+// field, which names the source register of csrrw/csrrs/csrrc and is the zimm
+// operand of the immediate forms.
+constexpr uint32_t CSR_FFLAGS = 0x001, CSR_FRM = 0x002, CSR_FCSR = 0x003;
+constexpr uint32_t CSR_MCYCLE = 0xB00, CSR_MINSTRET = 0xB02, CSR_MHPMCOUNTER3 = 0xB03;
+constexpr uint32_t CSR_CYCLE = 0xC00, CSR_TIME = 0xC01, CSR_INSTRET = 0xC02, CSR_HPMCOUNTER3 = 0xC03;
+constexpr uint32_t CSR_HIGH = 0x80;     // cycleh, instreth, ...: the upper 32 bits of a counter
+
+constexpr uint32_t csr_number(const DecodedInstr &instr) { return (uint32_t)instr.imm >> 5; }
+constexpr uint32_t csr_operand(const DecodedInstr &instr, uint32_t rs1_value) {
+    return (instr.desc->flags & READS_RS1) ? rs1_value : (uint32_t)instr.imm & 0x1F;
+}
+// csrrs/csrrc with x0, or a zero zimm, only read the CSR
+constexpr bool csr_writes(const DecodedInstr &instr) {
+    return (instr.desc->func3 & 3) == 1 || (instr.imm & 0x1F) != 0;
+}
+
+// the counter a counter CSR names: 0 cycle, 1 time, 2 instret, 3-31 hpmcounterN,
+// in the machine (mcycle, ...) or read-only user (cycle, ...) bank; -1 for other CSRs
+constexpr int csr_counter(uint32_t csr) {
+    return ((csr & ~0x9Fu) == 0xB00 || (csr & ~0x9Fu) == 0xC00) ? (int)(csr & 0x1F) : -1;
+}
+constexpr bool csr_read_only(uint32_t csr) { return (csr >> 10) == 3; }
+
+// fflags, frm and fcsr are views of fcsr
+constexpr bool is_fp_csr(uint32_t csr) { return csr >= CSR_FFLAGS && csr <= CSR_FCSR; }
+constexpr uint32_t fp_csr_read(uint32_t csr, uint32_t fcsr) {
+    return csr == CSR_FFLAGS ? fcsr & 0x1F : csr == CSR_FRM ? (fcsr >> FRM_SHIFT) & 7 : fcsr & 0xFF;
+}
+constexpr uint32_t fp_csr_write(uint32_t csr, uint32_t fcsr, uint32_t value) {
+    return csr == CSR_FFLAGS ? (fcsr & ~0x1Fu) | (value & 0x1F) :
+           csr == CSR_FRM ? (fcsr & 0x1F) | (value & 7) << FRM_SHIFT : value & 0xFF;
+}
+
+// Runs an INSTR_CSR instruction on an engine's CSRs, given as read(csr) and
+// write(csr, value), and returns the old value for rd. The engines read 0 from
+// CSRs they do not implement and ignore writes to them.
+template <typename Read, typename Write>
+uint32_t csr_execute(const DecodedInstr &instr, uint32_t rs1_value, Read read, Write write) {
+    uint32_t csr = csr_number(instr), old = read(csr);
+    if (csr_writes(instr)) write(csr, instr.desc->exec(old, csr_operand(instr, rs1_value)));
+    return old;
+}
+
+// the value a load writes back from the raw little-endian bytes it read
+constexpr uint32_t extend_load(const InstrDesc &d, uint32_t raw) {
+    return d.mem_size == 1 ? ((d.flags & LOAD_UNSIGNED) ? raw & 0xFF : (uint32_t)(int8_t)raw) :
+           d.mem_size == 2 ? ((d.flags & LOAD_UNSIGNED) ? raw & 0xFFFF : (uint32_t)(int16_t)raw) : raw;
+}
+
+static_assert(decode_instruction(0xFE010113).imm == -32, "addi sp, sp, -32");
+static_assert(decode_instruction(0xFE0008E3).imm == -16, "beq x0, x0, -16");
+static_assert(decode_instruction(0xFF5FF06F).imm == -12, "jal x0, -12");
+static_assert(decode_instruction(0xFFC08067).imm == -4, "jalr x0, -4(x1)");
+static_assert(decode_instruction(0xFE112E23).imm == -4, "sw x1, -4(x2)");
+static_assert(decode_instruction(0x4020D093).desc->exec == exec_sra, "srai x1, x1, 2");
+static_assert(decode_instruction(0x00052283).rs2 == 0, "lw t0, 0(a0) reads no rs2");
+static_assert(decode_instruction(0x02B51533).desc->exec == exec_mulh, "mulh a0, a0, a1");
+static_assert(exec_mulhsu(0xFFFFFFFF, 0xFFFFFFFF) == 0xFFFFFFFF && exec_mulhu(0xFFFFFFFF, 0xFFFFFFFF) == 0xFFFFFFFE, "mulh*");
+static_assert(exec_div(7, 0) == 0xFFFFFFFF && exec_rem(7, 0) == 7 && exec_div(0x80000000, 0xFFFFFFFF) == 0x80000000, "div edge cases");
+static_assert(decode_instruction(0x20B52533).desc->exec == exec_sh1add, "sh1add a0, a0, a1");
+static_assert(decode_instruction(0x60051513).desc->exec == exec_clz && decode_instruction(0x60051513).rs2 == 0, "clz a0, a0");
+static_assert(decode_instruction(0x69855513).desc->exec == exec_rev8, "rev8 a0, a0");
+static_assert(decode_instruction(0x60351513).desc == &invalid_instruction, "rs2 3 is no unary Zbb op");
+static_assert(exec_clz(0, 0) == 32 && exec_ctz(0x80, 0) == 7 && exec_cpop(0xF0F0, 0) == 8 && exec_sext_b(0x80, 0) == 0xFFFFFF80, "Zbb unary");
+static_assert(exec_ror(0x12345678, 8) == 0x78123456 && exec_rol(0x12345678, 0) == 0x12345678 && exec_rev8(0x12345678, 0) == 0x78563412, "Zbb rotates");
+static_assert(decode_instruction(0x00B57553).desc->fp_exec == fp_add && decode_instruction(0x00B57553).rd == FP_REG + 10 &&
+              decode_instruction(0x00B57553).rm == RM_DYN, "fadd.s fa0, fa0, fa1");
+static_assert(decode_instruction(0x60B57543).rs3 == FP_REG + 12, "fmadd.s fa0, fa0, fa1, fa2");
+static_assert(decode_instruction(0xC0051553).desc->fp_exec == fp_cvt_w && decode_instruction(0xC0051553).rd == 10 &&
+              decode_instruction(0xC0051553).rs1 == FP_REG + 10, "fcvt.w.s a0, fa0, rtz");
+static_assert(decode_instruction(0x00052507).rd == FP_REG + 10 && decode_instruction(0x00052507).rs1 == 10, "flw fa0, 0(a0)");
+static_assert(fp_class(0xFF800000, 0, 0) == 1 && fp_class(0x80000000, 0, 0) == 8 && fp_class(0x7FC00000, 0, 0) == 512, "fclass.s");
+static_assert(decode_instruction(0x022180D7).desc->vop == VOP_ADD && decode_instruction(0x022180D7).rd == VEC_REG + 1 &&
+              decode_instruction(0x022180D7).rs1 == VEC_REG + 3 && decode_instruction(0x022180D7).rs2 == VEC_REG + 2, "vadd.vv v1, v2, v3");
+static_assert(decode_instruction(0x022EB0D7).imm == -3 && decode_instruction(0x022EB0D7).rs1 == 0, "vadd.vi v1, v2, -3");
+static_assert(decode_instruction(0x0AD66227).rs3 == VEC_REG + 4 && decode_instruction(0x0AD66227).rs2 == 13, "vsse32.v v4, (a2), a3");
+static_assert(decode_instruction(0x0D05F557).desc->vop == VOP_SETVL && decode_instruction(0x0D05F557).imm == 0xD0, "vsetvli a0, a1, e32, m1, ta, ma");
+static_assert(decode_instruction(0x803170D7).desc == &invalid_instruction, "vsetvl x1, x2, x3 is not vsetvli");
+static_assert(decode_instruction(0xC10270D7).desc == &invalid_instruction, "vsetivli x1, 4, e32 is not implemented");
+static_assert(decode_instruction(0x7FF170D7).desc->vop == VOP_SETVL, "vsetvli with every vtype bit below 31 set");
+static_assert(decode_instruction(0x42102557).rd == 10 && decode_instruction(0x42102557).rs2 == VEC_REG + 1, "vmv.x.s a0, v1");
+static_assert(decode_instruction(0x002180D7).desc == &invalid_instruction, "masked forms are not implemented");
+static_assert(csr_number(decode_instruction(0xC0002573)) == CSR_CYCLE && decode_instruction(0xC0002573).rd == 10 &&
+              !csr_writes(decode_instruction(0xC0002573)), "rdcycle a0");
+static_assert(csr_number(decode_instruction(0xB002D073)) == CSR_MCYCLE && decode_instruction(0xB002D073).rs1 == 0 &&
+              csr_operand(decode_instruction(0xB002D073), 0) == 5, "csrwi mcycle, 5");
+static_assert(decode_instruction(0x00351073).rs1 == 10 && csr_writes(decode_instruction(0x00351073)), "fscsr a0");
+static_assert(csr_counter(0xC82) == 2 && csr_counter(0xB04) == 4 && csr_counter(0xB20) == -1 && csr_counter(0x003) == -1, "counters");
+static_assert(decode_instruction(0xFFFFFFFF).desc == &invalid_instruction, "end-of-text marker");
+
+// ---------------------------------------------------------------------------
+// RV32C. A parcel whose low two bits are not 11 is a 16-bit instruction. The
+// engines expand it to its 32-bit equivalent in fetch and decode that, and the
+// assembler (--compress) replaces a word by compress_instruction() where the
+// word has a 16-bit form. c.ebreak and the floating-point forms are not
+// supported and expand to the illegal word 0.
+
+constexpr uint32_t instruction_size(uint32_t parcel) { return (parcel & 3) == 3 ? 4 : 2; }
+
+constexpr uint32_t encode_r(uint32_t func7, uint32_t rs2, uint32_t rs1, uint32_t func3, uint32_t rd, uint32_t opcode) {
+    return func7 << 25 | rs2 << 20 | rs1 << 15 | func3 << 12 | rd << 7 | opcode;
+}
+constexpr uint32_t encode_i(int32_t imm, uint32_t rs1, uint32_t func3, uint32_t rd, uint32_t opcode) {
+    return (uint32_t)imm << 20 | rs1 << 15 | func3 << 12 | rd << 7 | opcode;
+}
+constexpr uint32_t encode_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t func3) {
+    return ((uint32_t)imm >> 5 & 0x7F) << 25 | rs2 << 20 | rs1 << 15 | func3 << 12 | ((uint32_t)imm & 0x1F) << 7 | 0x23;
+}
+constexpr uint32_t encode_b(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t func3) {
+    uint32_t i = (uint32_t)imm;
+    return (i >> 12 & 1) << 31 | (i >> 5 & 0x3F) << 25 | rs2 << 20 | rs1 << 15 | func3 << 12 |
+           (i >> 1 & 0xF) << 8 | (i >> 11 & 1) << 7 | 0x63;
+}
+constexpr uint32_t encode_j(int32_t imm, uint32_t rd) {
+    uint32_t i = (uint32_t)imm;
+    return (i >> 20 & 1) << 31 | (i >> 1 & 0x3FF) << 21 | (i >> 11 & 1) << 20 | (i >> 12 & 0xFF) << 12 | rd << 7 | 0x6F;
+}
+
+// bits hi..lo of a parcel, and the value placed at bit position `at`
+constexpr uint32_t cbits(uint32_t c, int hi, int lo) { return (c >> lo) & ((1u << (hi - lo + 1)) - 1); }
+constexpr uint32_t cbit(uint32_t c, int bit, int at) { return ((c >> bit) & 1) << at; }
+constexpr int32_t csext(uint32_t value, int bits) { return (int32_t)(value << (32 - bits)) >> (32 - bits); }
+
+// offsets of c.j/c.jal and c.beqz/c.bnez
+constexpr int32_t cj_offset(uint32_t c) {
+    return csext(cbit(c, 12, 11) | cbit(c, 11, 4) | cbits(c, 10, 9) << 8 | cbit(c, 8, 10) | cbit(c, 7, 6) |
+                 cbit(c, 6, 7) | cbits(c, 5, 3) << 1 | cbit(c, 2, 5), 12);
+}
+constexpr int32_t cb_offset(uint32_t c) {
+    return csext(cbit(c, 12, 8) | cbits(c, 11, 10) << 3 | cbits(c, 6, 5) << 6 | cbits(c, 4, 3) << 1 | cbit(c, 2, 5), 9);
+}
+
+constexpr uint32_t expand_compressed(uint32_t c) {
+    uint32_t rd = cbits(c, 11, 7), rs2 = cbits(c, 6, 2);
+    uint32_t rd_ = cbits(c, 4, 2) + 8, rs1_ = cbits(c, 9, 7) + 8;      // x8-x15 in the 3-bit fields
+    int32_t imm6 = csext(cbit(c, 12, 5) | cbits(c, 6, 2), 6);
+    uint32_t lw_imm = cbits(c, 12, 10) << 3 | cbit(c, 6, 2) | cbit(c, 5, 6);
+    switch (cbits(c, 1, 0) << 3 | cbits(c, 15, 13)) {
+    case 0x00: {                                                        // c.addi4spn
+        uint32_t imm = cbits(c, 12, 11) << 4 | cbits(c, 10, 7) << 6 | cbit(c, 6, 2) | cbit(c, 5, 3);
+        return imm ? encode_i(imm, 2, 0, rd_, 0x13) : 0;
+    }
+    case 0x02: return encode_i(lw_imm, rs1_, 2, rd_, 0x03);             // c.lw
+    case 0x06: return encode_s(lw_imm, rd_, rs1_, 2);                   // c.sw
+    case 0x08: return encode_i(imm6, rd, 0, rd, 0x13);                  // c.addi, c.nop
+    case 0x09: return encode_j(cj_offset(c), 1);                        // c.jal
+    case 0x0A: return encode_i(imm6, 0, 0, rd, 0x13);                   // c.li
+    case 0x0B:
+        if (rd == 2) {                                                  // c.addi16sp
+            int32_t imm = csext(cbit(c, 12, 9) | cbit(c, 6, 4) | cbit(c, 5, 6) | cbits(c, 4, 3) << 7 | cbit(c, 2, 5), 10);
+            return imm ? encode_i(imm, 2, 0, 2, 0x13) : 0;
+        }
+        return imm6 ? (uint32_t)imm6 << 12 | rd << 7 | 0x37 : 0;        // c.lui
+    case 0x0C:
+        switch (cbits(c, 11, 10)) {
+        case 0: return cbit(c, 12, 0) ? 0 : encode_r(0x00, cbits(c, 6, 2), rs1_, 5, rs1_, 0x13);   // c.srli
+        case 1: return cbit(c, 12, 0) ? 0 : encode_r(0x20, cbits(c, 6, 2), rs1_, 5, rs1_, 0x13);   // c.srai
+        case 2: return encode_i(imm6, rs1_, 7, rs1_, 0x13);                                        // c.andi
+        default: {                                                      // c.sub, c.xor, c.or, c.and
+            constexpr uint32_t func3[4] = {0, 4, 6, 7};
+            uint32_t op = cbits(c, 6, 5);
+            return cbit(c, 12, 0) ? 0 : encode_r(op == 0 ? 0x20 : 0x00, rd_, rs1_, func3[op], rs1_, 0x33);
+        }
+        }
+    case 0x0D: return encode_j(cj_offset(c), 0);                        // c.j
+    case 0x0E: return encode_b(cb_offset(c), 0, rs1_, 0);               // c.beqz
+    case 0x0F: return encode_b(cb_offset(c), 0, rs1_, 1);               // c.bnez
+    case 0x10: return cbit(c, 12, 0) ? 0 : encode_r(0x00, rs2, rd, 1, rd, 0x13);   // c.slli
+    case 0x12: {                                                        // c.lwsp
+        uint32_t imm = cbit(c, 12, 5) | cbits(c, 6, 4) << 2 | cbits(c, 3, 2) << 6;
+        return rd ? encode_i(imm, 2, 2, rd, 0x03) : 0;
+    }
+    case 0x14:
+        if (!cbit(c, 12, 0)) {
+            if (rs2) return encode_r(0, rs2, 0, 0, rd, 0x33);           // c.mv
+            return rd ? encode_i(0, rd, 0, 0, 0x67) : 0;                // c.jr
+        }
+        if (rs2) return encode_r(0, rs2, rd, 0, rd, 0x33);              // c.add
+        return rd ? encode_i(0, rd, 0, 1, 0x67) : 0;                    // c.jalr (c.ebreak unsupported)
+    case 0x16:                                                          // c.swsp
+        return encode_s(cbits(c, 12, 9) << 2 | cbits(c, 8, 7) << 6, rs2, 2, 2);
+    default:
+        return 0;
+    }
+}
+
+// the 32-bit form of any parcel
+constexpr uint32_t expand_instruction(uint32_t parcel) {
+    return instruction_size(parcel) == 4 ? parcel : expand_compressed(parcel & 0xFFFF);
+}
+
+// The 16-bit form of a 32-bit word, or 0 if it has none
+constexpr uint32_t compress_instruction(uint32_t word) {
+    DecodedInstr in = decode_instruction(word);
+    const InstrDesc &d = *in.desc;
+    uint32_t rd = (word >> 7) & 0x1F, rs1 = (word >> 15) & 0x1F, rs2 = (word >> 20) & 0x1F;
+    int32_t imm = in.imm;
+    auto is = [&](uint32_t opcode, uint32_t func3, uint32_t func7) {
+        return d.opcode == opcode && d.func3 == func3 && ((d.flags & MATCH_FUNC7) == 0 || d.func7 == func7);
+    };
+    auto compact = [](uint32_t reg) { return reg >= 8 && reg < 16; };
+    auto imm6 = [](int32_t v) { return ((uint32_t)v & 0x20) << 7 | ((uint32_t)v & 0x1F) << 2; };
+    auto lw_imm = [](int32_t v) { return ((uint32_t)v >> 3 & 7) << 10 | ((uint32_t)v >> 2 & 1) << 6 | ((uint32_t)v >> 6 & 1) << 5; };
+    bool fits6 = imm >= -32 && imm < 32;
+    uint32_t u = (uint32_t)imm;
+
+    if (is(0x13, 0, 0)) {                                               // addi
+        if (rd == 0 && rs1 == 0 && imm == 0) return 0x0001;             // c.nop
+        if (rd != 0 && rd == rs1 && imm && fits6) return 0x0001 | rd << 7 | imm6(imm);                 // c.addi
+        if (rd == 2 && rs1 == 2 && imm && imm % 16 == 0 && imm >= -512 && imm < 512)
+            return 0x6101 | (u >> 9 & 1) << 12 | (u >> 4 & 1) << 6 | (u >> 6 & 1) << 5 | (u >> 7 & 3) << 3 | (u >> 5 & 1) << 2;
+        if (rs1 == 2 && compact(rd) && imm > 0 && imm < 1024 && imm % 4 == 0)
+            return (u >> 4 & 3) << 11 | (u >> 6 & 0xF) << 7 | (u >> 2 & 1) << 6 | (u >> 3 & 1) << 5 | (rd - 8) << 2;
+        if (rd != 0 && rs1 == 0 && fits6) return 0x4001 | rd << 7 | imm6(imm);                         // c.li
+        if (rd != 0 && rs1 != 0 && imm == 0) return 0x8002 | rd << 7 | rs1 << 2;                       // c.mv
+        return 0;
+    }
+    if (is(0x13, 7, 0) && rd == rs1 && compact(rd) && fits6) return 0x8801 | (rd - 8) << 7 | imm6(imm);   // c.andi
+    if (is(0x13, 1, 0x00) && rd == rs1 && rd != 0 && imm) return 0x0002 | rd << 7 | u << 2;             // c.slli
+    if ((is(0x13, 5, 0x00) || is(0x13, 5, 0x20)) && rd == rs1 && compact(rd) && (imm & 0x1F))          // c.srli, c.srai
+        return 0x8001 | (d.func7 ? 1u : 0u) << 10 | (rd - 8) << 7 | (u & 0x1F) << 2;
+    if (is(0x37, 0, 0) && rd != 0 && rd != 2 && imm && (imm >> 12) >= -32 && (imm >> 12) < 32)
+        return 0x6001 | rd << 7 | imm6(imm >> 12);                                                    // c.lui
+    if (is(0x33, 0, 0x00) && rd != 0) {                                                               // add
+        if (rs1 == 0 && rs2 != 0) return 0x8002 | rd << 7 | rs2 << 2;                                 // c.mv
+        if (rd == rs1 && rs2 != 0) return 0x9002 | rd << 7 | rs2 << 2;                                // c.add
+        if (rd == rs2 && rs1 != 0) return 0x9002 | rd << 7 | rs1 << 2;
+        return 0;
+    }
+    if (d.opcode == 0x33 && compact(rd) && compact(rs1) && compact(rs2)) {
+        uint32_t op = is(0x33, 0, 0x20) ? 0 : is(0x33, 4, 0x00) ? 1 : is(0x33, 6, 0x00) ? 2 : is(0x33, 7, 0x00) ? 3 : 4;
+        bool commutes = op != 0;
+        if (op < 4 && (rd == rs1 || (commutes && rd == rs2)))                                         // c.sub/xor/or/and
+            return 0x8C01 | (rd - 8) << 7 | op << 5 | ((rd == rs1 ? rs2 : rs1) - 8) << 2;
+        return 0;
+    }
+    if (is(0x03, 2, 0) && imm >= 0 && imm % 4 == 0) {                                                 // lw
+        if (rs1 == 2 && rd != 0 && imm < 256) return 0x4002 | rd << 7 | (u >> 5 & 1) << 12 | (u >> 2 & 7) << 4 | (u >> 6 & 3) << 2;
+        if (compact(rd) && compact(rs1) && imm < 128) return 0x4000 | lw_imm(imm) | (rs1 - 8) << 7 | (rd - 8) << 2;
+        return 0;
+    }
+    if (is(0x23, 2, 0) && imm >= 0 && imm % 4 == 0) {                                                 // sw
+        if (rs1 == 2 && imm < 256) return 0xC002 | (u >> 2 & 0xF) << 9 | (u >> 6 & 3) << 7 | rs2 << 2;
+        if (compact(rs2) && compact(rs1) && imm < 128) return 0xC000 | lw_imm(imm) | (rs1 - 8) << 7 | (rs2 - 8) << 2;
+        return 0;
+    }
+    if (is(0x6F, 0, 0) && (rd == 0 || rd == 1) && imm >= -2048 && imm < 2048)                        // c.j, c.jal
+        return (rd ? 0x2001 : 0xA001) | (u >> 11 & 1) << 12 | (u >> 4 & 1) << 11 | (u >> 8 & 3) << 9 | (u >> 10 & 1) << 8 |
+               (u >> 6 & 1) << 7 | (u >> 7 & 1) << 6 | (u >> 1 & 7) << 3 | (u >> 5 & 1) << 2;
+    if (is(0x67, 0, 0) && imm == 0 && rs1 != 0 && (rd == 0 || rd == 1))                              // c.jr, c.jalr
+        return (rd ? 0x9002 : 0x8002) | rs1 << 7;
+    if ((is(0x63, 0, 0) || is(0x63, 1, 0)) && (rs1 == 0) != (rs2 == 0) && compact(rs1 | rs2) &&
+        imm >= -256 && imm < 256) {                                                                   // c.beqz, c.bnez
+        return (d.func3 ? 0xE001 : 0xC001) | (u >> 8 & 1) << 12 | (u >> 3 & 3) << 10 | ((rs1 | rs2) - 8) << 7 |
+               (u >> 6 & 3) << 5 | (u >> 1 & 3) << 3 | (u >> 5 & 1) << 2;
+    }
+    return 0;
+}
+
+// encodings as listed by GNU objdump
+static_assert(expand_instruction(0x0505) == 0x00150513, "c.addi a0, 1");
+static_assert(expand_instruction(0x4501) == 0x00000513, "c.li a0, 0");
+static_assert(expand_instruction(0x8522) == 0x00800533, "c.mv a0, s0");
+static_assert(expand_instruction(0x8082) == 0x00008067, "c.jr ra");
+static_assert(expand_instruction(0x1141) == 0xFF010113, "c.addi16sp sp, -16");
+static_assert(expand_instruction(0xC606) == 0x00112623, "c.swsp ra, 12(sp)");
+static_assert(expand_instruction(0x40B2) == 0x00C12083, "c.lwsp ra, 12(sp)");
+static_assert(expand_instruction(0x0800) == 0x01010413, "c.addi4spn s0, sp, 16");
+static_assert(expand_instruction(0x4108) == 0x00052503, "c.lw a0, 0(a0)");
+static_assert(expand_instruction(0x050A) == 0x00251513, "c.slli a0, 2");
+static_assert(expand_instruction(0x8385) == 0x0017D793, "c.srli a5, 1");
+static_assert(expand_instruction(0x8D0D) == 0x40B50533, "c.sub a0, a1");
+static_assert(expand_instruction(0x6785) == 0x000017B7, "c.lui a5, 1");
+static_assert(expand_instruction(0x952E) == 0x00B50533, "c.add a0, a1");
+static_assert(expand_instruction(0x9782) == 0x000780E7, "c.jalr a5");
+static_assert(compress_instruction(0xFF010113) == 0x1141 && compress_instruction(0x00112623) == 0xC606 &&
+              compress_instruction(0x00C12083) == 0x40B2 && compress_instruction(0x01010413) == 0x0800, "stack frame");
+static_assert(compress_instruction(0x40B50533) == 0x8D0D && compress_instruction(0x00B50533) == 0x952E, "c.sub, c.add");
+static_assert(compress_instruction(0x02B50533) == 0 && compress_instruction(0x40B54533) == 0, "mul and xnor have no 16-bit form");
+
+#endif
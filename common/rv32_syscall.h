@@ -0,0 +1,152 @@
+// System calls of the Phase2 simulator and both Phase 3 engines, in the style
+// of a proxy kernel: an ecall passes the call number in a7 and its arguments
+// in a0-a2, as on RISC-V Linux, and gets the result, or a negative errno, back
+// in a0. Guest file descriptors stand for host ones: 0-2 are the simulator's
+// stdin, stdout and stderr unless the engine redirects them, and openat opens
+// host files relative to the working directory.
+//
+// An ecall whose a7 is no call listed here ends the run. The Phase 3 engines
+// stopped at every ecall before there were system calls, so programs there that
+// end in a bare ecall still work. Phase2 used to run straight past an ecall; it
+// now makes the call, and stops at one whose a7 is unknown.
+#ifndef RV32_SYSCALL_H
+#define RV32_SYSCALL_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+enum SyscallNumber : uint32_t {
+    SYSCALL_OPENAT = 56,
+    SYSCALL_CLOSE = 57,
+    SYSCALL_READ = 63,
+    SYSCALL_WRITE = 64,
+    SYSCALL_EXIT = 93,
+    SYSCALL_EXIT_GROUP = 94,
+    SYSCALL_CLOCK_GETTIME = 113,
+    SYSCALL_GETTIMEOFDAY = 169,
+    SYSCALL_BRK = 214,
+    SYSCALL_GETRANDOM = 278,
+    SYSCALL_CLOCK_GETTIME64 = 403,
+};
+
+constexpr uint32_t SYSCALL_MAX_TRANSFER = 1u << 20;   // bytes one read, write or getrandom moves at most
+constexpr uint32_t SYSCALL_MAX_PATH = 4096;
+
+// open flags of RISC-V Linux, which openat translates for the host
+constexpr uint32_t GUEST_O_ACCMODE = 3, GUEST_O_CREAT = 0x40, GUEST_O_EXCL = 0x80, GUEST_O_TRUNC = 0x200,
+                   GUEST_O_APPEND = 0x400;
+
+struct SyscallState {
+    std::vector<int> host_fd = {0, 1, 2};  // by guest fd, -1 once closed
+    uint32_t brk_start = 0, brk = 0;       // the heap: set by the engine above the loaded data
+    unsigned long long clock_hz = 1000000000;   // simulated time is cycles at this rate
+    std::mt19937 random{0};                // getrandom is seeded, so that runs repeat
+    unsigned long long calls = 0;
+    bool exited = false;                   // exit or exit_group ended the run
+    int exit_code = 0;
+};
+
+// Runs the call of an ecall on the registers x0-x31 in x, once every older
+// instruction has written back. load(addr, size) and store(addr, size, value)
+// access guest memory, cycles is the simulated time so far. Returns false if
+// the run ends here: an exit call, or an a7 that names no call.
+template <class Load, class Store>
+bool syscall_execute(SyscallState &s, uint32_t *x, unsigned long long cycles, Load load, Store store) {
+    uint32_t a0 = x[10], a1 = x[11], a2 = x[12];
+    auto host = [&](uint32_t fd) { return fd < s.host_fd.size() ? s.host_fd[fd] : -1; };
+    auto store64 = [&](uint32_t addr, unsigned long long value) {
+        store(addr, 4, (uint32_t)value);
+        store(addr + 4, 4, (uint32_t)(value >> 32));
+    };
+    int64_t result;
+    switch (x[17]) {
+    case SYSCALL_OPENAT: {                 // openat(dirfd, path, flags, mode); dirfd is ignored
+        std::vector<char> path;
+        for (uint32_t i = 0; i < SYSCALL_MAX_PATH && (path.empty() || path.back()); ++i) path.push_back((char)load(a1 + i, 1));
+        if (path.back()) {
+            result = -ENAMETOOLONG;
+            break;
+        }
+        int access = (a2 & GUEST_O_ACCMODE) == 1 ? O_WRONLY : (a2 & GUEST_O_ACCMODE) == 2 ? O_RDWR : O_RDONLY;
+        int flags = access | ((a2 & GUEST_O_CREAT) ? O_CREAT : 0) | ((a2 & GUEST_O_EXCL) ? O_EXCL : 0) |
+                    ((a2 & GUEST_O_TRUNC) ? O_TRUNC : 0) | ((a2 & GUEST_O_APPEND) ? O_APPEND : 0);
+        int fd = open(path.data(), flags, x[13] & 0777);
+        if (fd < 0) {
+            result = -errno;
+            break;
+        }
+        auto slot = std::find(s.host_fd.begin(), s.host_fd.end(), -1);
+        result = slot - s.host_fd.begin();
+        if (slot == s.host_fd.end()) s.host_fd.push_back(fd);
+        else *slot = fd;
+        break;
+    }
+    case SYSCALL_CLOSE: {
+        int fd = host(a0);
+        result = fd < 0 ? -EBADF : 0;
+        if (fd > 2) close(fd);             // the simulator's own stdin/stdout/stderr stay open
+        if (fd >= 0) s.host_fd[a0] = -1;
+        break;
+    }
+    case SYSCALL_READ: {                   // read(fd, buf, count)
+        int fd = host(a0);
+        std::vector<uint8_t> buffer(std::min(a2, SYSCALL_MAX_TRANSFER));
+        ssize_t n = fd < 0 ? -1 : read(fd, buffer.data(), buffer.size());
+        result = fd < 0 ? -EBADF : n < 0 ? -errno : n;
+        for (ssize_t i = 0; i < n; ++i) store(a1 + i, 1, buffer[i]);
+        break;
+    }
+    case SYSCALL_WRITE: {                  // write(fd, buf, count)
+        int fd = host(a0);
+        std::vector<uint8_t> buffer(std::min(a2, SYSCALL_MAX_TRANSFER));
+        for (uint32_t i = 0; i < buffer.size(); ++i) buffer[i] = (uint8_t)load(a1 + i, 1);
+        if (fd == 1 || fd == 2) fflush(nullptr);   // after what the simulator printed so far
+        ssize_t n = fd < 0 ? -1 : write(fd, buffer.data(), buffer.size());
+        result = fd < 0 ? -EBADF : n < 0 ? -errno : n;
+        break;
+    }
+    case SYSCALL_EXIT:
+    case SYSCALL_EXIT_GROUP:
+        s.calls++;
+        s.exited = true;
+        s.exit_code = (int32_t)a0;
+        return false;
+    case SYSCALL_CLOCK_GETTIME:            // clock_gettime(clock, timespec *): every clock is simulated time,
+    case SYSCALL_CLOCK_GETTIME64:          // written as a 64-bit tv_sec and tv_nsec
+    case SYSCALL_GETTIMEOFDAY: {           // gettimeofday(timeval *, timezone *), tv_usec 64-bit as well
+        unsigned long long seconds = cycles / s.clock_hz, rest = cycles % s.clock_hz;
+        bool timeval = x[17] == SYSCALL_GETTIMEOFDAY;
+        uint32_t addr = timeval ? a0 : a1;
+        if (addr) {
+            store64(addr, seconds);
+            store64(addr + 8, rest * (timeval ? 1000000 : 1000000000) / s.clock_hz);
+        }
+        result = 0;
+        break;
+    }
+    case SYSCALL_BRK:                      // brk(addr): a break outside the heap leaves it unchanged
+        if (a0 >= s.brk_start && a0 < x[2]) s.brk = a0;
+        result = s.brk;
+        break;
+    case SYSCALL_GETRANDOM: {              // getrandom(buf, count, flags)
+        uint32_t n = std::min(a1, SYSCALL_MAX_TRANSFER);
+        for (uint32_t i = 0; i < n; ++i) store(a0 + i, 1, s.random() & 0xFF);
+        result = n;
+        break;
+    }
+    default:
+        return false;
+    }
+    s.calls++;
+    x[10] = (uint32_t)result;
+    return true;
+}
+
+#endif
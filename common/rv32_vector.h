@@ -0,0 +1,294 @@
+// RVV subset shared by the Phase2 simulator and both Phase 3 engines: the
+// vector register file, the host kernels that do the element arithmetic and
+// the semantics of the INSTR_VECTOR entries of instruction_table.
+//
+// Only LMUL = 1 and SEW of 8, 16 and 32 bits are supported, loads and stores
+// need EEW = SEW, every instruction is unmasked and the tail elements are left
+// undisturbed. The element-wise kernels come as plain C++ and, on x86 hosts,
+// as SSE4.1 and AVX2 versions; vector_kernels() picks one at run time from
+// what the host CPU reports through CPUID.
+#ifndef RV32_VECTOR_H
+#define RV32_VECTOR_H
+
+#include "rv32_isa.h"
+
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RV32_VECTOR_X86 1
+#endif
+
+constexpr uint32_t VLEN_MAX = 4096;            // bits; the largest --vlen
+constexpr uint32_t VTYPE_VILL = 0x80000000;    // vtype after a vsetvli this unit does not support
+
+// vd = vs2 op operand, element-wise over n elements. operand is vs1 or a
+// scalar broadcast to n elements. vd may be either source.
+typedef void (*VectorBinaryKernel)(uint8_t *vd, const uint8_t *vs2, const uint8_t *operand, uint32_t n);
+// acc op vs2[0] op ... op vs2[n - 1]
+typedef uint32_t (*VectorReduceKernel)(const uint8_t *vs2, uint32_t n, uint32_t acc);
+
+// one kernel per element-wise VectorOp and SEW, indexed by log2(SEW / 8);
+// reduce is only used for the operations of the vred*.vs instructions
+struct VectorKernels {
+    const char *name;
+    VectorBinaryKernel binary[NUM_VECTOR_ALU_OPS][3];
+    VectorReduceKernel reduce[NUM_VECTOR_ALU_OPS][3];
+};
+
+template <int OP, class T>
+inline T vector_op(T a, T b) {
+    typedef typename std::make_signed<T>::type S;
+    switch (OP) {
+    case VOP_ADD:  return (T)(a + b);
+    case VOP_SUB:  return (T)(a - b);
+    case VOP_AND:  return a & b;
+    case VOP_OR:   return a | b;
+    case VOP_XOR:  return a ^ b;
+    case VOP_MUL:  return (T)((uint32_t)a * b);   // no promotion to a signed int that could overflow
+    case VOP_MINU: return a < b ? a : b;
+    case VOP_MIN:  return (S)a < (S)b ? a : b;
+    case VOP_MAXU: return a > b ? a : b;
+    case VOP_MAX:  return (S)a > (S)b ? a : b;
+    default:       return b;                      // VOP_MOVE
+    }
+}
+
+// registers are byte arrays with element i at byte i * SEW / 8, little-endian
+struct VectorScalarKernels {
+    template <int OP, class T>
+    static void binary(uint8_t *vd, const uint8_t *vs2, const uint8_t *operand, uint32_t n) {
+        for (uint32_t i = 0; i < n * sizeof(T); i += sizeof(T)) {
+            T a, b;
+            memcpy(&a, vs2 + i, sizeof a);
+            memcpy(&b, operand + i, sizeof b);
+            a = vector_op<OP, T>(a, b);
+            memcpy(vd + i, &a, sizeof a);
+        }
+    }
+    template <int OP, class T>
+    static uint32_t reduce(const uint8_t *vs2, uint32_t n, uint32_t acc) {
+        T r = (T)acc;
+        for (uint32_t i = 0; i < n * sizeof(T); i += sizeof(T)) {
+            T a;
+            memcpy(&a, vs2 + i, sizeof a);
+            r = vector_op<OP, T>(r, a);
+        }
+        return r;
+    }
+};
+
+#ifdef RV32_VECTOR_X86
+// SSE2 has no 8-bit multiply: multiply the even and the odd bytes as 16-bit lanes
+__attribute__((target("sse4.1"))) inline __m128i vector_mul8_sse(__m128i a, __m128i b) {
+    __m128i even = _mm_mullo_epi16(a, b);
+    __m128i odd = _mm_mullo_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    return _mm_or_si128(_mm_and_si128(even, _mm_set1_epi16(0xFF)), _mm_slli_epi16(odd, 8));
+}
+
+__attribute__((target("avx2"))) inline __m256i vector_mul8_avx2(__m256i a, __m256i b) {
+    __m256i even = _mm256_mullo_epi16(a, b);
+    __m256i odd = _mm256_mullo_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+    return _mm256_or_si256(_mm256_and_si256(even, _mm256_set1_epi16(0xFF)), _mm256_slli_epi16(odd, 8));
+}
+
+// 16 bytes at a time; the remainder goes to the scalar kernels
+struct VectorSSE41Kernels {
+    template <int OP, class T>
+    __attribute__((target("sse4.1"))) static __m128i op(__m128i a, __m128i b) {
+        constexpr int W = sizeof(T);
+        switch (OP) {
+        case VOP_ADD:  return W == 1 ? _mm_add_epi8(a, b) : W == 2 ? _mm_add_epi16(a, b) : _mm_add_epi32(a, b);
+        case VOP_SUB:  return W == 1 ? _mm_sub_epi8(a, b) : W == 2 ? _mm_sub_epi16(a, b) : _mm_sub_epi32(a, b);
+        case VOP_AND:  return _mm_and_si128(a, b);
+        case VOP_OR:   return _mm_or_si128(a, b);
+        case VOP_XOR:  return _mm_xor_si128(a, b);
+        case VOP_MUL:  return W == 1 ? vector_mul8_sse(a, b) : W == 2 ? _mm_mullo_epi16(a, b) : _mm_mullo_epi32(a, b);
+        case VOP_MINU: return W == 1 ? _mm_min_epu8(a, b) : W == 2 ? _mm_min_epu16(a, b) : _mm_min_epu32(a, b);
+        case VOP_MIN:  return W == 1 ? _mm_min_epi8(a, b) : W == 2 ? _mm_min_epi16(a, b) : _mm_min_epi32(a, b);
+        case VOP_MAXU: return W == 1 ? _mm_max_epu8(a, b) : W == 2 ? _mm_max_epu16(a, b) : _mm_max_epu32(a, b);
+        case VOP_MAX:  return W == 1 ? _mm_max_epi8(a, b) : W == 2 ? _mm_max_epi16(a, b) : _mm_max_epi32(a, b);
+        default:       return b;
+        }
+    }
+    template <int OP, class T>
+    __attribute__((target("sse4.1"))) static void binary(uint8_t *vd, const uint8_t *vs2, const uint8_t *operand, uint32_t n) {
+        uint32_t bytes = n * sizeof(T), i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(vs2 + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(operand + i));
+            _mm_storeu_si128((__m128i *)(vd + i), op<OP, T>(a, b));
+        }
+        VectorScalarKernels::binary<OP, T>(vd + i, vs2 + i, operand + i, (bytes - i) / sizeof(T));
+    }
+    // the lanes are combined in a different order than one by one, which the
+    // wrapping add and multiply and the bitwise and min/max operations allow
+    template <int OP, class T>
+    __attribute__((target("sse4.1"))) static uint32_t reduce(const uint8_t *vs2, uint32_t n, uint32_t acc) {
+        uint32_t bytes = n * sizeof(T), i = 0;
+        if (bytes >= 16) {
+            __m128i lanes = _mm_loadu_si128((const __m128i *)vs2);
+            for (i = 16; i + 16 <= bytes; i += 16) lanes = op<OP, T>(lanes, _mm_loadu_si128((const __m128i *)(vs2 + i)));
+            alignas(16) uint8_t spill[16];
+            _mm_store_si128((__m128i *)spill, lanes);
+            acc = VectorScalarKernels::reduce<OP, T>(spill, 16 / sizeof(T), acc);
+        }
+        return VectorScalarKernels::reduce<OP, T>(vs2 + i, (bytes - i) / sizeof(T), acc);
+    }
+};
+
+// 32 bytes at a time; the remainder goes to the SSE4.1 kernels
+struct VectorAVX2Kernels {
+    template <int OP, class T>
+    __attribute__((target("avx2"))) static __m256i op(__m256i a, __m256i b) {
+        constexpr int W = sizeof(T);
+        switch (OP) {
+        case VOP_ADD:  return W == 1 ? _mm256_add_epi8(a, b) : W == 2 ? _mm256_add_epi16(a, b) : _mm256_add_epi32(a, b);
+        case VOP_SUB:  return W == 1 ? _mm256_sub_epi8(a, b) : W == 2 ? _mm256_sub_epi16(a, b) : _mm256_sub_epi32(a, b);
+        case VOP_AND:  return _mm256_and_si256(a, b);
+        case VOP_OR:   return _mm256_or_si256(a, b);
+        case VOP_XOR:  return _mm256_xor_si256(a, b);
+        case VOP_MUL:  return W == 1 ? vector_mul8_avx2(a, b) : W == 2 ? _mm256_mullo_epi16(a, b) : _mm256_mullo_epi32(a, b);
+        case VOP_MINU: return W == 1 ? _mm256_min_epu8(a, b) : W == 2 ? _mm256_min_epu16(a, b) : _mm256_min_epu32(a, b);
+        case VOP_MIN:  return W == 1 ? _mm256_min_epi8(a, b) : W == 2 ? _mm256_min_epi16(a, b) : _mm256_min_epi32(a, b);
+        case VOP_MAXU: return W == 1 ? _mm256_max_epu8(a, b) : W == 2 ? _mm256_max_epu16(a, b) : _mm256_max_epu32(a, b);
+        case VOP_MAX:  return W == 1 ? _mm256_max_epi8(a, b) : W == 2 ? _mm256_max_epi16(a, b) : _mm256_max_epi32(a, b);
+        default:       return b;
+        }
+    }
+    template <int OP, class T>
+    __attribute__((target("avx2"))) static void binary(uint8_t *vd, const uint8_t *vs2, const uint8_t *operand, uint32_t n) {
+        uint32_t bytes = n * sizeof(T), i = 0;
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(vs2 + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(operand + i));
+            _mm256_storeu_si256((__m256i *)(vd + i), op<OP, T>(a, b));
+        }
+        VectorSSE41Kernels::binary<OP, T>(vd + i, vs2 + i, operand + i, (bytes - i) / sizeof(T));
+    }
+    template <int OP, class T>
+    __attribute__((target("avx2"))) static uint32_t reduce(const uint8_t *vs2, uint32_t n, uint32_t acc) {
+        uint32_t bytes = n * sizeof(T), i = 0;
+        if (bytes >= 32) {
+            __m256i lanes = _mm256_loadu_si256((const __m256i *)vs2);
+            for (i = 32; i + 32 <= bytes; i += 32) lanes = op<OP, T>(lanes, _mm256_loadu_si256((const __m256i *)(vs2 + i)));
+            alignas(32) uint8_t spill[32];
+            _mm256_store_si256((__m256i *)spill, lanes);
+            acc = VectorScalarKernels::reduce<OP, T>(spill, 32 / sizeof(T), acc);
+        }
+        return VectorSSE41Kernels::reduce<OP, T>(vs2 + i, (bytes - i) / sizeof(T), acc);
+    }
+};
+#endif
+
+template <class K, size_t... OP>
+VectorKernels make_vector_kernels(const char *name, std::index_sequence<OP...>) {
+    return {name,
+            {{K::template binary<OP, uint8_t>, K::template binary<OP, uint16_t>, K::template binary<OP, uint32_t>}...},
+            {{K::template reduce<OP, uint8_t>, K::template reduce<OP, uint16_t>, K::template reduce<OP, uint32_t>}...}};
+}
+
+// The kernels called name ("scalar", "sse4.1" or "avx2"), or the widest the
+// host supports for a null name. nullptr if the name is unknown or the host
+// CPU lacks the instructions.
+inline const VectorKernels *vector_kernels(const char *name) {
+    typedef std::make_index_sequence<NUM_VECTOR_ALU_OPS> Ops;
+    static const VectorKernels scalar = make_vector_kernels<VectorScalarKernels>("scalar", Ops());
+#ifdef RV32_VECTOR_X86
+    __builtin_cpu_init();   // may run before main, from the initializer of a VectorUnit
+    static const VectorKernels sse41 = make_vector_kernels<VectorSSE41Kernels>("sse4.1", Ops());
+    static const VectorKernels avx2 = make_vector_kernels<VectorAVX2Kernels>("avx2", Ops());
+    bool has_avx2 = __builtin_cpu_supports("avx2"), has_sse41 = __builtin_cpu_supports("sse4.1");
+    if (!name) return has_avx2 ? &avx2 : has_sse41 ? &sse41 : &scalar;
+    if (!strcmp(name, "avx2")) return has_avx2 ? &avx2 : nullptr;
+    if (!strcmp(name, "sse4.1")) return has_sse41 ? &sse41 : nullptr;
+#endif
+    return !name || !strcmp(name, "scalar") ? &scalar : nullptr;
+}
+
+struct VectorUnit {
+    uint32_t vlen = 128;                   // bits per register
+    uint32_t vl = 0;
+    uint32_t vtype = VTYPE_VILL;
+    unsigned long long elements = 0;       // elements processed so far
+    const VectorKernels *kernels = vector_kernels(nullptr);
+    alignas(32) uint8_t reg[32][VLEN_MAX / 8];
+    alignas(32) uint8_t broadcast[VLEN_MAX / 8];   // the scalar operand of .vx and .vi forms
+
+    uint32_t sew_bytes() const { return 1u << ((vtype >> 3) & 7); }
+};
+
+// Runs an INSTR_VECTOR instruction. x1 and x2 are the integer registers rs1
+// and rs2 name (base and stride of a memory access, the scalar of .vx forms).
+// load(addr, size) and store(addr, size, value) access guest memory. Returns
+// the value of an integer rd: the new vl of vsetvli, element 0 of vmv.x.s.
+template <class Load, class Store>
+uint32_t vector_execute(VectorUnit &v, const DecodedInstr &instr, uint32_t x1, uint32_t x2, Load load, Store store) {
+    const InstrDesc &d = *instr.desc;
+    if (d.vop == VOP_SETVL) {
+        uint32_t vtype = (uint32_t)instr.imm, vsew = (vtype >> 3) & 7;
+        bool supported = !(vtype & ~0xFFu) && (vtype & 7) == 0 && vsew <= 2;   // LMUL = 1, SEW up to 32
+        uint32_t vlmax = supported ? v.vlen >> (3 + vsew) : 0;
+        uint32_t avl = instr.rs1 ? x1 : instr.rd ? UINT32_MAX : v.vl;
+        v.vtype = supported ? vtype : VTYPE_VILL;
+        v.vl = avl < vlmax ? avl : vlmax;
+        return v.vl;
+    }
+    if (v.vtype & VTYPE_VILL) return 0;
+
+    uint32_t sew = v.sew_bytes(), log_sew = (v.vtype >> 3) & 7, n = v.vl;
+    uint8_t *vd = v.reg[(instr.rd - VEC_REG) & 31];
+    switch (d.vop) {
+    case VOP_LOAD:
+    case VOP_STORE: {
+        if (d.mem_size != sew) return 0;
+        uint32_t stride = (d.flags & READS_RS2) ? x2 : sew;
+        uint8_t *data = d.vop == VOP_LOAD ? vd : v.reg[instr.rs3 - VEC_REG];
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t value = 0;
+            if (d.vop == VOP_LOAD) {
+                value = load(x1 + i * stride, sew);
+                memcpy(data + i * sew, &value, sew);
+            } else {
+                memcpy(&value, data + i * sew, sew);
+                store(x1 + i * stride, sew, value);
+            }
+        }
+        break;
+    }
+    case VOP_MOVE_X_S: {
+        uint32_t value = 0;
+        memcpy(&value, v.reg[instr.rs2 - VEC_REG], sew);
+        v.elements++;
+        return sew == 4 ? value : sew == 2 ? (uint32_t)(int16_t)value : (uint32_t)(int8_t)value;
+    }
+    case VOP_MOVE_S_X:
+        if (n) memcpy(vd, &x1, sew);
+        n = n ? 1 : 0;
+        break;
+    default: {
+        const uint8_t *operand = v.broadcast;
+        if (d.flags & VEC_RS1) {
+            operand = v.reg[instr.rs1 - VEC_REG];
+        } else {
+            uint32_t scalar = (d.flags & READS_RS1) ? x1 : (uint32_t)instr.imm;
+            for (uint32_t i = 0; i < n * sew; i += sew) memcpy(v.broadcast + i, &scalar, sew);
+        }
+        const uint8_t *vs2 = (d.flags & READS_RS2) ? v.reg[instr.rs2 - VEC_REG] : operand;
+        if (d.flags & VEC_REDUCE) {
+            if (!n) break;
+            uint32_t acc = 0;
+            memcpy(&acc, operand, sew);
+            acc = v.kernels->reduce[d.vop][log_sew](vs2, n, acc);
+            memcpy(vd, &acc, sew);
+        } else {
+            v.kernels->binary[d.vop][log_sew](vd, vs2, operand, n);
+        }
+    }
+    }
+    v.elements += n;
+    return 0;
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include<bits/stdc++.h>
+#include "../common/rv32_isa.h"
 using namespace std;
 
 //variables for address of instructions in .text and variables in .data respectively
@@ -8,9 +9,6 @@ long long dataAddress = 0x10000000; //starting address of .data section
 //boolean for checking if we are in .data section
 bool dataMode = false;
 
-//maintaining the current program counter which will help in the calculation of offset for branch instructions
-long long currentPC= 0x0000000;
-
 //Maps for storing address corresponding to labels
 unordered_map <string , long long> labels;
 
@@ -20,169 +18,655 @@ unordered_map <string , long long> dataLabels;
 //vector to store all the variable of data section
 vector <pair <long long, string> > dataSegment;
 
-//struct to hold the instruction details
-struct Instruction{
-    string opcode;
-    string func3;
-    string func7;
-    string type;
+//ABI register names, indexed by register number
+constexpr const char *abiRegisterNames[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+constexpr const char *abiFpRegisterNames[32] = {
+    "ft0", "ft1", "ft2", "ft3", "ft4", "ft5", "ft6", "ft7",
+    "fs0", "fs1", "fa0", "fa1", "fa2", "fa3", "fa4", "fa5",
+    "fa6", "fa7", "fs2", "fs3", "fs4", "fs5", "fs6", "fs7",
+    "fs8", "fs9", "fs10", "fs11", "ft8", "ft9", "ft10", "ft11"
+};
+
+//rounding mode operands of the RV32F instructions, indexed by the value of the rm field
+constexpr const char *roundingModeNames[8] = {"rne", "rtz", "rdn", "rup", "rmm", "", "", "dyn"};
+
+//vtype operands of vsetvli, indexed by the value of the vsew and vlmul fields
+constexpr const char *vectorSewNames[4] = {"e8", "e16", "e32", "e64"};
+constexpr const char *vectorLmulNames[8] = {"m1", "m2", "m4", "m8", "", "mf8", "mf4", "mf2"};
+
+//CSR operands of the Zicsr instructions by name; hpmcounter3-31 and mhpmcounter3-31
+//(and their ...h upper halves) are recognized by csrNumber
+struct CsrName{
+    const char *name;
+    uint32_t number;
+};
+constexpr CsrName csrNames[] = {
+    {"fflags", CSR_FFLAGS}, {"frm", CSR_FRM}, {"fcsr", CSR_FCSR},
+    {"cycle", CSR_CYCLE}, {"time", CSR_TIME}, {"instret", CSR_INSTRET},
+    {"cycleh", CSR_CYCLE | CSR_HIGH}, {"timeh", CSR_TIME | CSR_HIGH}, {"instreth", CSR_INSTRET | CSR_HIGH},
+    {"mcycle", CSR_MCYCLE}, {"minstret", CSR_MINSTRET},
+    {"mcycleh", CSR_MCYCLE | CSR_HIGH}, {"minstreth", CSR_MINSTRET | CSR_HIGH}
 };
 
-string binaryToHex(string binCode){
-    string hexCode = "0x";
-    for(int i=0; i<binCode.size(); i+=4){
-        string hexDigit = binCode.substr(i, 4);
-        if(hexDigit == "0000") hexCode += "0";
-        else if(hexDigit == "0001") hexCode += "1";
-        else if(hexDigit == "0010") hexCode += "2";
-        else if(hexDigit == "0011") hexCode += "3";
-        else if(hexDigit == "0100") hexCode += "4";
-        else if(hexDigit == "0101") hexCode += "5";
-        else if(hexDigit == "0110") hexCode += "6";
-        else if(hexDigit == "0111") hexCode += "7";
-        else if(hexDigit == "1000") hexCode += "8";
-        else if(hexDigit == "1001") hexCode += "9";
-        else if(hexDigit == "1010") hexCode += "A";
-        else if(hexDigit == "1011") hexCode += "B";
-        else if(hexDigit == "1100") hexCode += "C";
-        else if(hexDigit == "1101") hexCode += "D";
-        else if(hexDigit == "1110") hexCode += "E";
-        else if(hexDigit == "1111") hexCode += "F";
-    }
-    return hexCode;
+//Zicsr pseudo-instructions and the instruction each stands for, %0 and %1 being its operands
+struct CsrPseudoInstruction{
+    const char *name;
+    const char *expansion;
+};
+constexpr CsrPseudoInstruction csrPseudoInstructions[] = {
+    {"rdcycle", "csrrs %0, cycle, x0"}, {"rdcycleh", "csrrs %0, cycleh, x0"},
+    {"rdtime", "csrrs %0, time, x0"}, {"rdtimeh", "csrrs %0, timeh, x0"},
+    {"rdinstret", "csrrs %0, instret, x0"}, {"rdinstreth", "csrrs %0, instreth, x0"},
+    {"csrr", "csrrs %0, %1, x0"}, {"csrw", "csrrw x0, %0, %1"},
+    {"csrs", "csrrs x0, %0, %1"}, {"csrc", "csrrc x0, %0, %1"},
+    {"csrwi", "csrrwi x0, %0, %1"}, {"csrsi", "csrrsi x0, %0, %1"}, {"csrci", "csrrci x0, %0, %1"},
+    {"frcsr", "csrrs %0, fcsr, x0"}, {"fscsr", "csrrw x0, fcsr, %0"},
+    {"frrm", "csrrs %0, frm, x0"}, {"fsrm", "csrrw x0, frm, %0"},
+    {"frflags", "csrrs %0, fflags, x0"}, {"fsflags", "csrrw x0, fflags, %0"}
+};
+
+//register number for x0-x31, an ABI name or fp; -1 if the name is not a register
+int registerNumber(const string &name){
+    if(name.size() >= 2 && name.size() <= 3 && name[0] == 'x' && isdigit(name[1])){
+        if(name.size() == 3 && (name[1] == '0' || !isdigit(name[2]))) return -1;
+        int number = stoi(name.substr(1));
+        return number < 32 ? number : -1;
+    }
+    if(name == "fp") return 8;
+    for(int i=0; i<32; i++){
+        if(name == abiRegisterNames[i]) return i;
+    }
+    return -1;
+}
+
+//register number for v0-v31; -1 if the name is not a v-register
+int vectorRegisterNumber(const string &name){
+    if(name.size() >= 2 && name.size() <= 3 && name[0] == 'v' && isdigit(name[1])){
+        if(name.size() == 3 && (name[1] == '0' || !isdigit(name[2]))) return -1;
+        int number = stoi(name.substr(1));
+        return number < 32 ? number : -1;
+    }
+    return -1;
+}
+
+//the same for an f-register (f0-f31 or an ABI name) when fp is set
+int registerNumber(const string &name, bool fp){
+    if(!fp) return registerNumber(name);
+    if(name.size() >= 2 && name.size() <= 3 && name[0] == 'f' && isdigit(name[1])){
+        if(name.size() == 3 && (name[1] == '0' || !isdigit(name[2]))) return -1;
+        int number = stoi(name.substr(1));
+        return number < 32 ? number : -1;
+    }
+    for(int i=0; i<32; i++){
+        if(name == abiFpRegisterNames[i]) return i;
+    }
+    return -1;
+}
+
+//CSR number for a CSR name or a number 0-4095; -1 otherwise
+int csrNumber(const string &name){
+    for(const CsrName &csr:csrNames){
+        if(name == csr.name) return csr.number;
+    }
+    size_t prefix = name.compare(0, 10, "hpmcounter") == 0 ? 10 : name.compare(0, 11, "mhpmcounter") == 0 ? 11 : 0;
+    if(prefix){
+        string digits = name.substr(prefix);
+        bool high = !digits.empty() && digits.back() == 'h';
+        if(high) digits.pop_back();
+        if(digits.empty() || digits.size() > 2 || !all_of(digits.begin(), digits.end(), ::isdigit) || digits[0] == '0'){
+            return -1;
+        }
+        int counter = stoi(digits);
+        if(counter < 3 || counter > 31) return -1;
+        return (prefix == 10 ? CSR_HPMCOUNTER3 : CSR_MHPMCOUNTER3) + counter - 3 + (high ? CSR_HIGH : 0);
+    }
+    char *end;
+    long long number = strtoll(name.c_str(), &end, 0);
+    return (!name.empty() && isdigit(name[0]) && !*end && number <= 0xFFF) ? number : -1;
+}
+
+//"0x" followed by 8 uppercase hex digits, the form used for addresses and words in output.mc
+string hexWord(uint32_t value){
+    char buffer[11];
+    snprintf(buffer, sizeof(buffer), "0x%08X", value);
+    return buffer;
+}
 
+//the 32 bits of a word as '0'/'1' characters, most significant first
+string binaryWord(uint32_t value){
+    string bits(32, '0');
+    for(int i=0; i<32; i++){
+        if(value & (1u << (31 - i))) bits[i] = '1';
+    }
+    return bits;
+}
+
+//immediate fields of the instruction formats, already shifted into place in the word.
+//the linker patches a fixup by clearing the field's mask and or-ing in the new value
+constexpr uint32_t I_IMMEDIATE_MASK = 0xFFF00000;
+constexpr uint32_t S_IMMEDIATE_MASK = 0xFE000F80;
+constexpr uint32_t SB_IMMEDIATE_MASK = 0xFE000F80;
+constexpr uint32_t U_IMMEDIATE_MASK = 0xFFFFF000;
+constexpr uint32_t UJ_IMMEDIATE_MASK = 0xFFFFF000;
+uint32_t iImmediate(long long immediate){
+    return (uint32_t)(immediate & 0xFFF) << 20;
+}
+uint32_t sImmediate(long long immediate){
+    uint32_t imm = immediate & 0xFFF;
+    return (imm >> 5) << 25 | (imm & 0x1F) << 7;
+}
+uint32_t sbImmediate(long long offset){
+    uint32_t imm = offset & 0x1FFF;
+    return (imm >> 12) << 31 | ((imm >> 5) & 0x3F) << 25 | ((imm >> 1) & 0xF) << 8 | ((imm >> 11) & 1) << 7;
 }
+uint32_t uImmediate(long long immediate){
+    return (uint32_t)(immediate & 0xFFFFF) << 12;
+}
+uint32_t ujImmediate(long long offset){
+    uint32_t imm = offset & 0x1FFFFF;
+    return (imm >> 20) << 31 | ((imm >> 1) & 0x3FF) << 21 | ((imm >> 11) & 1) << 20 | ((imm >> 12) & 0xFF) << 12;
+}
+
+//result of encoding one line: the machine word, or an error message in its place
+struct Encoding{
+    uint32_t word;
+    const char *error;
+};
+
+//every error parseLine reports; object files store the index into this table
+constexpr const char *encodingErrors[] = {
+    "Invalid Instruction", "Label not found", "Immediate out of bound",
+    "Offset out of bound", "Invalid register", "Something went wrong",
+    "Invalid operands", "Invalid rounding mode", "Invalid CSR"
+};
+
+//one assembled .text line, kept for the binary image and object files
+struct EncodedLine{
+    long long address;
+    uint32_t word;
+    const char *error;      //nullptr if the line assembled
+    int lineNumber;
+    string source;
+};
+
+//a symbol reference left for the linker (-c): the immediate of the instruction at address,
+//relative to the object's .text, is filled in once the symbol has its final address.
+//branches and jal to labels of the same file are PC-relative and need no fixup, while
+//%hi/%lo operands always do, because the linker moves both .text and .data
+enum FixupKind{ FIXUP_SB, FIXUP_UJ, FIXUP_HI, FIXUP_LO };
+constexpr const char *fixupNames[] = {"sb", "uj", "hi", "lo"};
+struct Fixup{
+    long long address;
+    FixupKind kind;
+    string symbol;
+};
+
+//--schedule: the pipeline whose data stalls the scheduler minimizes, as in Phase 3
+enum ScheduleModel{ SCHEDULE_OFF, SCHEDULE_FORWARDING, SCHEDULE_NO_FORWARDING };
+
+//what the scheduler needs from an encoded instruction, decoded from the word with the
+//shared decoder that Phase 3's pipeline_decode uses (x0 is never a dependency)
+struct ScheduledOp{
+    int rd = 0, rs1 = 0, rs2 = 0, rs3 = 0;  //f-registers are FP_REG + 0-31, v-registers VEC_REG + 0-31
+    bool load = false, store = false;
+    bool loadUse = false;           //a scalar load, whose value reaches dependent instructions a cycle late
+    bool control = false;           //branch, jal, jalr, ecall: stays last in its block
+    bool barrier = false;           //never moved: auipc (reads its own pc), vsetvli, CSR accesses and lines with errors
+    int base = 0, size = 0;         //memory access: base register (-1: vector), offset and size in bytes
+    long long offset = 0;
+    bool relocated = false;         //the offset is a %lo fixup of an object file, unknown until the link
+};
+
+ScheduledOp scheduledOp(const Encoding &code){
+    ScheduledOp op;
+    uint32_t word = code.word, opcode = word & 0x7F;
+    if(code.error || opcode == 0x17){
+        op.barrier = true;
+        return op;
+    }
+    DecodedInstr instr = decode_instruction(word);
+    uint32_t flags = instr.desc->flags;
+    //every vector instruction after a vsetvli runs with its vl and vtype
+    if((flags & INSTR_VECTOR) && instr.desc->vop == VOP_SETVL){
+        op.barrier = true;
+        return op;
+    }
+    //a counter read times the instructions around it, and fcsr changes with FP instructions
+    if(flags & INSTR_CSR){
+        op.barrier = true;
+        return op;
+    }
+    op.rs1 = instr.rs1;
+    op.rs2 = instr.rs2;
+    op.rs3 = instr.rs3;
+    op.rd = instr.rd;
+    op.control = (flags & (INSTR_BRANCH | INSTR_JUMP | INSTR_ECALL)) != 0;
+    op.load = (flags & INSTR_LOAD) != 0;
+    op.store = (flags & INSTR_STORE) != 0;
+    if(op.load || op.store){
+        op.base = instr.rs1;
+        op.size = instr.desc->mem_size;
+        op.offset = instr.imm;
+    }
+    //the vector unit accesses memory in EX, over a range that depends on vl
+    if(flags & INSTR_VECTOR){
+        op.base = -1;
+    }
+    else{
+        op.loadUse = op.load;
+    }
+    return op;
+}
+
+//one chunk of the source for the parallel two-pass assembly; pass 1 addresses are
+//relative to the chunk until the prefix sum over the chunks gives its bases
+struct SourceChunk{
+    size_t begin = 0, end = 0;      //byte range of whole lines in the source
+    int firstLine = 1;
+    char lastSwitch = 0;            //'D' or 'T' if the chunk contains .data/.text
+    bool dataMode = false;          //mode at the current line of pass 1
+    long long textSize = 0, dataSize = 0;
+    long long textBase = 0, dataBase = 0;
+    vector<pair<string, long long> > textLabels, dataLabels;
+    vector<pair<long long, string> > data;
+    vector<string> lines;
+    vector<int> lineNumbers;
+    string messages;                //diagnostics from pass 1, printed in source order
+    string output;                  //output.mc lines from pass 2
+    vector<EncodedLine> encoded;
+    vector<pair<string, Encoding> > encodings;         //pass 2 encodings by cache key, for --watch
+    size_t cacheMisses = 0;
+    vector<Fixup> fixups;           //pass 2 symbol references of an object file
+    vector<unsigned char> sizes;    //--compress: bytes of each line, 2 or 4 (empty: all 4)
+};
+
+//layout of the compact binary image (.mcb), read by the Phase 3 simulator.
+//all fields are little-endian uint32; the *Offset fields are byte offsets from the start of the file
+struct McbHeader{
+    char magic[4];          //"\x7fMCB"
+    uint32_t version;
+    uint32_t entry;
+    uint32_t textRunsOffset, textRunCount;     //McbRun, payload is instruction words
+    uint32_t dataRunsOffset, dataRunCount;     //McbRun, payload is bytes
+    uint32_t symbolsOffset, symbolCount;       //McbSymbol
+    uint32_t linesOffset, lineCount;           //McbLine, one per instruction
+    uint32_t stringsOffset, stringsSize;       //NUL-terminated names and source lines
+};
+struct McbRun{ uint32_t address, size, payloadOffset; };
+struct McbSymbol{ uint32_t address, nameOffset, kind; };     //kind is 'T' or 'D'
+struct McbLine{ uint32_t address, lineNumber, textOffset; };
 
 //class RiscVAssembler to be worked on
 class RiscVAssembler{
 private:
-    //map to hold the register names with their binary values
-    unordered_map<string, string> registerMap = {
-        {"x0", "00000"},  {"zero", "00000"},
-        {"x1", "00001"},  {"ra", "00001"},
-        {"x2", "00010"},  {"sp", "00010"},
-        {"x3", "00011"},  {"gp", "00011"},
-        {"x4", "00100"},  {"tp", "00100"},
-        {"x5", "00101"},  {"t0", "00101"},
-        {"x6", "00110"},  {"t1", "00110"},
-        {"x7", "00111"},  {"t2", "00111"},
-        {"x8", "01000"},  {"s0", "01000"}, {"fp", "01000"},
-        {"x9", "01001"},  {"s1", "01001"},
-        {"x10", "01010"}, {"a0", "01010"},
-        {"x11", "01011"}, {"a1", "01011"},
-        {"x12", "01100"}, {"a2", "01100"},
-        {"x13", "01101"}, {"a3", "01101"},
-        {"x14", "01110"}, {"a4", "01110"},
-        {"x15", "01111"}, {"a5", "01111"},
-        {"x16", "10000"}, {"a6", "10000"},
-        {"x17", "10001"}, {"a7", "10001"},
-        {"x18", "10010"}, {"s2", "10010"},
-        {"x19", "10011"}, {"s3", "10011"},
-        {"x20", "10100"}, {"s4", "10100"},
-        {"x21", "10101"}, {"s5", "10101"},
-        {"x22", "10110"}, {"s6", "10110"},
-        {"x23", "10111"}, {"s7", "10111"},
-        {"x24", "11000"}, {"s8", "11000"},
-        {"x25", "11001"}, {"s9", "11001"},
-        {"x26", "11010"}, {"s10", "11010"},
-        {"x27", "11011"}, {"s11", "11011"},
-        {"x28", "11100"}, {"t3", "11100"},
-        {"x29", "11101"}, {"t4", "11101"},
-        {"x30", "11110"}, {"t5", "11110"},
-        {"x31", "11111"}, {"t6", "11111"}
-    };
-    
-
-    //map to hold different types of instructions
-    unordered_map<string, Instruction> instructionMap = {
-        // R-type instructions
-        {"add", {"0110011", "000", "0000000", "R"}},
-        {"and", {"0110011", "111", "0000000", "R"}},
-        {"or", {"0110011", "110", "0000000", "R"}},
-        {"sll", {"0110011", "001", "0000000", "R"}},
-        {"slt", {"0110011", "010", "0000000", "R"}},
-        {"sra", {"0110011", "101", "0100000", "R"}},
-        {"srl", {"0110011", "101", "0000000", "R"}},
-        {"sub", {"0110011", "000", "0100000", "R"}},
-        {"xor", {"0110011", "100", "0000000", "R"}},
-        {"mul", {"0110011", "000", "0000001", "R"}},
-        {"div", {"0110011", "100", "0000001", "R"}},
-        {"rem", {"0110011", "110", "0000001", "R"}},
-    
-        // I-type instructions
-        {"addi", {"0010011", "000", "", "I"}},
-        {"andi", {"0010011", "111", "", "I"}},
-        {"ori", {"0010011", "110", "", "I"}},
-        {"lb", {"0000011", "000", "", "I"}},
-        {"ld", {"0000011", "011", "", "I"}},
-        {"lh", {"0000011", "001", "", "I"}},
-        {"lw", {"0000011", "010", "", "I"}},
-        {"jalr", {"1100111", "000", "", "I"}},
-    
-        // S-type instructions (store)
-        {"sb", {"0100011", "000", "", "S"}},
-        {"sw", {"0100011", "010", "", "S"}},
-        {"sd", {"0100011", "011", "", "S"}},
-        {"sh", {"0100011", "001", "", "S"}},
-    
-        // SB-type instructions (branch)
-        {"beq", {"1100011", "000", "", "SB"}},
-        {"bne", {"1100011", "001", "", "SB"}},
-        {"bge", {"1100011", "101", "", "SB"}},
-        {"blt", {"1100011", "100", "", "SB"}},
-    
-        // U-type instructions
-        {"auipc", {"0010111", "", "", "U"}},
-        {"lui", {"0110111", "", "", "U"}},
-    
-        // UJ-type instructions
-        {"jal", {"1101111", "", "", "UJ"}}
-    };
+    //map from mnemonic to its entry in instruction_table (shared with the simulators)
+    unordered_map<string, const InstrDesc *> instructionMap = [](){
+        unordered_map<string, const InstrDesc *> table;
+        for(const InstrDesc &instr:instruction_table){
+            table[instr.name] = &instr;
+        }
+        return table;
+    }();
 
     //function for generating R-type instructions
-    string generateRType(const Instruction &instr, const string &rd, const string &rs1, const string &rs2){
-        return instr.func7 + registerMap[rs2] + registerMap[rs1] + instr.func3 + registerMap[rd] + instr.opcode;
+    Encoding generateRType(const InstrDesc &instr, const string &rd, const string &rs1, const string &rs2){
+        int d = registerNumber(rd), s1 = registerNumber(rs1), s2 = registerNumber(rs2);
+        if(d < 0 || s1 < 0 || s2 < 0){
+            return {0, "Invalid register"};
+        }
+        return {instr.func7 << 25 | s2 << 20 | s1 << 15 | instr.func3 << 12 | d << 7 | instr.opcode, nullptr};
     };
 
     //function for generating I-type instructions
-    string generateIType(const Instruction &instr, const string &rd, const string &rs1, const long long immediate){
+    Encoding generateIType(const InstrDesc &instr, const string &rd, const string &rs1, const long long immediate){
         //if immediate is out of bound then return error
         if(immediate < -2048 || immediate > 2047){
-            return "Immediate out of bound";
+            return {0, "Immediate out of bound"};
+        }
+        //slli/srli/srai: a 5-bit shift amount, with func7 in the upper immediate bits
+        if((instr.flags & MATCH_FUNC7) && (immediate < 0 || immediate > 31)){
+            return {0, "Immediate out of bound"};
         }
-        return bitset<12>(immediate).to_string() + registerMap[rs1] + instr.func3 + registerMap[rd] + instr.opcode;
+        int d = registerNumber(rd, instr.flags & FP_RD), s1 = registerNumber(rs1);
+        if(d < 0 || s1 < 0){
+            return {0, "Invalid register"};
+        }
+        return {instr.func7 << 25 | iImmediate(immediate) | s1 << 15 | instr.func3 << 12 | d << 7 | instr.opcode, nullptr};
     };
 
     //function for generating S-type instructions
-    string generateSType(const Instruction &instr, const string &rs1, const string &rs2, const long long offset){
+    Encoding generateSType(const InstrDesc &instr, const string &rs1, const string &rs2, const long long offset){
         //if offset is out of bound then return error
         if(offset < -2048 || offset > 2047){
-            return "Offset out of bound";
+            return {0, "Offset out of bound"};
+        }
+        int s1 = registerNumber(rs1), s2 = registerNumber(rs2, instr.flags & FP_RS2);
+        if(s1 < 0 || s2 < 0){
+            return {0, "Invalid register"};
+        }
+        return {sImmediate(offset) | s2 << 20 | s1 << 15 | instr.func3 << 12 | instr.opcode, nullptr};
+    };
+    //function for generating RV32F computational instructions: rd, rs1, rs2 and for the
+    //R4 format rs3, where the unary (MATCH_RS2) ones take only rd and rs1. A FUNC3_RM
+    //instruction takes an optional rounding mode last, dyn if there is none
+    Encoding generateFPType(const InstrDesc &instr, vector<string> operands){
+        size_t registers = instr.type == R4_TYPE ? 4 : (instr.flags & MATCH_RS2) ? 2 : 3;
+        uint32_t func3 = instr.func3;
+        if(instr.flags & FUNC3_RM){
+            func3 = RM_DYN;
+            if(operands.size() == registers + 1){
+                int mode = -1;
+                for(int i=0; i<8; i++){
+                    if(operands.back() == roundingModeNames[i]) mode = i;
+                }
+                if(mode < 0 || !*roundingModeNames[mode]){
+                    return {0, "Invalid rounding mode"};
+                }
+                func3 = mode;
+                operands.pop_back();
+            }
+        }
+        if(operands.size() != registers){
+            return {0, "Invalid operands"};
+        }
+        int d = registerNumber(operands[0], instr.flags & FP_RD), s1 = registerNumber(operands[1], instr.flags & FP_RS1);
+        int s2 = (instr.flags & MATCH_RS2) ? instr.rs2 : registerNumber(operands[2], instr.flags & FP_RS2);
+        int s3 = instr.type == R4_TYPE ? registerNumber(operands[3], true) : 0;
+        if(d < 0 || s1 < 0 || s2 < 0 || s3 < 0){
+            return {0, "Invalid register"};
+        }
+        uint32_t func7 = instr.type == R4_TYPE ? s3 << 2 : instr.func7;     //rs3, then fmt 00 (single)
+        return {func7 << 25 | s2 << 20 | s1 << 15 | func3 << 12 | d << 7 | instr.opcode, nullptr};
+    };
+    //function for generating RVV instructions, all unmasked:
+    //  vsetvli rd, rs1, e32[, m1][, ta|tu][, ma|mu]    (vtype defaults: m1, tu, mu)
+    //  vle32.v vd, (rs1)     vlse32.v vd, (rs1), rs2     vse32.v vs3, (rs1)     vsse32.v vs3, (rs1), rs2
+    //  vadd.vv vd, vs2, vs1  vadd.vx vd, vs2, rs1  vadd.vi vd, vs2, simm5  vredsum.vs vd, vs2, vs1
+    //  vmv.v.v vd, vs1  vmv.v.x vd, rs1  vmv.v.i vd, simm5  vmv.x.s rd, vs2  vmv.s.x vd, rs1
+    Encoding generateVType(const InstrDesc &instr, const vector<string> &operands){
+        if(instr.vop == VOP_SETVL){
+            if(operands.size() < 3){
+                return {0, "Invalid operands"};
+            }
+            int d = registerNumber(operands[0]), s1 = registerNumber(operands[1]);
+            if(d < 0 || s1 < 0){
+                return {0, "Invalid register"};
+            }
+            int sew = -1, lmul = 0, policy = 0;
+            for(size_t i=2; i<operands.size(); i++){
+                const string &field = operands[i];
+                int found = -1;
+                for(int j=0; j<4; j++){
+                    if(field == vectorSewNames[j]) sew = found = j;
+                }
+                for(int j=0; j<8; j++){
+                    if(*vectorLmulNames[j] && field == vectorLmulNames[j]) lmul = found = j;
+                }
+                if(field == "ta" || field == "ma") policy |= found = field == "ta" ? 0x40 : 0x80;
+                if(field == "tu" || field == "mu") found = 0;
+                if(found < 0){
+                    return {0, "Invalid operands"};
+                }
+            }
+            if(sew < 0){
+                return {0, "Invalid operands"};
+            }
+            uint32_t vtype = policy | sew << 3 | lmul;
+            return {vtype << 20 | s1 << 15 | instr.func3 << 12 | d << 7 | instr.opcode, nullptr};
+        }
+
+        bool memory = instr.flags & (INSTR_LOAD | INSTR_STORE);
+        bool source = (instr.flags & READS_RS1) || instr.func3 == 3;     //vs1, rs1 or the OPIVI immediate
+        size_t count = memory ? ((instr.flags & READS_RS2) ? 3 : 2) : 1 + !(instr.flags & MATCH_RS2) + source;
+        if(operands.size() != count){
+            return {0, "Invalid operands"};
+        }
+        int d = (instr.flags & (VEC_RD | VEC_RS3)) ? vectorRegisterNumber(operands[0]) : registerNumber(operands[0]);
+        int s1 = 0, s2 = (instr.flags & MATCH_RS2) ? instr.rs2 : 0;
+        if(memory){
+            //(rs1) or 0(rs1): vector accesses have no offset
+            const string &address = operands[1];
+            size_t open = address.find('(');
+            if(open == string::npos || address.back() != ')' || (open != 0 && address.substr(0, open) != "0")){
+                return {0, "Invalid operands"};
+            }
+            s1 = registerNumber(address.substr(open + 1, address.size() - open - 2));
+            if(instr.flags & READS_RS2) s2 = registerNumber(operands[2]);
+        }
+        else{
+            if(!(instr.flags & MATCH_RS2)) s2 = (instr.flags & VEC_RS2) ? vectorRegisterNumber(operands[1]) : registerNumber(operands[1]);
+            if(instr.flags & VEC_RS1){
+                s1 = vectorRegisterNumber(operands.back());
+            }
+            else if(instr.flags & READS_RS1){
+                s1 = registerNumber(operands.back());
+            }
+            else if(source){
+                char *end;
+                long long immediate = strtoll(operands.back().c_str(), &end, 0);
+                if(operands.back().empty() || *end){
+                    return {0, "Invalid operands"};
+                }
+                if(immediate < -16 || immediate > 15){
+                    return {0, "Immediate out of bound"};
+                }
+                s1 = immediate & 0x1F;
+            }
+        }
+        if(d < 0 || s1 < 0 || s2 < 0){
+            return {0, "Invalid register"};
+        }
+        return {instr.func7 << 25 | s2 << 20 | s1 << 15 | instr.func3 << 12 | d << 7 | instr.opcode, nullptr};
+    };
+
+    //function for generating Zicsr instructions: csrrw rd, csr, rs1 and csrrwi rd, csr, zimm,
+    //where csr is a name (cycle, mcycle, hpmcounter3, fcsr, ...) or a number
+    Encoding generateCSRType(const InstrDesc &instr, const vector<string> &operands){
+        if(operands.size() != 3){
+            return {0, "Invalid operands"};
+        }
+        int d = registerNumber(operands[0]), csr = csrNumber(operands[1]), source;
+        if(csr < 0){
+            return {0, "Invalid CSR"};
+        }
+        if(instr.flags & READS_RS1){
+            source = registerNumber(operands[2]);
+        }
+        else{
+            char *end;
+            long long immediate = strtoll(operands[2].c_str(), &end, 0);
+            if(operands[2].empty() || *end){
+                return {0, "Invalid operands"};
+            }
+            if(immediate < 0 || immediate > 31){
+                return {0, "Immediate out of bound"};
+            }
+            source = immediate;
         }
-        string offsetStr = bitset<12>(offset).to_string();
-        return offsetStr.substr(0, 7) + registerMap[rs2] + registerMap[rs1] + instr.func3 + offsetStr.substr(7,5) + instr.opcode;
+        if(d < 0 || source < 0){
+            return {0, "Invalid register"};
+        }
+        return {(uint32_t)csr << 20 | source << 15 | instr.func3 << 12 | d << 7 | instr.opcode, nullptr};
     };
-    string generateSBType(const Instruction &instr, const string &rs1, const string &rs2, const long long offset){
-        string imm = bitset<13>(offset).to_string();
-        return imm[0] + imm.substr(2,6) + registerMap[rs2] + registerMap[rs1] + instr.func3 + imm.substr(8,4) + imm[1] + instr.opcode; 
+
+    Encoding generateSBType(const InstrDesc &instr, const string &rs1, const string &rs2, const long long offset){
+        int s1 = registerNumber(rs1), s2 = registerNumber(rs2);
+        if(s1 < 0 || s2 < 0){
+            return {0, "Invalid register"};
+        }
+        return {sbImmediate(offset) | s2 << 20 | s1 << 15 | instr.func3 << 12 | instr.opcode, nullptr};
     };
-    string generateUType(const Instruction &instr, const string &rd, const long long immediate){
+    Encoding generateUType(const InstrDesc &instr, const string &rd, const long long immediate){
         //if immediate is out of bound then return error
         //immediate's lower bound is set to 0 because -ve mem address do not exist
         if(immediate < 0 || immediate > 1048575){
-            return "Immediate out of bound";
+            return {0, "Immediate out of bound"};
         }
-
-        return bitset<20>(immediate).to_string() + registerMap.at(rd) + instr.opcode;
+        int d = registerNumber(rd);
+        if(d < 0){
+            return {0, "Invalid register"};
+        }
+        return {uImmediate(immediate) | d << 7 | instr.opcode, nullptr};
     };
-    string generateUJType(const Instruction &instr, const string &rd, const long long offset){
-        string imm = bitset<21>(offset).to_string();
-        return imm[0] + imm.substr(10,10) + imm[9] + imm.substr(1,8) + registerMap[rd] + instr.opcode;
+    Encoding generateUJType(const InstrDesc &instr, const string &rd, const long long offset){
+        int d = registerNumber(rd);
+        if(d < 0){
+            return {0, "Invalid register"};
+        }
+        return {ujImmediate(offset) | d << 7 | instr.opcode, nullptr};
     };
 
+    //every assembled .text line, in address order
+    vector<EncodedLine> encodedLines;
+
+    //--watch keeps the line encodings of the last assembly, keyed by encodingKey()
+    unordered_map<string, Encoding> encodingCache;
+
+    //cache key of a line: its text, the PC-relative offset of the label of a branch or jal,
+    //and the address of a %hi/%lo symbol, the only other inputs to its encoding. A line
+    //holds no '\n', so the key is exact and a hit never returns another line's encoding
+    string encodingKey(const string &line, long long pc){
+        string key = line;
+        vector<string> tokens;
+        size_t at = 0;
+        while(tokens.size() < 4 && (at = line.find_first_not_of(" \t\r", at)) != string::npos){
+            size_t end = line.find_first_of(" \t\r", at);
+            tokens.push_back(line.substr(at, end - at));
+            at = end;
+        }
+        auto found = tokens.empty() ? instructionMap.end() : instructionMap.find(tokens[0]);
+        if(found == instructionMap.end()) return key;
+        size_t labelToken = found->second->type == SB_TYPE ? 3 : found->second->type == UJ_TYPE ? 2 : 0;
+        if(labelToken && labelToken < tokens.size()){
+            auto target = labels.find(tokens[labelToken]);
+            key += target == labels.end() ? "\n?" : "\n" + to_string(target->second - pc);
+        }
+        size_t percent = line.find('%');
+        if(percent != string::npos){
+            long long address = ~0ll;
+            symbolOperand(line.substr(percent, line.find(')', percent) + 1 - percent), pc, FIXUP_HI, nullptr, address);
+            key += "\n%" + to_string(address);
+        }
+        return key;
+    }
+
+    //address of the symbol in a %hi(symbol) or %lo(symbol) operand. For an object file
+    //the operand becomes a fixup and its value is 0 until the link
+    bool symbolOperand(const string &operand, long long pc, FixupKind kind, vector<Fixup> *fixups, long long &address){
+        if(operand.size() < 6 || operand[0] != '%' || operand[3] != '(' || operand.back() != ')') return false;
+        string symbol = operand.substr(4, operand.size() - 5);
+        if(fixups){
+            fixups->push_back({pc, kind, symbol});
+            address = 0;
+            return true;
+        }
+        auto found = labels.find(symbol);
+        if(found != labels.end()){
+            address = found->second;
+            return true;
+        }
+        found = dataLabels.find(symbol);
+        if(found == dataLabels.end()) return false;
+        address = found->second;
+        return true;
+    }
+
+    //%lo(symbol): the low 12 bits, sign-extended, of the symbol's address
+    bool lowOperand(const string &operand, long long pc, vector<Fixup> *fixups, long long &immediate){
+        if(operand.compare(0, 4, "%lo(") != 0 || !symbolOperand(operand, pc, FIXUP_LO, fixups, immediate)) return false;
+        immediate = ((immediate & 0xFFF) ^ 0x800) - 0x800;
+        return true;
+    }
+
+    //offset and base register of a load or store. The offset is a number or %lo(symbol);
+    //it shares a token with the base, as in 8(x5) or %lo(array)(x5), unless rs1 was
+    //written as an operand of its own
+    bool memoryOperand(string offset, string &rs1, long long pc, vector<Fixup> *fixups, long long &immediate){
+        if(rs1.empty()){
+            size_t open = offset.find('(', offset.compare(0, 4, "%lo(") == 0 ? offset.find(')') : 0);
+            rs1 = offset.substr(open + 1);
+            rs1.pop_back();
+            offset.erase(open);
+        }
+        else{
+            offset.pop_back();
+        }
+        if(offset[0] == '%') return lowOperand(offset, pc, fixups, immediate);
+        immediate = stoi(offset);
+        return true;
+    }
+
+    //one output.mc line; a line that failed to assemble keeps the bare "0x" and carries the error in the comment.
+    //a compressed instruction is listed as its 16-bit parcel
+    string listingLine(long long pc, uint32_t word, const char *error, const string &source){
+        if(!error && instruction_size(word) == 2){
+            return hexWord(pc) + " " + hexWord(word).erase(2, 4) + " " + source + " #" + binaryWord(word).substr(16) + '\n';
+        }
+        return hexWord(pc) + " " + (error ? "0x" : hexWord(word)) + " " + source + " #" + (error ? error : binaryWord(word)) + '\n';
+    }
+
+    //the data segment at the end of output.mc, one line per data item
+    void writeDataSegment(ostream &outputFile){
+        outputFile<<endl;
+        outputFile<<endl;
+        outputFile<<"#Data Segment"<<endl;
+        for(auto it:dataSegment){
+            outputFile<<hexWord(it.first) <<" " << hexWord(stoi(it.second)) <<" "<< it.second <<'\n';
+        }
+    }
+
 public:
+    bool cacheEncodings = false;
+    bool objectMode = false;        //-c: leave references to other files as fixups
+    ScheduleModel schedule = SCHEDULE_OFF;
+    bool compress = false;          //--compress: emit the RV32C form of every instruction that has one
+    long long linesCompressed = 0, textBytesBefore = 0;     //of the last --compress pass
+    bool layout = false;            //--layout: a profile was loaded by loadProfile()
+    long long stallsBefore = 0, stallsAfter = 0, linesMoved = 0;   //totals of the last --schedule pass
+    vector<Fixup> fixups;
+    long long linesAssembled = 0;   //instruction lines in the last parseFile
+    long long linesEncoded = 0;     //of those, lines that had to be encoded (cache misses)
+
+    //forget the previous assembly before assembling the file again
+    void reset(){
+        labels.clear();
+        dataLabels.clear();
+        dataSegment.clear();
+        encodedLines.clear();
+        fixups.clear();
+        programCounter = 0x00000000;
+        dataAddress = 0x10000000;
+        dataMode = false;
+    }
+
+    //the line a CSR pseudo-instruction stands for, given the rest of its line; false if
+    //the number of operands is wrong
+    bool expandCsrPseudo(const CsrPseudoInstruction &pseudo, stringstream &ss, string &line){
+        vector<string> operands;
+        string operand;
+        while(ss >> operand){
+            if(operand.back() == ',') operand.pop_back();
+            operands.push_back(operand);
+        }
+        line = pseudo.expansion;
+        size_t used = 0;
+        for(size_t at; (at = line.find('%')) != string::npos; ){
+            size_t index = line[at + 1] - '0';
+            if(index >= operands.size()) return false;
+            used = max(used, index + 1);
+            line.replace(at, 2, operands[index]);
+        }
+        return used == operands.size();
+    }
 
-    string parseLine(const string &line){
+    //encode one instruction line that sits at address pc. With fixups, a symbol that
+    //has to be resolved by the linker is recorded there and encoded as 0
+    Encoding parseLine(const string &line, long long pc, vector<Fixup> *fixups = nullptr){
         stringstream ss(line);
         string instruction;
         string rd;
@@ -191,69 +675,112 @@ public:
         long long immediate=0;
 
         ss >> instruction;
-        if(instructionMap.find(instruction) == instructionMap.end()){
-            return "Invalid Instruction";
+        auto found = instructionMap.find(instruction);
+        if(found == instructionMap.end()){
+            for(const CsrPseudoInstruction &pseudo:csrPseudoInstructions){
+                if(instruction != pseudo.name) continue;
+                string expansion;
+                if(!expandCsrPseudo(pseudo, ss, expansion)){
+                    return {0, "Invalid operands"};
+                }
+                return parseLine(expansion, pc, fixups);
+            }
+            return {0, "Invalid Instruction"};
         }
-        const Instruction &instr = instructionMap[instruction];
+        const InstrDesc &instr = *found->second;
 
-        if (instr.type == "R") {
+        if (instr.flags & (INSTR_FP | INSTR_VECTOR | INSTR_CSR)) {
+            vector<string> operands;
+            string operand;
+            while(ss >> operand){
+                if(operand.back() == ',') operand.pop_back();
+                operands.push_back(operand);
+            }
+            return (instr.flags & INSTR_VECTOR) ? generateVType(instr, operands) :
+                   (instr.flags & INSTR_CSR) ? generateCSRType(instr, operands) : generateFPType(instr, operands);
+        }
+        else if (instr.type == SYS_TYPE) {
+            //ecall: the system call number and arguments are in a7 and a0-a5
+            string operand;
+            if(ss >> operand){
+                return {0, "Invalid operands"};
+            }
+            return {instr.opcode, nullptr};
+        }
+        else if (instr.type == R_TYPE) {
             ss >> rd >> rs1 >> rs2;
             rd.pop_back();
             rs1.pop_back();
             return generateRType(instr, rd, rs1, rs2);
         } 
-        else if (instr.type == "I") {
-           if(instruction=="lw" || instruction=="lh" || instruction=="lb" || instruction=="ld"){
+        else if (instr.type == I_TYPE) {
+           if(instr.flags & INSTR_LOAD){
                string offsetS;
                ss >> rd >> offsetS >> rs1;
-               if(rs1.size()==0){
-                   immediate = stoi(offsetS.substr(0, offsetS.find('(')));
-                   rs1 = offsetS.substr(offsetS.find('(')+1);
-                   rs1.pop_back();
-               }
-               else{
-                   offsetS.pop_back();
-                   immediate = stoi(offsetS);
+               if(!memoryOperand(offsetS, rs1, pc, fixups, immediate)){
+                   return {0, "Label not found"};
                }
                rd.pop_back();
                return generateIType(instr, rd, rs1, immediate);}
+          else if(instr.flags & MATCH_RS2){
+                //clz rd, rs1: the R-type encoding with rs2 fixed by the table
+                ss >> rd >> rs1;
+                rd.pop_back();
+                return generateRType(instr, rd, rs1, "x" + to_string(instr.rs2));
+          }
           else{ 
-                ss >> rd >> rs1 >> immediate;
+                ss >> rd >> rs1 >> ws;
+                if(ss.peek() == '%'){
+                    //addi rd, rs1, %lo(symbol)
+                    string operand;
+                    ss >> operand;
+                    if(!lowOperand(operand, pc, fixups, immediate)){
+                        return {0, "Label not found"};
+                    }
+                }
+                else{
+                    ss >> immediate;
+                }
                 rd.pop_back();
                 rs1.pop_back();
                 return generateIType(instr, rd, rs1, immediate);
 
         } }
-        else if (instr.type == "S") {
+        else if (instr.type == S_TYPE) {
             string offsetS;
             ss >> rs2 >> offsetS >> rs1;
-            if(rs1.size()==0){
-                immediate = stoi(offsetS.substr(0, offsetS.find('(')));
-                rs1 = offsetS.substr(offsetS.find('(')+1);
-                rs1.pop_back();
-            }
-            else{
-                offsetS.pop_back();
-                immediate = stoi(offsetS);
+            if(!memoryOperand(offsetS, rs1, pc, fixups, immediate)){
+                return {0, "Label not found"};
             }
             rs2.pop_back();
             return generateSType(instr, rs1, rs2, immediate);
         } 
-        else if (instr.type == "SB") {
+        else if (instr.type == SB_TYPE) {
             string label;
             ss>>rs1>>rs2>>label;
+            long long offset = 0;
             if(labels.find(label)==labels.end()){
-                return "Label not found";
+                if(!fixups) return {0, "Label not found"};
+                fixups->push_back({pc, FIXUP_SB, label});
+            }
+            else{
+                offset = (labels.at(label) - pc);
             }
             rs1.pop_back();
             rs2.pop_back();
-            long long offset = (labels[label] - currentPC);
             return generateSBType(instr, rs1, rs2, offset);
         } 
-        else if (instr.type == "U") {
+        else if (instr.type == U_TYPE) {
             string offset;
             ss >> rd >> offset;
-            if(offset[0] == '0' && offset[1] == 'x'){
+            if(offset.compare(0, 4, "%hi(") == 0){
+                //lui rd, %hi(symbol): rounded so that adding the sign-extended %lo gives the address
+                if(!symbolOperand(offset, pc, FIXUP_HI, fixups, immediate)){
+                    return {0, "Label not found"};
+                }
+                immediate = (immediate + 0x800) >> 12;
+            }
+            else if(offset[0] == '0' && offset[1] == 'x'){
             offset = offset.substr(2);
             long long immediate = stoll(offset, nullptr, 16);
             }
@@ -264,194 +791,1112 @@ public:
             immediate &= 0xFFFFF;
             return generateUType(instr, rd, immediate);
         } 
-        else if (instr.type == "UJ") {
+        else if (instr.type == UJ_TYPE) {
             string label;
             ss>>rd>>label;
+            long long offset = 0;
             if(labels.find(label)==labels.end()){
-                return "Label not found";
+                if(!fixups) return {0, "Label not found"};
+                fixups->push_back({pc, FIXUP_UJ, label});
+            }
+            else{
+                offset = (labels.at(label) - pc);
             }
             rd.pop_back();
-            long long offset = (labels[label] - currentPC);
             return generateUJType(instr, rd,offset);
         } 
         else {
-            return "Invalid Instruction";
+            return {0, "Invalid Instruction"};
         }   
 
-        return "Something went wrong";
+        return {0, "Something went wrong"};
     }
 
-    void parseFile(ifstream &inputFile, ofstream &outputFile){
-        vector<string> lines;
-        string line;
-        while(getline(inputFile, line)){
-            if (line == ".data"){
-                dataMode = true;
-                continue;
-            }
-            if (line == ".text"){
-                dataMode = false;
-                continue;
-            }
+    //pass 1 for one source line: mode switches, labels, data directives and the
+    //address of each instruction, relative to the start of the line's chunk
+    void scanLine(string line, int lineNumber, SourceChunk &chunk){
+        if (line == ".data"){
+            chunk.dataMode = true;
+            return;
+        }
+        if (line == ".text"){
+            chunk.dataMode = false;
+            return;
+        }
 
-            stringstream ss(line);
-            string word;
-            ss>>word;
-            if (word.back() == ':'){
-                word.pop_back();
-                if (dataMode){
-                    dataLabels[word] = dataAddress;
-                }
-                else{
-                    labels[word] = programCounter;
-                }
-                continue;
+        stringstream ss(line);
+        string word;
+        ss>>word;
+        if (!word.empty() && word.back() == ':'){
+            word.pop_back();
+            if (chunk.dataMode){
+                chunk.dataLabels.push_back({word, chunk.dataSize});
+            }
+            else{
+                chunk.textLabels.push_back({word, chunk.textSize});
             }
+            return;
+        }
 
-            if (dataMode){
-                if (word == ".word"){
-                    string token;
-                    while(ss>>token){
-                        int val;
-                        if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
-                            // Character case
-                            val = token[1];
-                        }else {
-                            try {
-                                val = stoi(token);
-                            } catch (...) {
-                                cout << "Invalid .byte value: " << token << endl;
-                                break;
-                            }
+        if (chunk.dataMode){
+            if (word == ".word"){
+                string token;
+                while(ss>>token){
+                    int val;
+                    if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
+                        // Character case
+                        val = token[1];
+                    }else {
+                        try {
+                            val = stoi(token);
+                        } catch (...) {
+                            chunk.messages += "Invalid .byte value: " + token + "\n";
+                            break;
                         }
+                    }
 
-                        dataSegment.push_back({dataAddress, to_string(val)});
-                        dataAddress += 4;
-                    }   
-                }
-                else if (word == ".half"){
-                    string token;
-                    while(ss>>token){
-                        int val;
-                        if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
-                            // Character case
-                            val = token[1];
-                        }else {
-                            try {
-                                val = stoi(token);
-                            } catch (...) {
-                                cout << "Invalid .byte value: " << token << endl;
-                                break;
-                            }
-                        }
-                        if (val < -32768 || val > 32767) {
-                            cout << "Value out of bound for .byte: " << val << endl;
+                    chunk.data.push_back({chunk.dataSize, to_string(val)});
+                    chunk.dataSize += 4;
+                }   
+            }
+            else if (word == ".half"){
+                string token;
+                while(ss>>token){
+                    int val;
+                    if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
+                        // Character case
+                        val = token[1];
+                    }else {
+                        try {
+                            val = stoi(token);
+                        } catch (...) {
+                            chunk.messages += "Invalid .byte value: " + token + "\n";
                             break;
                         }
-                        dataSegment.push_back({dataAddress, to_string(val)});
-                        dataAddress += 2;
+                    }
+                    if (val < -32768 || val > 32767) {
+                        chunk.messages += "Value out of bound for .byte: " + to_string(val) + "\n";
+                        break;
+                    }
+                    chunk.data.push_back({chunk.dataSize, to_string(val)});
+                    chunk.dataSize += 2;
+                }
+            }
+            else if (word == ".byte"){
+                string token;
+                while (ss >> token) {
+                long long val;
+                if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
+                    // Character case
+                    val = token[1];
+                } else {
+                    try {
+                        val = stoi(token);
+                    } catch (...) {
+                        chunk.messages += "Invalid .byte value: " + token + "\n";
+                        break;
                     }
                 }
-                else if (word == ".byte"){
-                    string token;
-                    while (ss >> token) {
+
+                if (val < -128 || val > 127) {
+                    chunk.messages += "Value out of bound for .byte: " + to_string(val) + "\n";
+                    break;
+                }
+
+                chunk.data.push_back({chunk.dataSize, to_string(val)});
+                chunk.dataSize += 1;
+            }   
+            }
+            else if (word == ".double"){
+                string token;
+                while(ss>>token){
                     long long val;
                     if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
                         // Character case
                         val = token[1];
-                    } else {
+                    }else {
                         try {
-                            val = stoi(token);
+                            val = stoll(token);
                         } catch (...) {
-                            cout << "Invalid .byte value: " << token << endl;
+                            chunk.messages += "Invalid .byte value: " + token + "\n";
                             break;
                         }
                     }
 
-                    if (val < -128 || val > 127) {
-                        cout << "Value out of bound for .byte: " << val << endl;
-                        break;
+                    chunk.data.push_back({chunk.dataSize, to_string(val)});
+                    chunk.dataSize += 8;
+                }      
+            }
+            else if (word == ".asciiz") {
+                string str;
+                getline(ss, str);
+                if (str.size() >= 2 && str[1] == '"' && str.back() == '"') {
+                    for (size_t i=2;i<str.size()-1;i++) {
+                        chunk.data.push_back({chunk.dataSize, to_string(str[i])});
+                        chunk.dataSize++;
                     }
+                    // Null terminator
+                    chunk.data.push_back({chunk.dataSize, "0"});
+                    chunk.dataSize++;
+                } else {
+                    chunk.messages += "Invalid .asciiz format. Must be enclosed in double quotes.\n";
+                    return;
+                }
+            
+            }
+            
+            return;
 
-                    dataSegment.push_back({dataAddress, to_string(val)});
-                    dataAddress += 1;
-                }   
+        }
+
+        //trim leading and trailing whitespaces
+        line.erase(line.find_last_not_of("\n\r\t")+1);
+        line.erase(0, line.find_first_not_of(" \n\r\t"));
+
+        //if the line is neither empty nor a comment
+        if(!line.empty() && line[0] != '#'){ 
+            chunk.lines.push_back(line);  
+            chunk.lineNumbers.push_back(lineNumber);
+            chunk.textSize += 4;              
+        }
+
+    }
+
+    //--layout profile, keyed by the addresses of the program assembled without --layout
+    struct BranchCount{ long long taken, notTaken; string text; };
+    map<long long, BranchCount> branchCounts;
+    map<long long, long long> blockCounts;
+
+    //read the branch_profile.txt written by the simulator's --branch-profile
+    bool loadProfile(const string &filename){
+        ifstream profileFile(filename);
+        if(!profileFile) return false;
+        string line, kind, address;
+        while(getline(profileFile, line)){
+            if(!line.empty() && line.back() == '\r') line.pop_back();
+            stringstream ss(line);
+            ss>>kind>>address;
+            if(kind == "branch"){
+                BranchCount count;
+                ss>>count.taken>>count.notTaken;
+                getline(ss >> ws, count.text);
+                branchCounts[stoll(address, nullptr, 16)] = count;
+            }
+            else if(kind == "block"){
+                ss>>blockCounts[stoll(address, nullptr, 16)];
+            }
+        }
+        layout = true;
+        return true;
+    }
+
+    //--layout: reorder the basic blocks between pass 1 and pass 2 so that the hot successor of
+    //every block falls through, since fetch predicts not taken and each taken branch or jump
+    //flushes the pipeline. Blocks are chained along their heaviest edges (Pettis-Hansen): a
+    //block is appended to another chain's tail when it heads its own chain. The entry chain
+    //comes first, then the others by their hottest block, and never-executed chains last in
+    //source order. Branches whose hot side would no longer fall through are inverted, and a
+    //jal is added wherever a fallthrough is lost or removed where its target now follows
+    void layoutBlocks(vector<SourceChunk> &chunks){
+        vector<pair<string, int> > lines;
+        for(auto &chunk:chunks){
+            for(size_t i=0; i<chunk.lines.size(); i++) lines.push_back({chunk.lines[i], chunk.lineNumbers[i]});
+        }
+        int n = lines.size();
+        for(auto &branch:branchCounts){
+            long long k = branch.first / 4;
+            if(branch.first % 4 || k >= n || lines[k].first != branch.second.text){
+                cout<<"layout: the profile does not match this program (branch at "<<hexWord(branch.first)<<"), layout skipped"<<endl;
+                return;
+            }
+        }
+        auto tokensOf = [](const string &line){
+            vector<string> tokens;
+            stringstream ss(line);
+            string token;
+            while(ss>>token) tokens.push_back(token);
+            return tokens;
+        };
+        auto stripComma = [](string token){
+            if(!token.empty() && token.back() == ',') token.pop_back();
+            return token;
+        };
+
+        //blocks start at the entry, at labels and after branches and jumps. A block ends in
+        //'B' (branch), 'J' (jump, no fallthrough), 'C' (call: returns to the next line) or 'F'
+        struct Block{
+            int first, last;
+            char end = 'F';
+            string target;
+            long long count = 0;
+            vector<string> names;
+
+            Block(int first, int last) : first(first), last(last) {}
+        };
+        vector<Block> blocks;
+        map<long long, vector<string> > labelsAt;
+        for(auto &label:labels) labelsAt[label.second].push_back(label.first);
+        for(auto &names:labelsAt) sort(names.second.begin(), names.second.end());
+        for(int k=0; k<n; k++){
+            if(blocks.empty() || blocks.back().end != 'F' || labelsAt.count(4ll * k)){
+                if(!blocks.empty()) blocks.back().last = k;
+                blocks.push_back(Block(k, n));
+                if(labelsAt.count(4ll * k)) blocks.back().names = labelsAt[4ll * k];
+            }
+            vector<string> tokens = tokensOf(lines[k].first);
+            auto found = tokens.empty() ? instructionMap.end() : instructionMap.find(tokens[0]);
+            if(found == instructionMap.end()) continue;
+            Block &block = blocks.back();
+            if(found->second->type == SB_TYPE && tokens.size() >= 4){
+                block.end = 'B';
+                block.target = tokens[3];
+            }
+            else if(found->second->flags & INSTR_JUMP){
+                bool link = tokens.size() >= 2 && registerNumber(stripComma(tokens[1])) != 0;
+                block.end = link ? 'C' : 'J';
+                if(!link && tokens[0] == "jal" && tokens.size() >= 3) block.target = tokens[2];
+            }
+        }
+        int END = blocks.size();
+        map<long long, int> blockAt;
+        for(int b=0; b<END; b++) blockAt[4ll * blocks[b].first] = b;
+        blockAt[4ll * n] = END;
+        auto blockOf = [&](const string &label){
+            auto found = labels.find(label);
+            if(found == labels.end() || !blockAt.count(found->second)) return -1;
+            return blockAt[found->second];
+        };
+        for(auto &block:blocks){
+            auto leader = blockCounts.upper_bound(4ll * block.first);
+            if(leader != blockCounts.begin()) block.count = prev(leader)->second;
+        }
+        auto branchAt = [&](const Block &block){
+            auto found = branchCounts.find(4ll * (block.last - 1));
+            return found == branchCounts.end() ? BranchCount{0, 0, ""} : found->second;
+        };
+
+        //edges (weight, taken, from, to): fallthroughs before taken edges of the same weight
+        vector<tuple<long long, int, int, int> > edges;
+        for(int b=0; b<END; b++){
+            Block &block = blocks[b];
+            int target = block.target.empty() ? -1 : blockOf(block.target);
+            if(block.end == 'B'){
+                edges.push_back({branchAt(block).notTaken, 0, b, b + 1});
+                if(target >= 0) edges.push_back({branchAt(block).taken, 1, b, target});
+            }
+            else if(block.end == 'J'){
+                if(target >= 0) edges.push_back({block.count, 1, b, target});
+            }
+            else{
+                edges.push_back({block.count, 0, b, b + 1});
+            }
+        }
+        sort(edges.begin(), edges.end(), [](const tuple<long long, int, int, int> &a, const tuple<long long, int, int, int> &b){
+            if(get<0>(a) != get<0>(b)) return get<0>(a) > get<0>(b);
+            return make_pair(get<1>(a), get<2>(a)) < make_pair(get<1>(b), get<2>(b));
+        });
+        vector<int> next(END, -1), previous(END, -1);
+        auto headOf = [&](int b){
+            while(previous[b] >= 0) b = previous[b];
+            return b;
+        };
+        for(auto &edge:edges){
+            int from = get<2>(edge), to = get<3>(edge);
+            if(to == 0 || to >= END || from == to || next[from] >= 0 || previous[to] >= 0 || headOf(from) == to) continue;
+            next[from] = to;
+            previous[to] = from;
+        }
+        vector<int> heads;
+        for(int b=0; b<END; b++){
+            if(previous[b] < 0) heads.push_back(b);
+        }
+        auto hottest = [&](int head){
+            long long count = 0;
+            for(int b=head; b>=0; b=next[b]) count = max(count, blocks[b].count);
+            return count;
+        };
+        stable_sort(heads.begin(), heads.end(), [&](int a, int b){
+            if((a == 0) != (b == 0)) return a == 0;
+            return hottest(a) > hottest(b);
+        });
+        vector<int> order;
+        for(int head:heads){
+            for(int b=head; b>=0; b=next[b]) order.push_back(b);
+        }
+        order.push_back(END);
+
+        //emit the blocks in their new order, fixing up the ends
+        auto nameOf = [&](int b){
+            if(b == END){
+                if(!labelsAt.count(4ll * n)) labelsAt[4ll * n].push_back("__layout_end");
+                return labelsAt[4ll * n][0];
+            }
+            if(blocks[b].names.empty()) blocks[b].names.push_back("__layout_" + to_string(b));
+            return blocks[b].names[0];
+        };
+        const map<string, string> inverse = {{"beq", "bne"}, {"bne", "beq"}, {"blt", "bge"}, {"bge", "blt"}, {"bltu", "bgeu"}, {"bgeu", "bltu"}};
+        vector<pair<string, int> > laidOut;
+        vector<long long> start(END + 1);
+        long long inverted = 0, added = 0, removed = 0, takenBefore = 0, takenAfter = 0;
+        for(int p=0; p+1<(int)order.size(); p++){
+            int b = order[p], following = order[p + 1];
+            Block &block = blocks[b];
+            start[b] = laidOut.size();
+            laidOut.insert(laidOut.end(), lines.begin() + block.first, lines.begin() + block.last - 1);
+            pair<string, int> last = lines[block.last - 1];
+            int target = block.target.empty() ? -1 : blockOf(block.target);
+            int fallthrough = b + 1;
+            if(block.end == 'B'){
+                BranchCount count = branchAt(block);
+                vector<string> tokens = tokensOf(last.first);
+                takenBefore += count.taken;
+                if(following == fallthrough){
+                    takenAfter += count.taken;
+                    laidOut.push_back(last);
                 }
-                else if (word == ".double"){
-                    string token;
-                    while(ss>>token){
-                        long long val;
-                        if (token[0] == '\'' && token.size() == 3 && token[2] == '\'') { 
-                            // Character case
-                            val = token[1];
-                        }else {
-                            try {
-                                val = stoll(token);
-                            } catch (...) {
-                                cout << "Invalid .byte value: " << token << endl;
-                                break;
-                            }
-                        }
+                else if(following == target && inverse.count(tokens[0])){
+                    takenAfter += count.notTaken;
+                    laidOut.push_back({inverse.at(tokens[0]) + " " + tokens[1] + " " + tokens[2] + " " + nameOf(fallthrough), last.second});
+                    inverted++;
+                }
+                else{
+                    takenAfter += count.taken + count.notTaken;
+                    laidOut.push_back(last);
+                    laidOut.push_back({"jal x0, " + nameOf(fallthrough), last.second});
+                    added++;
+                }
+            }
+            else if(block.end == 'J'){
+                takenBefore += block.count;
+                if(target >= 0 && following == target){
+                    removed++;
+                }
+                else{
+                    takenAfter += block.count;
+                    laidOut.push_back(last);
+                }
+            }
+            else{
+                laidOut.push_back(last);
+                if(following != fallthrough){
+                    takenAfter += block.count;
+                    laidOut.push_back({"jal x0, " + nameOf(fallthrough), last.second});
+                    added++;
+                }
+            }
+        }
+        start[END] = laidOut.size();
 
-                        dataSegment.push_back({dataAddress, to_string(val)});
-                        dataAddress += 8;
-                    }      
-                }
-                else if (word == ".asciiz") {
-                    string str;
-                    getline(ss, str);
-                    if (str.size() >= 2 && str[1] == '"' && str.back() == '"') {
-                        for (int i=2;i<str.size()-1;i++) {
-                            dataSegment.push_back({dataAddress, to_string(str[i])});
-                            dataAddress++;
-                        }
-                        // Null terminator
-                        dataSegment.push_back({dataAddress, "0"});
-                        dataAddress++;
-                    } else {
-                        cout << "Invalid .asciiz format. Must be enclosed in double quotes." << endl;
-                        continue;
-                    }
-                
+        //new label addresses, then the lines are dealt out to the chunks again for pass 2
+        for(int b=0; b<=END; b++){
+            const vector<string> &names = b == END ? labelsAt[4ll * n] : blocks[b].names;
+            for(auto &name:names) labels[name] = 4 * start[b];
+        }
+        programCounter = 4ll * laidOut.size();
+        for(size_t c=0; c<chunks.size(); c++){
+            size_t from = laidOut.size() * c / chunks.size(), to = laidOut.size() * (c + 1) / chunks.size();
+            chunks[c].lines.clear();
+            chunks[c].lineNumbers.clear();
+            for(size_t k=from; k<to; k++){
+                chunks[c].lines.push_back(laidOut[k].first);
+                chunks[c].lineNumbers.push_back(laidOut[k].second);
+            }
+            chunks[c].textBase = 4 * from;
+            chunks[c].textSize = 4 * (to - from);
+        }
+        cout<<"layout: "<<END<<" blocks, "<<inverted<<" branches inverted, "<<added<<" jumps added, "<<removed
+            <<" removed; taken branches and jumps in the profile: "<<takenBefore<<" before, "<<takenAfter<<" after"<<endl;
+    }
+
+    //data stalls of ops issued in this order through the 5-stage pipeline of Phase 3, counting
+    //only dependencies inside the list. Decode waits for a producer in EX/MEM or MEM/WB, so a
+    //consumer issues 3 cycles after its producer; with forwarding only a load holds it, for 2
+    long long blockStalls(const vector<ScheduledOp> &ops, const vector<int> &order){
+        long long ready[NUM_REGISTERS] = {}, cycle = 0;
+        for(int i:order){
+            const ScheduledOp &op = ops[i];
+            long long issue = max({cycle + 1, ready[op.rs1], ready[op.rs2], ready[op.rs3]});
+            if(op.rd) ready[op.rd] = schedule == SCHEDULE_NO_FORWARDING ? issue + 3 : op.loadUse ? issue + 2 : 0;
+            cycle = issue;
+        }
+        return cycle - (long long)order.size();
+    }
+
+    //list-schedule one basic block: every step issues, among the ops whose predecessors have
+    //all issued, the one that can issue soonest, preferring the longest path to the block end.
+    //returns the new order, or the old one when that does not remove any stall
+    vector<int> scheduleBlock(const vector<ScheduledOp> &ops){
+        int n = ops.size();
+        vector<int> order(n);
+        iota(order.begin(), order.end(), 0);
+        long long before = blockStalls(ops, order);
+        stallsBefore += before;
+        if(before == 0 || n < 3){
+            stallsAfter += before;
+            return order;
+        }
+
+        //i must stay ahead of j for register (RAW, WAR, WAW) and memory dependencies. Two
+        //accesses off the same, unchanged base register are independent if their offsets are
+        //known and do not overlap
+        vector<vector<int> > successors(n);
+        vector<int> predecessors(n), height(n, 1);
+        for(int j=1; j<n; j++){
+            for(int i=j-1, baseWritten=0; i>=0; i--){
+                const ScheduledOp &a = ops[i], &b = ops[j];
+                if(a.rd && a.rd == b.base) baseWritten = 1;
+                bool registers = (a.rd && (a.rd == b.rs1 || a.rd == b.rs2 || a.rd == b.rs3 || a.rd == b.rd))
+                              || (b.rd && (b.rd == a.rs1 || b.rd == a.rs2 || b.rd == a.rs3));
+                bool memory = (a.store && (b.load || b.store)) || (a.load && b.store);
+                if(memory && !baseWritten && a.base >= 0 && a.base == b.base && !a.relocated && !b.relocated){
+                    memory = a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+                }
+                if(registers || memory || b.control){
+                    successors[i].push_back(j);
+                    predecessors[j]++;
+                }
+            }
+        }
+        for(int i=n-1; i>=0; i--){
+            for(int j:successors[i]){
+                int latency = ops[i].rd && (ops[i].rd == ops[j].rs1 || ops[i].rd == ops[j].rs2 || ops[i].rd == ops[j].rs3) ? (schedule == SCHEDULE_NO_FORWARDING ? 3 : ops[i].loadUse ? 2 : 1) : 1;
+                height[i] = max(height[i], latency + height[j]);
+            }
+        }
+
+        vector<int> scheduled;
+        long long ready[NUM_REGISTERS] = {}, cycle = 0;
+        while((int)scheduled.size() < n){
+            int best = -1;
+            long long bestIssue = 0;
+            for(int i=0; i<n; i++){
+                if(predecessors[i] != 0) continue;
+                long long issue = max({cycle + 1, ready[ops[i].rs1], ready[ops[i].rs2], ready[ops[i].rs3]});
+                if(best < 0 || issue < bestIssue || (issue == bestIssue && height[i] > height[best])){
+                    best = i;
+                    bestIssue = issue;
                 }
-                
+            }
+            predecessors[best] = -1;
+            for(int j:successors[best]) predecessors[j]--;
+            const ScheduledOp &op = ops[best];
+            if(op.rd) ready[op.rd] = schedule == SCHEDULE_NO_FORWARDING ? bestIssue + 3 : op.loadUse ? bestIssue + 2 : 0;
+            cycle = bestIssue;
+            scheduled.push_back(best);
+        }
+        long long after = blockStalls(ops, scheduled);
+        if(after >= before){
+            stallsAfter += before;
+            return order;
+        }
+        stallsAfter += after;
+        return scheduled;
+    }
+
+    //--schedule: reorder the instructions of every basic block to hide data stalls, between
+    //pass 1 and pass 2. A block starts at a label and ends after a branch or jump, so labels
+    //and the addresses of control transfers do not move. Long blocks are scheduled in windows
+    void scheduleLines(vector<SourceChunk> &chunks){
+        const int WINDOW = 64;
+        unordered_set<long long> labelAddresses;
+        for(auto &label:labels) labelAddresses.insert(label.second);
+        vector<pair<SourceChunk *, int> > lines;
+        for(auto &chunk:chunks){
+            for(int i=0; i<(int)chunk.lines.size(); i++) lines.push_back({&chunk, i});
+        }
+        stallsBefore = stallsAfter = linesMoved = 0;
+
+        vector<ScheduledOp> ops;
+        size_t blockStart = 0;
+        auto finishBlock = [&](size_t end){
+            vector<int> order = scheduleBlock(ops);
+            vector<pair<string, int> > moved;
+            for(int i:order){
+                auto &line = lines[blockStart + i];
+                moved.push_back({line.first->lines[line.second], line.first->lineNumbers[line.second]});
+            }
+            for(int i=0; i<(int)order.size(); i++){
+                auto &line = lines[blockStart + i];
+                line.first->lines[line.second] = moved[i].first;
+                line.first->lineNumbers[line.second] = moved[i].second;
+                if(order[i] != i) linesMoved++;
+            }
+            ops.clear();
+            blockStart = end;
+        };
+        vector<Fixup> ignored;
+        for(size_t k=0; k<lines.size(); k++){
+            SourceChunk &chunk = *lines[k].first;
+            long long pc = chunk.textBase + 4 * lines[k].second;
+            if(k > blockStart && labelAddresses.count(pc)) finishBlock(k);
+            ignored.clear();
+            ScheduledOp op = scheduledOp(parseLine(chunk.lines[lines[k].second], pc, objectMode ? &ignored : nullptr));
+            op.relocated = !ignored.empty();
+            if(op.barrier){
+                if(k > blockStart) finishBlock(k);
+                blockStart = k + 1;
                 continue;
+            }
+            ops.push_back(op);
+            if(op.control || ops.size() == WINDOW) finishBlock(k + 1);
+        }
+        if(!ops.empty()) finishBlock(lines.size());
+        cout<<"schedule ("<<(schedule == SCHEDULE_NO_FORWARDING ? "no forwarding" : "forwarding")<<"): "
+            <<stallsBefore<<" data stalls before, "<<stallsAfter<<" after, "<<linesMoved<<" instructions moved"<<endl;
+    }
+
+    //--compress: give every line that has an RV32C form 2 bytes. Branch and jump offsets
+    //shrink with the code, so the sizes are relaxed: every line starts at 2 bytes and
+    //grows to 4 for good once its encoding at the current addresses has no 16-bit form,
+    //until no line grows. Only growing guarantees the loop ends. Labels move with the lines
+    void compressLines(vector<SourceChunk> &chunks){
+        vector<pair<SourceChunk *, int> > lines;
+        for(auto &chunk:chunks){
+            chunk.sizes.assign(chunk.lines.size(), 2);
+            for(int i=0; i<(int)chunk.lines.size(); i++) lines.push_back({&chunk, i});
+        }
+        //every line is still 4 bytes, so a text label's address gives its line
+        long long base = chunks[0].textBase;
+        vector<pair<string, size_t> > lineOfLabel;
+        for(auto &label:labels) lineOfLabel.push_back({label.first, (size_t)(label.second - base) / 4});
+        vector<long long> address(lines.size() + 1, base);
+        for(bool grown = true; grown; ){
+            grown = false;
+            for(size_t k=0; k<lines.size(); k++){
+                address[k + 1] = address[k] + lines[k].first->sizes[lines[k].second];
+            }
+            for(auto &label:lineOfLabel) labels[label.first] = address[label.second];
+            for(size_t k=0; k<lines.size(); k++){
+                unsigned char &size = lines[k].first->sizes[lines[k].second];
+                if(size == 4) continue;
+                Encoding code = parseLine(lines[k].first->lines[lines[k].second], address[k]);
+                if(code.error || !compress_instruction(code.word)){
+                    size = 4;
+                    grown = true;
+                }
+            }
+        }
+        size_t k = 0;
+        for(auto &chunk:chunks){
+            chunk.textBase = address[k];
+            k += chunk.lines.size();
+            chunk.textSize = address[k] - chunk.textBase;
+        }
+        textBytesBefore = 4ll * lines.size();
+        linesCompressed = 2 * lines.size() - (address[lines.size()] - base) / 2;
+        programCounter = address[lines.size()];
+        cout<<"compress: "<<linesCompressed<<" of "<<lines.size()<<" instructions compressed, .text "
+            <<textBytesBefore<<" -> "<<programCounter - base<<" bytes"<<endl;
+    }
 
+    //two-pass assembly. The source is cut into one chunk of whole lines per thread.
+    //pass 1 scans the chunks in parallel with chunk-relative addresses, prefix sums of
+    //the chunk sizes then give every chunk its base addresses, and pass 2 encodes the
+    //chunks in parallel into buffers that are written out in source order
+    void parseFile(istream &inputFile, ostream &outputFile, int threads = 1){
+        string source((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
+        vector<SourceChunk> chunks(max(1, threads));
+        size_t position = 0;
+        int lineNumber = 0;
+        for(size_t c=0; c<chunks.size(); c++){
+            size_t end = source.size();
+            if(c + 1 < chunks.size()){
+                size_t eol = source.find('\n', max(position, source.size() * (c + 1) / chunks.size()));
+                if(eol != string::npos) end = eol + 1;
             }
+            chunks[c].begin = position;
+            chunks[c].end = end;
+            chunks[c].firstLine = lineNumber + 1;
+            lineNumber += count(source.begin() + position, source.begin() + end, '\n');
+            position = end;
+        }
+        auto forEachChunk = [&](auto work){
+            vector<thread> workers;
+            for(size_t c=1; c<chunks.size(); c++) workers.emplace_back(work, ref(chunks[c]));
+            work(chunks[0]);
+            for(auto &worker:workers) worker.join();
+        };
+        auto forEachLine = [&](SourceChunk &chunk, auto visit){
+            size_t at = chunk.begin;
+            int number = chunk.firstLine;
+            while(at < chunk.end){
+                size_t eol = source.find('\n', at);
+                if(eol == string::npos || eol > chunk.end) eol = chunk.end;
+                visit(source.substr(at, eol - at), number++);
+                at = eol + 1;
+            }
+        };
+
+        //a chunk starts in the mode the previous chunks left behind
+        forEachChunk([&](SourceChunk &chunk){
+            forEachLine(chunk, [&](const string &line, int){
+                if(line == ".data") chunk.lastSwitch = 'D';
+                if(line == ".text") chunk.lastSwitch = 'T';
+            });
+        });
+        bool mode = dataMode;
+        for(auto &chunk:chunks){
+            chunk.dataMode = mode;
+            if(chunk.lastSwitch) mode = chunk.lastSwitch == 'D';
+        }
 
-            //trim leading and trailing whitespaces
-            line.erase(line.find_last_not_of("\n\r\t")+1);
-            line.erase(0, line.find_first_not_of(" \n\r\t"));
+        //pass 1
+        forEachChunk([&](SourceChunk &chunk){
+            forEachLine(chunk, [&](const string &line, int number){ scanLine(line, number, chunk); });
+        });
+        for(auto &chunk:chunks){
+            chunk.textBase = programCounter;
+            chunk.dataBase = dataAddress;
+            programCounter += chunk.textSize;
+            dataAddress += chunk.dataSize;
+            for(auto &label:chunk.textLabels) labels[label.first] = chunk.textBase + label.second;
+            for(auto &label:chunk.dataLabels) dataLabels[label.first] = chunk.dataBase + label.second;
+            for(auto &item:chunk.data) dataSegment.push_back({chunk.dataBase + item.first, item.second});
+            cout<<chunk.messages;
+        }
+        dataMode = mode;
+        if(layout) layoutBlocks(chunks);
+        if(schedule != SCHEDULE_OFF) scheduleLines(chunks);
+        if(compress) compressLines(chunks);
 
-            //if the line is neither empty nor a comment
-            if(!line.empty() && line[0] != '#'){ 
-                lines.push_back(line);  
-                programCounter += 4;              
+        //pass 2: parse each line and build the machine code for the output file
+        forEachChunk([&](SourceChunk &chunk){
+            long long pc = chunk.textBase;
+            vector<Fixup> *fixups = objectMode ? &chunk.fixups : nullptr;
+            for(size_t i=0; i<chunk.lines.size(); i++){
+                const string &line = chunk.lines[i];
+                Encoding code;
+                if(cacheEncodings){
+                    //the cache is only read here; it is rebuilt after the threads join
+                    string key = encodingKey(line, pc);
+                    auto cached = encodingCache.find(key);
+                    if(cached != encodingCache.end()){
+                        code = cached->second;
+                    }
+                    else{
+                        code = parseLine(line, pc, fixups);
+                        chunk.cacheMisses++;
+                    }
+                    chunk.encodings.push_back({move(key), code});
+                }
+                else{
+                    code = parseLine(line, pc, fixups);
+                }
+                int size = chunk.sizes.empty() ? 4 : chunk.sizes[i];
+                if(size == 2) code.word = compress_instruction(code.word);
+                chunk.output += listingLine(pc, code.word, code.error, line);
+                chunk.encoded.push_back({pc, code.word, code.error, chunk.lineNumbers[i], line});
+                pc += size;
             }
+        });
+        linesAssembled = linesEncoded = 0;
+        for(auto &chunk:chunks){
+            outputFile<<chunk.output;
+            encodedLines.insert(encodedLines.end(), chunk.encoded.begin(), chunk.encoded.end());
+            fixups.insert(fixups.end(), chunk.fixups.begin(), chunk.fixups.end());
+            linesAssembled += chunk.lines.size();
+            linesEncoded += cacheEncodings ? chunk.cacheMisses : chunk.lines.size();
+        }
+        if(cacheEncodings){
+            //keep only the lines of this assembly, so edits do not grow the cache without bound
+            encodingCache.clear();
+            for(auto &chunk:chunks){
+                for(auto &entry:chunk.encodings) encodingCache.emplace(move(entry.first), entry.second);
+            }
+        }
+        writeDataSegment(outputFile);
+    }
 
+    //write every label as "<address> <T|D> <name>" (T = .text, D = .data), sorted by address
+    //the simulator uses this to put function names in its call-graph profile
+    void writeSymbols(ofstream &symbolFile){
+        vector<pair<long long, string> > symbols;
+        for(auto it:labels){
+            symbols.push_back({it.second, "T " + it.first});
         }
-        //parse each line and write the machine code to the output file
-        for(const auto &line:lines){
-            string machineCode = parseLine(line);
-            outputFile<<binaryToHex(bitset<32>(currentPC).to_string()) <<" " << binaryToHex(machineCode) <<" "<< line <<" #"<<machineCode<<endl;
-            currentPC += 4;
+        for(auto it:dataLabels){
+            symbols.push_back({it.second, "D " + it.first});
+        }
+        sort(symbols.begin(), symbols.end());
+        for(auto it:symbols){
+            symbolFile<<hexWord(it.first) <<" "<< it.second <<'\n';
+        }
+    }
+
+    //write the compact binary image (see McbHeader). Its data is what output.mc gives the
+    //simulator: the low byte of each data item, at the item's address
+    void writeBinaryImage(ofstream &binaryFile){
+        vector<McbRun> textRuns, dataRuns;
+        vector<McbSymbol> symbols;
+        vector<McbLine> lineInfo;
+        vector<uint8_t> textBytes;
+        vector<uint8_t> dataBytes;
+        string strings(1, '\0');
+        auto addString = [&](const string &s){
+            uint32_t offset = strings.size();
+            strings += s;
+            strings += '\0';
+            return offset;
+        };
+
+        //text: a run breaks wherever a line failed to assemble. Compressed instructions are 2 bytes
+        for(const auto &line:encodedLines){
+            if(line.error) continue;
+            uint32_t size = instruction_size(line.word);
+            if(textRuns.empty() || textRuns.back().address + textRuns.back().size != line.address){
+                textRuns.push_back({(uint32_t)line.address, 0, (uint32_t)textBytes.size()});
+            }
+            textRuns.back().size += size;
+            for(uint32_t b=0; b<size; b++) textBytes.push_back((line.word >> (8 * b)) & 0xFF);
+            lineInfo.push_back({(uint32_t)line.address, (uint32_t)line.lineNumber, addString(line.source)});
+        }
+
+        //data: consecutive .byte items share a run; one breaks after every wider item
+        for(const auto &item:dataSegment){
+            long long address = item.first;
+            if(dataRuns.empty() || dataRuns.back().address + dataRuns.back().size != address){
+                dataRuns.push_back({(uint32_t)address, 0, (uint32_t)dataBytes.size()});
+            }
+            dataBytes.push_back(stoll(item.second) & 0xFF);
+            dataRuns.back().size++;
+        }
+
+        //sorted before the names are interned, so the image does not depend on hash order
+        vector<tuple<long long, string, char> > labelList;
+        for(auto it:labels) labelList.push_back({it.second, it.first, 'T'});
+        for(auto it:dataLabels) labelList.push_back({it.second, it.first, 'D'});
+        sort(labelList.begin(), labelList.end());
+        for(auto &label:labelList){
+            symbols.push_back({(uint32_t)get<0>(label), addString(get<1>(label)), (uint32_t)get<2>(label)});
+        }
+
+        //sections follow the header in this order; payload offsets are made absolute here
+        McbHeader header = {};
+        memcpy(header.magic, "\x7f" "MCB", 4);
+        header.version = 1;
+        header.entry = encodedLines.empty() ? 0 : (uint32_t)encodedLines[0].address;
+        uint32_t offset = sizeof(header);
+        uint32_t textOffset = offset;             offset += (textBytes.size() + 3) / 4 * 4;
+        uint32_t dataOffset = offset;             offset += (dataBytes.size() + 3) / 4 * 4;
+        header.textRunsOffset = offset;           header.textRunCount = textRuns.size();   offset += textRuns.size() * sizeof(McbRun);
+        header.dataRunsOffset = offset;           header.dataRunCount = dataRuns.size();   offset += dataRuns.size() * sizeof(McbRun);
+        header.symbolsOffset = offset;            header.symbolCount = symbols.size();     offset += symbols.size() * sizeof(McbSymbol);
+        header.linesOffset = offset;              header.lineCount = lineInfo.size();      offset += lineInfo.size() * sizeof(McbLine);
+        header.stringsOffset = offset;            header.stringsSize = strings.size();
+        for(auto &run:textRuns) run.payloadOffset += textOffset;
+        for(auto &run:dataRuns) run.payloadOffset += dataOffset;
+        textBytes.resize((textBytes.size() + 3) / 4 * 4, 0);
+        dataBytes.resize((dataBytes.size() + 3) / 4 * 4, 0);
+
+        binaryFile.write((const char *)&header, sizeof(header));
+        binaryFile.write((const char *)textBytes.data(), textBytes.size());
+        binaryFile.write((const char *)dataBytes.data(), dataBytes.size());
+        binaryFile.write((const char *)textRuns.data(), textRuns.size() * sizeof(McbRun));
+        binaryFile.write((const char *)dataRuns.data(), dataRuns.size() * sizeof(McbRun));
+        binaryFile.write((const char *)symbols.data(), symbols.size() * sizeof(McbSymbol));
+        binaryFile.write((const char *)lineInfo.data(), lineInfo.size() * sizeof(McbLine));
+        binaryFile.write(strings.data(), strings.size());
+    }
+
+    //write a relocatable object (-c), one record per line:
+    //  RVOBJ 1
+    //  size <text bytes> <data bytes>
+    //  text <line number> <word> <error index or -1> <source>     one per instruction
+    //  data <offset> <value>                                      one per data item
+    //  symbol <T|D> <offset> <name>
+    //  fixup <offset> <sb|uj|hi|lo> <symbol>
+    //offsets are relative to the start of the object's .text or .data
+    void writeObject(ostream &objectFile){
+        objectFile<<"RVOBJ 1\n";
+        objectFile<<"size "<<programCounter<<" "<<dataAddress - 0x10000000<<'\n';
+        for(const auto &line:encodedLines){
+            int error = -1;
+            for(int i=0; line.error && i<(int)size(encodingErrors); i++){
+                if(strcmp(line.error, encodingErrors[i]) == 0) error = i;
+            }
+            objectFile<<"text "<<line.lineNumber<<" "<<hexWord(line.word)<<" "<<error<<" "<<line.source<<'\n';
         }
-        outputFile<<endl;
-        outputFile<<endl;
-        outputFile<<"#Data Segment"<<endl;
         for(auto it:dataSegment){
-            outputFile<<binaryToHex(bitset<32>(it.first).to_string()) <<" " << binaryToHex(bitset<32>(stoi(it.second)).to_string()) <<" "<< it.second <<endl;
+            objectFile<<"data "<<it.first - 0x10000000<<" "<<it.second<<'\n';
+        }
+        vector<tuple<char, long long, string> > symbols;
+        for(auto it:labels) symbols.push_back({'T', it.second, it.first});
+        for(auto it:dataLabels) symbols.push_back({'D', it.second - 0x10000000, it.first});
+        sort(symbols.begin(), symbols.end());
+        for(auto &symbol:symbols){
+            objectFile<<"symbol "<<get<0>(symbol)<<" "<<get<1>(symbol)<<" "<<get<2>(symbol)<<'\n';
+        }
+        for(auto &fixup:fixups){
+            objectFile<<"fixup "<<fixup.address<<" "<<fixupNames[fixup.kind]<<" "<<fixup.symbol<<'\n';
         }
     }
+
+    //link objects written by -c into one program, as if their sources had been assembled
+    //one after another: the .text and .data of each object follow those of the previous
+    //one. A fixup resolves to the symbol in its own object if there is one, else to the
+    //only other object that defines it. Returns false after printing the errors
+    bool linkObjects(const vector<string> &paths, ostream &outputFile){
+        struct ObjectFile{
+            long long textBase, dataBase;
+            unordered_map<string, long long> symbols;      //final addresses
+            unordered_map<string, char> sections;          //T or D
+            vector<Fixup> fixups;
+        };
+        vector<ObjectFile> objects;
+        unordered_map<string, vector<int> > definedIn;
+        reset();
+        bool ok = true;
+        for(int o=0; o<(int)paths.size(); o++){
+            ifstream objectFile(paths[o]);
+            string line, kind;
+            if(!getline(objectFile, line) || line.compare(0, 7, "RVOBJ 1") != 0){
+                cout<<"Error: "<<paths[o]<<" is not an object file"<<endl;
+                ok = false;
+                continue;
+            }
+            ObjectFile object = {programCounter, dataAddress, {}, {}, {}};
+            long long textAddress = programCounter;
+            while(getline(objectFile, line)){
+                if(!line.empty() && line.back() == '\r') line.pop_back();
+                stringstream ss(line);
+                ss>>kind;
+                if(kind == "size"){
+                    long long textSize, dataSize;
+                    ss>>textSize>>dataSize;
+                    programCounter += textSize;
+                    dataAddress += dataSize;
+                }
+                else if(kind == "text"){
+                    int lineNumber, error;
+                    string word, source;
+                    ss>>lineNumber>>word>>error;
+                    getline(ss >> ws, source);
+                    const char *message = error < 0 ? nullptr : error < (int)size(encodingErrors) ? encodingErrors[error] : "Something went wrong";
+                    encodedLines.push_back({textAddress, (uint32_t)stoul(word, nullptr, 16), message, lineNumber, source});
+                    textAddress += 4;
+                }
+                else if(kind == "data"){
+                    long long offset;
+                    string value;
+                    ss>>offset>>value;
+                    dataSegment.push_back({object.dataBase + offset, value});
+                }
+                else if(kind == "symbol"){
+                    char section;
+                    long long offset;
+                    string name;
+                    ss>>section>>offset>>name;
+                    object.symbols[name] = (section == 'T' ? object.textBase : object.dataBase) + offset;
+                    object.sections[name] = section;
+                    definedIn[name].push_back(o);
+                }
+                else if(kind == "fixup"){
+                    Fixup fixup;
+                    string name;
+                    ss>>fixup.address>>name>>fixup.symbol;
+                    fixup.kind = (FixupKind)(find(begin(fixupNames), end(fixupNames), name) - begin(fixupNames));
+                    object.fixups.push_back(fixup);
+                }
+            }
+            objects.push_back(object);
+        }
+        if(!ok) return false;
+
+        //a name defined in one object is global. One defined in several is local to each of
+        //them, so in output.sym it is qualified with the object's name and none replaces another
+        for(int o=0; o<(int)objects.size(); o++){
+            for(auto &symbol:objects[o].symbols){
+                string name = symbol.first;
+                if(definedIn[name].size() > 1) name = filesystem::path(paths[o]).stem().string() + ":" + name;
+                (objects[o].sections[symbol.first] == 'T' ? labels : dataLabels)[name] = symbol.second;
+            }
+        }
+
+        for(int o=0; o<(int)objects.size(); o++){
+            for(auto &fixup:objects[o].fixups){
+                long long address = objects[o].textBase + fixup.address;
+                long long target;
+                auto own = objects[o].symbols.find(fixup.symbol);
+                auto other = definedIn.find(fixup.symbol);
+                if(own != objects[o].symbols.end()){
+                    target = own->second;
+                }
+                else if(other == definedIn.end()){
+                    cout<<"Error: "<<paths[o]<<": undefined symbol "<<fixup.symbol<<endl;
+                    ok = false;
+                    continue;
+                }
+                else if(other->second.size() > 1){
+                    cout<<"Error: "<<paths[o]<<": symbol "<<fixup.symbol<<" is defined in more than one object"<<endl;
+                    ok = false;
+                    continue;
+                }
+                else{
+                    target = objects[other->second[0]].symbols.at(fixup.symbol);
+                }
+                if(fixup.kind >= size(fixupNames) || address < 0 || address / 4 >= (long long)encodedLines.size()){
+                    cout<<"Error: "<<paths[o]<<": bad fixup at "<<fixup.address<<endl;
+                    ok = false;
+                    continue;
+                }
+                EncodedLine &line = encodedLines[address / 4];
+                if(line.error) continue;
+                long long offset = target - address;
+                if((fixup.kind == FIXUP_SB && (offset < -4096 || offset > 4094)) || (fixup.kind == FIXUP_UJ && (offset < -1048576 || offset > 1048574))){
+                    cout<<"Error: "<<paths[o]<<": "<<fixup.symbol<<" is out of reach of the "<<fixupNames[fixup.kind]<<" instruction at "<<hexWord(address)<<endl;
+                    ok = false;
+                    continue;
+                }
+                if(fixup.kind == FIXUP_SB) line.word = (line.word & ~SB_IMMEDIATE_MASK) | sbImmediate(offset);
+                if(fixup.kind == FIXUP_UJ) line.word = (line.word & ~UJ_IMMEDIATE_MASK) | ujImmediate(offset);
+                if(fixup.kind == FIXUP_HI) line.word = (line.word & ~U_IMMEDIATE_MASK) | uImmediate((target + 0x800) >> 12);
+                //a store splits %lo over the S-type field, other instructions take it in the I-type one
+                bool store = decode_instruction(line.word).desc->flags & INSTR_STORE;
+                if(fixup.kind == FIXUP_LO && store) line.word = (line.word & ~S_IMMEDIATE_MASK) | sImmediate(target);
+                if(fixup.kind == FIXUP_LO && !store) line.word = (line.word & ~I_IMMEDIATE_MASK) | iImmediate(target);
+            }
+        }
+        if(!ok) return false;
+
+        for(const auto &line:encodedLines){
+            outputFile<<listingLine(line.address, line.word, line.error, line.source);
+        }
+        writeDataSegment(outputFile);
+        return true;
+    }
 };
 
-int main(){
+//--watch: assemble input.asm again whenever it changes. Lines whose text and branch
+//offset are unchanged take their encoding from the cache, and only the byte range of
+//output.mc that differs from the previous assembly is rewritten
+void watchInput(RiscVAssembler &assembler, int threads, bool writeBinary){
+    ifstream current("output.mc", ios::binary);
+    string previous((istreambuf_iterator<char>(current)), istreambuf_iterator<char>());
+    current.close();
+    error_code error;
+    auto lastChange = filesystem::last_write_time("input.asm", error);
+    cout<<"watching input.asm, press Ctrl-C to stop"<<endl;
+    while(true){
+        this_thread::sleep_for(chrono::milliseconds(100));
+        auto changed = filesystem::last_write_time("input.asm", error);
+        if(error || changed == lastChange) continue;
+        lastChange = changed;
+        auto start = chrono::steady_clock::now();
+
+        ifstream inputFile("input.asm");
+        ostringstream output;
+        assembler.reset();
+        assembler.parseFile(inputFile, output, threads);
+        string content = output.str();
+
+        //rewrite [first, last): from the first differing byte, to the last one if the size
+        //is unchanged, else to the new end of the file
+        size_t first = 0;
+        while(first < content.size() && first < previous.size() && content[first] == previous[first]) first++;
+        size_t last = content.size();
+        if(content.size() == previous.size()){
+            while(last > first && content[last - 1] == previous[last - 1]) last--;
+        }
+        fstream outputFile("output.mc", ios::in | ios::out | ios::binary);
+        if(outputFile){
+            outputFile.seekp(first);
+            outputFile.write(content.data() + first, last - first);
+            outputFile.close();
+            if(content.size() < previous.size()) filesystem::resize_file("output.mc", content.size(), error);
+        }
+        else{
+            ofstream fresh("output.mc", ios::binary);
+            fresh<<content;
+            first = 0;
+            last = content.size();
+        }
+        previous = move(content);
+
+        ofstream symbolFile("output.sym");
+        assembler.writeSymbols(symbolFile);
+        symbolFile.close();
+        if(writeBinary){
+            ofstream binaryFile("output.mcb", ios::binary);
+            assembler.writeBinaryImage(binaryFile);
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout<<"reassembled in "<<ms<<" ms: "<<assembler.linesEncoded<<" of "<<assembler.linesAssembled
+            <<" lines encoded, "<<last - first<<" bytes of output.mc rewritten"<<endl;
+    }
+}
+
+int main(int argc, char *argv[]){
     RiscVAssembler assembler;
 
-    ifstream inputFile("input.asm");
+    //--mcb also writes the compact binary image output.mcb
+    //-j N assembles with N threads (0 = one per core)
+    //--watch keeps reassembling input.asm as it changes
+    //--schedule / --schedule-no-forwarding reorder instructions to hide data stalls
+    //--layout branch_profile.txt lays out basic blocks along the simulator's branch profile
+    //--compress emits 16-bit RV32C instructions where they exist
+    //-c [file.asm] [-o file.o] assembles one file into a relocatable object
+    //--link a.o b.o ... links objects into output.mc instead of assembling input.asm
+    bool writeBinary = false;
+    bool watch = false;
+    bool compileOnly = false;
+    bool link = false;
+    int threads = 1;
+    string objectName;
+    vector<string> files;
+    for(int i=1; i<argc; i++){
+        if(string(argv[i]) == "--mcb") writeBinary = true;
+        else if(string(argv[i]) == "--watch") watch = true;
+        else if(string(argv[i]) == "-c") compileOnly = true;
+        else if(string(argv[i]) == "--link") link = true;
+        else if(string(argv[i]) == "--schedule") assembler.schedule = SCHEDULE_FORWARDING;
+        else if(string(argv[i]) == "--schedule-no-forwarding") assembler.schedule = SCHEDULE_NO_FORWARDING;
+        else if(string(argv[i]) == "--compress") assembler.compress = true;
+        else if(string(argv[i]) == "-o" && i + 1 < argc) objectName = argv[++i];
+        else if(string(argv[i]) == "--layout" && i + 1 < argc){
+            if(!assembler.loadProfile(argv[++i])){
+                cout<<"Error in opening the profile "<<argv[i]<<endl;
+                return 1;
+            }
+        }
+        else if(string(argv[i]) == "-j" && i + 1 < argc){
+            threads = atoi(argv[++i]);
+            if(threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        }
+        else files.push_back(argv[i]);
+    }
+
+    if(assembler.compress && (compileOnly || link)){
+        //objects and the linker lay out .text in 4-byte lines
+        cout<<"--compress cannot be combined with -c or --link"<<endl;
+        return 1;
+    }
+    if(compileOnly){
+        string sourceName = files.empty() ? "input.asm" : files[0];
+        if(objectName.empty()){
+            objectName = sourceName.substr(0, sourceName.rfind('.')) + ".o";
+        }
+        ifstream inputFile(sourceName);
+        if(!inputFile){
+            cout<<"Error in opening the input file"<<endl;
+            return 1;
+        }
+        ofstream objectFile(objectName);
+        if(!objectFile){
+            cout<<"Error in opening the object file"<<endl;
+            return 1;
+        }
+        ostringstream listing;
+        assembler.objectMode = true;
+        assembler.parseFile(inputFile, listing, threads);
+        assembler.writeObject(objectFile);
+        return 0;
+    }
+
+    ifstream inputFile;
+    if(!link) inputFile.open("input.asm");
     ofstream outputFile("output.mc");
 
-    if(!inputFile){
+    if(!link && !inputFile){
         cout<<"Error in opening the input file"<<endl;
         return 0;
     }
@@ -460,7 +1905,32 @@ int main(){
         return 0;
     }
     
-    assembler.parseFile(inputFile, outputFile);
+    if(link){
+        if(!assembler.linkObjects(files, outputFile)) return 1;
+        watch = false;
+    }
+    else{
+        assembler.cacheEncodings = watch;
+        assembler.parseFile(inputFile, outputFile, threads);
+    }
+
+    ofstream symbolFile("output.sym");
+    if(!symbolFile){
+        cout<<"Error in opening the symbol file"<<endl;
+        return 0;
+    }
+    assembler.writeSymbols(symbolFile);
+    symbolFile.close();
+
+    if(writeBinary){
+        ofstream binaryFile("output.mcb", ios::binary);
+        if(!binaryFile){
+            cout<<"Error in opening the binary file"<<endl;
+            return 0;
+        }
+        assembler.writeBinaryImage(binaryFile);
+        binaryFile.close();
+    }
 
     //print all the unoreded maps labels, dataLabels and dataSegment
     // cout<<"Labels: "<<endl;
@@ -477,5 +1947,8 @@ int main(){
     // }
     inputFile.close();
     outputFile.close();
+    if(watch){
+        watchInput(assembler, threads, writeBinary);
+    }
     return 0;
 }
\ No newline at end of file